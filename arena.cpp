@@ -0,0 +1,14 @@
+#include "arena.h"
+
+namespace {
+
+std::pmr::pool_options ArenaPoolOptions() {
+    std::pmr::pool_options options;
+    options.largest_required_pool_block = 4096;//крупнее - массивы событий больших дат, берутся у системы напрямую и возвращаются ей
+    return options;
+}
+
+}
+
+DatabaseArena::DatabaseArena()
+        : system_(std::pmr::new_delete_resource()), pool_(ArenaPoolOptions(), &system_), counting_(&pool_) {}
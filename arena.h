@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+
+//Посредник, считающий выделения памяти через него (см. команду Stats)
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream) : upstream_(upstream) {}
+
+    size_t Allocations() const {return allocations_;}
+    size_t Deallocations() const {return deallocations_;}
+    size_t BytesInUse() const {return bytes_in_use_;}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations_;
+        bytes_in_use_ += bytes;
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        ++deallocations_;
+        bytes_in_use_ -= bytes;
+        upstream_->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream_;
+    size_t allocations_ = 0;
+    size_t deallocations_ = 0;
+    size_t bytes_in_use_ = 0;
+};
+
+//Память одной базы: пул блоков фиксированных размеров (узлы деревьев, массивы номеров событий).
+//Память, отданная пулу при удалении, переиспользуется, а блоки крупнее пулов (массивы событий
+//больших дат) сразу возвращаются системе. Вся арена освобождается разом в деструкторе.
+class DatabaseArena {
+public:
+    DatabaseArena();
+
+    DatabaseArena(const DatabaseArena&) = delete;
+    DatabaseArena& operator=(const DatabaseArena&) = delete;
+
+    std::pmr::memory_resource* Resource() {return &counting_;}
+    const CountingResource& Counters() const {return counting_;}
+    //сколько памяти пул держит у системы, включая свободные блоки
+    const CountingResource& SystemCounters() const {return system_;}
+
+private:
+    CountingResource system_;//куски пула и крупные блоки, взятые у системы
+    std::pmr::unsynchronized_pool_resource pool_;
+    CountingResource counting_;//выделения базы, для статистики
+};
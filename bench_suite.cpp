@@ -0,0 +1,381 @@
+#include "bench_suite.h"
+#include "database.h"
+#include "condition_parser.h"
+#include "predicates.h"
+#include "token.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t ADD_BUFFER = 16384;//ёмкость буфера Add в замере add_buffered
+
+//splitmix64: воспроизводимый на любой платформе, в отличие от распределений <random>
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    //[0, 1)
+    double Uniform() {
+        return static_cast<double>(Next() >> 11) / static_cast<double>(1ULL << 53);
+    }
+
+    size_t Below(size_t bound) {
+        return static_cast<size_t>(Uniform() * bound);
+    }
+
+private:
+    uint64_t state_;
+};
+
+//номера 0..n-1 с вероятностью, пропорциональной 1 / (номер + 1)^s
+class Zipf {
+public:
+    Zipf(size_t n, double s) : cdf_(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / pow(static_cast<double>(i + 1), s);
+            cdf_[i] = sum;
+        }
+        for (double& value : cdf_) {
+            value /= sum;
+        }
+    }
+
+    size_t operator()(Random& random) const {
+        const size_t i = lower_bound(cdf_.begin(), cdf_.end(), random.Uniform()) - cdf_.begin();
+        return min(i, cdf_.size() - 1);
+    }
+
+private:
+    vector<double> cdf_;
+};
+
+struct Workload {
+    vector<Date> dates;
+    vector<string> events;
+    vector<string> texts;//различные события по убыванию популярности
+};
+
+//номер дня -> дата; в синтетическом году 12 месяцев по 28 дней, так что соответствие взаимно однозначно
+Date DayToDate(int day) {
+    return {2000 + day / 336, 1 + day % 336 / 28, 1 + day % 28};
+}
+
+int RandomDay(const WorkloadOptions& options, Random& random) {
+    if (options.dates == DateDistribution::Skewed) {
+        return static_cast<int>(options.days * pow(random.Uniform(), 0.25));
+    }
+    return static_cast<int>(random.Below(options.days));
+}
+
+Workload MakeWorkload(const WorkloadOptions& options) {
+    Workload workload;
+    for (size_t i = 0; i < options.distinct_events; ++i) {
+        workload.texts.push_back("event " + to_string(i) + (i % 3 == 0 ? " sport" : " holiday"));
+    }
+    Random random(options.seed);
+    const Zipf popularity(options.distinct_events, options.zipf);
+    workload.dates.reserve(options.events);
+    workload.events.reserve(options.events);
+    for (size_t i = 0; i < options.events; ++i) {
+        workload.dates.push_back(DayToDate(RandomDay(options, random)));
+        workload.events.push_back(workload.texts[popularity(random)]);
+    }
+    return workload;
+}
+
+//задержки одной операции
+class Latencies {
+public:
+    template <typename F>
+    void Measure(F operation) {
+        const auto start = chrono::steady_clock::now();
+        operation();
+        samples_.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+    }
+
+    void Write(ostream& json, const string& name, size_t items_per_op) {
+        sort(samples_.begin(), samples_.end());
+        double total = 0;
+        for (double sample : samples_) {
+            total += sample;
+        }
+        auto percentile = [this](double p) {
+            return samples_.empty() ? 0.0 : samples_[min(samples_.size() - 1, static_cast<size_t>(p * samples_.size()))];
+        };
+        json << "    \"" << name << "\": {\"ops\": " << samples_.size()
+             << ", \"ops_per_sec\": " << (total > 0 ? samples_.size() * 1e9 / total : 0.0)
+             << ", \"items_per_op\": " << items_per_op
+             << ", \"ns\": {\"mean\": " << (samples_.empty() ? 0.0 : total / samples_.size())
+             << ", \"p50\": " << percentile(0.5) << ", \"p90\": " << percentile(0.9)
+             << ", \"p99\": " << percentile(0.99) << ", \"max\": " << (samples_.empty() ? 0.0 : samples_.back())
+             << "}}";
+    }
+
+private:
+    vector<double> samples_;
+};
+
+long PeakRssKilobytes() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+//текущий, а не пиковый RSS: второе поле /proc/self/statm в страницах; -1, если файла нет (не Linux)
+long CurrentRssKilobytes() {
+    ifstream statm("/proc/self/statm");
+    long size = 0;
+    long resident = 0;
+    if (!(statm >> size >> resident)) {
+        return -1;
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+shared_ptr<Node> Parse(const string& text) {
+    istringstream is(text);
+    return ParseCondition(is);
+}
+
+//поток, выбрасывающий вывод: Print меряется без стоимости записи в файл
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override {return c;}
+    streamsize xsputn(const char*, streamsize n) override {return n;}
+};
+
+size_t ParseSize(const string& value, const string& name) {
+    if (value.empty() || value.find_first_not_of("0123456789") != string::npos) {
+        throw invalid_argument(name + " expects a number: " + value);
+    }
+    return stoull(value);
+}
+
+}
+
+WorkloadOptions ParseWorkloadOptions(const vector<string>& args, string& json_path) {
+    WorkloadOptions options;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const string& name = args[i];
+        if (i + 1 == args.size()) {
+            throw invalid_argument("Missing value for " + name);
+        }
+        const string& value = args[++i];
+        if (name == "--events") {
+            options.events = ParseSize(value, name);
+        } else if (name == "--distinct") {
+            options.distinct_events = max<size_t>(1, ParseSize(value, name));
+        } else if (name == "--zipf") {
+            options.zipf = stod(value);
+        } else if (name == "--dates") {
+            if (value != "uniform" && value != "skewed") {
+                throw invalid_argument("--dates expects uniform or skewed: " + value);
+            }
+            options.dates = value == "skewed" ? DateDistribution::Skewed : DateDistribution::Uniform;
+        } else if (name == "--days") {
+            options.days = static_cast<int>(max<size_t>(1, ParseSize(value, name)));
+        } else if (name == "--queries") {
+            options.queries = ParseSize(value, name);
+        } else if (name == "--scans") {
+            options.scans = ParseSize(value, name);
+        } else if (name == "--seed") {
+            options.seed = ParseSize(value, name);
+        } else if (name == "--json") {
+            json_path = value;
+        } else {
+            throw invalid_argument("Unknown option: " + name);
+        }
+    }
+    return options;
+}
+
+void RunBenchSuite(const WorkloadOptions& options, ostream& json) {
+    const Workload workload = MakeWorkload(options);
+    Random random(options.seed ^ 0x5DEECE66DULL);
+
+    json << fixed << setprecision(1);
+    json << "{\n  \"workload\": {\"events\": " << options.events << ", \"distinct_events\": " << options.distinct_events
+         << ", \"zipf\": " << options.zipf << ", \"dates\": \""
+         << (options.dates == DateDistribution::Skewed ? "skewed" : "uniform") << "\", \"days\": " << options.days
+         << ", \"queries\": " << options.queries << ", \"scans\": " << options.scans << ", \"seed\": " << options.seed
+         << "},\n  \"operations\": {\n";
+
+    Database db;
+    {
+        Latencies add;
+        for (size_t i = 0; i < workload.events.size(); ++i) {
+            add.Measure([&] {db.Add(workload.dates[i], workload.events[i]);});
+        }
+        add.Write(json, "add", 1);
+    }
+    const size_t stored = db.CountIf(NodePredicate(make_shared<EmptyNode>()));
+    const long rss_after_add = CurrentRssKilobytes();
+    {
+        //те же события через буфер Add: задержка включает редкие слияния пачки
+        Database buffered;
+        buffered.SetAddBuffer(ADD_BUFFER);
+        Latencies add;
+        for (size_t i = 0; i < workload.events.size(); ++i) {
+            add.Measure([&] {buffered.Add(workload.dates[i], workload.events[i]);});
+        }
+        add.Measure([&] {buffered.Flush();});
+        json << ",\n";
+        add.Write(json, "add_buffered", 1);
+    }
+
+    const string popular = workload.texts.front();
+    const string rare = workload.texts.back();
+    const string middle_date = DayToDate(options.days / 2).ToString();
+    const string late_date = DayToDate(options.days * 9 / 10).ToString();
+    const vector<pair<string, string>> shapes = {
+            {"find_date_range", "date >= " + middle_date + " AND date < " + late_date},
+            {"find_event_equal_popular", "event == \"" + popular + "\""},
+            {"find_event_equal_rare", "event == \"" + rare + "\""},
+            {"find_date_range_and_event", "date >= " + middle_date + " AND event == \"" + popular + "\""},
+            {"find_event_one_of", "event == \"" + popular + "\" OR event == \"" + rare + "\""},
+            {"find_generic", "event != \"" + popular + "\" AND (date < " + middle_date + " OR date > " + late_date + ")"},
+            {"find_all", ""},
+    };
+    for (const auto& shape : shapes) {
+        const auto condition = Parse(shape.second);
+        Latencies find;
+        size_t found = 0;
+        for (size_t r = 0; r < options.scans; ++r) {
+            find.Measure([&] {
+                found = DispatchCondition(condition, [&db](auto predicate) {return db.FindIf(predicate).size();});
+            });
+        }
+        json << ",\n";
+        find.Write(json, shape.first, found);
+    }
+
+    {
+        Latencies last;
+        for (size_t q = 0; q < options.queries; ++q) {
+            const Date date = DayToDate(RandomDay(options, random));
+            last.Measure([&] {db.LastEntry(date);});
+        }
+        json << ",\n";
+        last.Write(json, "last", 1);
+    }
+    {
+        NullBuffer null_buffer;
+        ostream null_stream(&null_buffer);
+        Latencies print;
+        for (size_t r = 0; r < max<size_t>(1, options.scans / 4); ++r) {
+            print.Measure([&] {db.Print(null_stream);});
+        }
+        json << ",\n";
+        print.Write(json, "print", stored);
+    }
+
+    vector<string> texts;
+    for (size_t q = 0; q < options.queries; ++q) {
+        texts.push_back(shapes[q % shapes.size()].second);
+    }
+    {
+        Latencies tokenize;
+        for (const string& text : texts) {
+            tokenize.Measure([&] {
+                istringstream is(text);
+                Tokenize(is);
+            });
+        }
+        json << ",\n";
+        tokenize.Write(json, "tokenize", 1);
+    }
+    {
+        Latencies parse;
+        for (const string& text : texts) {
+            parse.Measure([&] {Parse(text);});
+        }
+        json << ",\n";
+        parse.Write(json, "parse_condition", 1);
+    }
+
+    //стоимость статистики (stats.h): одни и те же проходы и разборы с выключенной и включённой
+    //статистикой вперемешку; сравниваются медианы, чтобы шум машины не решал исход
+    {
+        const auto condition = Parse(shapes[5].second);
+        vector<double> scan[2], parse[2];//[включена]
+        for (size_t r = 0; r < 4 * max<size_t>(options.scans, 2); ++r) {
+            const bool enabled = r % 2;
+            Stats::Instance().SetEnabled(enabled);
+            auto start = chrono::steady_clock::now();
+            DispatchCondition(condition, [&db](auto predicate) {return db.CountIf(predicate);});
+            scan[enabled].push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+            start = chrono::steady_clock::now();
+            for (const string& text : texts) {
+                Parse(text);
+            }
+            parse[enabled].push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+        }
+        Stats::Instance().SetEnabled(true);
+        auto overhead = [](vector<double> (&samples)[2]) {
+            for (auto& side : samples) {
+                nth_element(side.begin(), side.begin() + side.size() / 2, side.end());
+            }
+            return 100 * (samples[1][samples[1].size() / 2] / samples[0][samples[0].size() / 2] - 1);
+        };
+        json << ",\n    \"instrumentation_overhead_percent\": {\"scan\": " << overhead(scan)
+             << ", \"parse\": " << overhead(parse) << "}";
+    }
+
+    {
+        //удаление старой половины дат: без разделов и с разделами по месяцам, где выбранные
+        //целиком месяцы уходят без обхода событий
+        const auto condition = Parse("date < " + middle_date);
+        for (bool partitioned : {false, true}) {
+            Database retained(db);
+            if (partitioned) {
+                retained.SetPartitioning(DatePartitioning::Month);
+            }
+            Latencies remove_before;
+            size_t removed = 0;
+            remove_before.Measure([&] {
+                removed = DispatchCondition(condition, [&retained](auto predicate) {return retained.RemoveIf(predicate);});
+            });
+            json << ",\n";
+            remove_before.Write(json, partitioned ? "remove_date_before_partitioned" : "remove_date_before", removed);
+        }
+    }
+
+    {
+        Latencies remove_date;
+        size_t removed = 0;
+        for (size_t q = 0; q < options.queries; ++q) {
+            const auto condition = Parse("date == " + DayToDate(RandomDay(options, random)).ToString());
+            remove_date.Measure([&] {
+                removed += DispatchCondition(condition, [&db](auto predicate) {return db.RemoveIf(predicate);});
+            });
+        }
+        json << ",\n";
+        remove_date.Write(json, "remove_date", options.queries ? removed / options.queries : 0);
+
+        Latencies remove_event;
+        const auto condition = Parse("event == \"" + popular + "\"");
+        size_t removed_events = 0;
+        remove_event.Measure([&] {
+            removed_events = DispatchCondition(condition, [&db](auto predicate) {return db.RemoveIf(predicate);});
+        });
+        json << ",\n";
+        remove_event.Write(json, "remove_event_popular", removed_events);
+    }
+
+    json << "\n  },\n  \"stored_events\": " << stored << ",\n  \"rss_after_add_kb\": " << rss_after_add
+         << ",\n  \"peak_rss_kb\": " << PeakRssKilobytes() << "\n}\n";
+}
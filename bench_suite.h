@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Набор замеров db_bench: синтетическая нагрузка, задаваемая параметрами и зерном генератора,
+//так что одинаковые параметры дают одинаковые данные и запросы от запуска к запуску.
+
+enum class DateDistribution {
+    Uniform,    //даты равномерно по всему диапазону
+    Skewed      //большая часть событий - в последних датах диапазона
+};
+
+struct WorkloadOptions {
+    size_t events = 200000;
+    size_t distinct_events = 3000;
+    double zipf = 1.0;//показатель популярности событий, 0 - равномерно
+    DateDistribution dates = DateDistribution::Uniform;
+    int days = 3650;//ширина диапазона дат начиная с 2000-01-01
+    size_t queries = 2000;//замеров на дешёвые операции (Last, разбор условий, точечные удаления)
+    size_t scans = 20;//замеров на полные проходы (FindIf, Print)
+    uint64_t seed = 42;
+};
+
+//разбирает --events N, --distinct N, --zipf S, --dates uniform|skewed, --days N, --queries N,
+//--scans N, --seed N, --json FILE; invalid_argument при ошибке
+WorkloadOptions ParseWorkloadOptions(const vector<string>& args, string& json_path);
+
+//выполняет все замеры и пишет отчёт в JSON
+void RunBenchSuite(const WorkloadOptions& options, ostream& json);
@@ -0,0 +1,90 @@
+#pragma once
+#include "bit_ops.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+//битовая маска выбранных событий одной даты: бит i - событие i
+using Bitmap = vector<uint64_t>;
+
+inline size_t BitmapWords(size_t size) {
+    return (size + 63) / 64;
+}
+
+inline void ClearBitmap(Bitmap& bitmap, size_t size) {
+    bitmap.assign(BitmapWords(size), 0);
+}
+
+inline void FillBitmap(Bitmap& bitmap, size_t size) {
+    bitmap.assign(BitmapWords(size), ~uint64_t(0));
+    if (size % 64 != 0) {
+        bitmap.back() = (uint64_t(1) << (size % 64)) - 1;
+    }
+}
+
+//инверсия в пределах первых size бит
+inline void InvertBitmap(Bitmap& bitmap, size_t size) {
+    for (uint64_t& word : bitmap) {
+        word = ~word;
+    }
+    if (size % 64 != 0 && !bitmap.empty()) {
+        bitmap.back() &= (uint64_t(1) << (size % 64)) - 1;
+    }
+}
+
+inline void SetBit(Bitmap& bitmap, size_t i) {
+    bitmap[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+inline bool TestBit(const Bitmap& bitmap, size_t i) {
+    return (bitmap[i / 64] >> (i % 64)) & 1;
+}
+
+inline size_t CountBits(const Bitmap& bitmap) {
+    size_t count = 0;
+    for (uint64_t word : bitmap) {
+        count += PopCount(word);
+    }
+    return count;
+}
+
+inline bool AnyBit(const Bitmap& bitmap) {
+    for (uint64_t word : bitmap) {
+        if (word) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//вызывает f(i) для каждого установленного бита по возрастанию i
+template <typename F>
+void ForEachBit(const Bitmap& bitmap, F f) {
+    for (size_t w = 0; w < bitmap.size(); ++w) {
+        uint64_t word = bitmap[w];
+        while (word) {
+            f(w * 64 + LowestBit(word));
+            word &= word - 1;
+        }
+    }
+}
+
+//как ForEachBit, но по убыванию i при reverse и с остановкой, как только f(i) вернёт false;
+//возвращает false, если обход был остановлен
+template <typename F>
+bool ForEachBitWhile(const Bitmap& bitmap, bool reverse, F f) {
+    for (size_t k = 0; k < bitmap.size(); ++k) {
+        const size_t w = reverse ? bitmap.size() - 1 - k : k;
+        uint64_t word = bitmap[w];
+        while (word) {
+            const size_t bit = reverse ? HighestBit(word) : LowestBit(word);
+            if (!f(w * 64 + bit)) {
+                return false;
+            }
+            word &= ~(uint64_t(1) << bit);
+        }
+    }
+    return true;
+}
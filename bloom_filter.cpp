@@ -0,0 +1,50 @@
+#include "bloom_filter.h"
+
+#include <algorithm>
+#include <cstring>
+
+BloomFilter::BloomFilter(size_t expected_keys, size_t bits_per_key)
+        : bits_((max<size_t>(expected_keys, 1) * bits_per_key + 63) / 64),
+          hashes_(static_cast<uint32_t>(min<size_t>(max<size_t>(bits_per_key * 69 / 100, 1), 30))) {}//k = m/n * ln 2
+
+uint64_t BloomFilter::Hash(string_view key) {
+    //FNV-1a по 8 байт с перемешиванием splitmix64 в конце
+    uint64_t hash = 0xcbf29ce484222325ULL ^ key.size();
+    size_t i = 0;
+    for (; i + 8 <= key.size(); i += 8) {
+        uint64_t word;
+        memcpy(&word, key.data() + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < key.size(); ++i) {
+        hash = (hash ^ static_cast<unsigned char>(key[i])) * 0x100000001b3ULL;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+void BloomFilter::Add(string_view key) {
+    const uint64_t hash = Hash(key);
+    const uint64_t bits = bits_.size() * 64;
+    uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (uint32_t i = 0; i < hashes_; ++i, h1 += h2) {
+        const uint64_t bit = h1 % bits;
+        bits_[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+}
+
+bool BloomFilter::MayContain(string_view key) const {
+    const uint64_t hash = Hash(key);
+    const uint64_t bits = bits_.size() * 64;
+    uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (uint32_t i = 0; i < hashes_; ++i, h1 += h2) {
+        const uint64_t bit = h1 % bits;
+        if (!(bits_[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
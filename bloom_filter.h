@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+//Фильтр Блума: MayContain ложно только для ключей, которых точно не добавляли.
+//bits_per_key бит на ожидаемый ключ; число хешей подбирается под него (10 бит - около 1% ложных
+//срабатываний). Позиции - двойное хеширование h1 + i*h2 от одного 64-битного хеша ключа.
+class BloomFilter {
+public:
+    explicit BloomFilter(size_t expected_keys = 0, size_t bits_per_key = 10);
+
+    void Add(string_view key);
+    bool MayContain(string_view key) const;
+
+    size_t MemoryUsage() const {return bits_.size() * sizeof(uint64_t);}
+
+    static uint64_t Hash(string_view key);
+
+private:
+    vector<uint64_t> bits_;
+    uint32_t hashes_;
+};
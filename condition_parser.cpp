@@ -1,6 +1,8 @@
 #include "condition_parser.h"
 #include "token.h"
+#include "stats.h"
 #include <map>
+#include <algorithm>
 
 
 
@@ -104,7 +106,18 @@ shared_ptr<Node> ParseExpression(It& current, It end, unsigned precedence) {
 }
 
 shared_ptr<Node> ParseCondition(istream& is) {
+    return ParseCondition(is, nullptr);
+}
+
+shared_ptr<Node> ParseCondition(istream& is, ParseTiming* timing) {
+    static thread_local uint32_t calls = 0;
+    auto timer = MakeScopedTimer([](chrono::nanoseconds latency) {Stats::Instance().RecordParse(latency);},
+                                 ++calls % Stats::PARSE_SAMPLE == 0);
+    const auto start = timing ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
     auto tokens = Tokenize(is);
+    if (timing) {
+        timing->tokenize = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    }
     auto current = tokens.begin();
     auto top_node = ParseExpression(current, tokens.end(), 0u);
 
@@ -116,5 +129,278 @@ shared_ptr<Node> ParseCondition(istream& is) {
         throw logic_error("Unexpected tokens after condition");
     }
 
+    if (timing) {
+        timing->parse = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start) - timing->tokenize;
+    }
     return top_node;
 }
+
+namespace {
+
+//последнее слово text и позиция его начала; пустое, если текст кончился
+string LastWord(const string& text, size_t& begin) {
+    size_t end = text.find_last_not_of(" \t\r");
+    if (end == string::npos) {
+        begin = 0;
+        return "";
+    }
+    size_t start = text.find_last_of(" \t", end);
+    begin = start == string::npos ? 0 : start + 1;
+    return text.substr(begin, end + 1 - begin);
+}
+
+//конец последней строки в кавычках (как их читает Tokenize: от кавычки до следующей);
+//0, если кавычек нет, и размер text, если последняя кавычка не закрыта
+size_t QuotedEnd(const string& text) {
+    size_t end = 0;
+    for (size_t open = text.find('"'); open != string::npos; open = text.find('"', end)) {
+        const size_t close = text.find('"', open + 1);
+        if (close == string::npos) {
+            return text.size();
+        }
+        end = close + 1;
+    }
+    return end;
+}
+
+size_t ParseCount(const string& word, const string& keyword) {
+    if (word.empty() || word.find_first_not_of("0123456789") != string::npos) {
+        throw logic_error(keyword + " expects a non-negative number");
+    }
+    return stoull(word);
+}
+
+}
+
+FindOptions ParseFindOptions(string& text) {
+    FindOptions options;
+    bool limit = false, offset = false;
+    //параметры - только слова после последнего токена условия: текст в кавычках им не отдаётся
+    const size_t quoted_end = QuotedEnd(text);
+    while (true) {
+        size_t begin = 0;
+        const string word = LastWord(text, begin);
+        if (begin < quoted_end) {
+            return options;
+        }
+        if (word == "DESC" && !options.descending) {
+            options.descending = true;
+            text.resize(begin);
+            continue;
+        }
+        //число и ключевое слово перед ним
+        size_t keyword_begin = 0;
+        const string keyword = LastWord(text.substr(0, begin), keyword_begin);
+        if (keyword_begin >= quoted_end && ((keyword == "LIMIT" && !limit) || (keyword == "OFFSET" && !offset))) {
+            const size_t value = ParseCount(word, keyword);
+            if (keyword == "LIMIT") {
+                options.limit = value;
+                limit = true;
+            } else {
+                options.offset = value;
+                offset = true;
+            }
+            text.resize(keyword_begin);
+            continue;
+        }
+        return options;
+    }
+}
+
+string ParseEvent(istream& is) {
+    string res;
+    is >> ws;
+    getline(is, res);
+    return res;
+}
+
+namespace {
+
+bool CollectConjunction(const shared_ptr<Node>& node, ConditionShape& shape) {
+    if (dynamic_pointer_cast<EmptyNode>(node)) {
+        return true;
+    }
+    if (auto logical = dynamic_pointer_cast<LogicalOperationNode>(node)) {
+        return logical->GetOperation() == LogicalOperation::And &&
+               CollectConjunction(logical->GetLeft(), shape) &&
+               CollectConjunction(logical->GetRight(), shape);
+    }
+    if (auto date_node = dynamic_pointer_cast<DateComparisonNode>(node)) {
+        const int packed = date_node->GetDate().GetPacked();
+        switch (date_node->GetComparison()) {
+            case Comparison::Less:
+                shape.date_to = min(shape.date_to, packed - 1);
+                return true;
+            case Comparison::LessOrEqual:
+                shape.date_to = min(shape.date_to, packed);
+                return true;
+            case Comparison::Greater:
+                shape.date_from = max(shape.date_from, packed + 1);
+                return true;
+            case Comparison::GreaterOrEqual:
+                shape.date_from = max(shape.date_from, packed);
+                return true;
+            case Comparison::Equal:
+                shape.date_from = max(shape.date_from, packed);
+                shape.date_to = min(shape.date_to, packed);
+                return true;
+            default:
+                return false;
+        }
+    }
+    if (auto event_node = dynamic_pointer_cast<EventComparisonNode>(node)) {
+        if (event_node->GetComparison() != Comparison::Equal || !shape.events.empty()) {
+            return false;
+        }
+        shape.events.push_back(event_node->GetEvent());
+        return true;
+    }
+    return false;
+}
+
+bool CollectDisjunction(const shared_ptr<Node>& node, vector<string>& events) {
+    if (auto logical = dynamic_pointer_cast<LogicalOperationNode>(node)) {
+        return logical->GetOperation() == LogicalOperation::Or &&
+               CollectDisjunction(logical->GetLeft(), events) &&
+               CollectDisjunction(logical->GetRight(), events);
+    }
+    if (auto event_node = dynamic_pointer_cast<EventComparisonNode>(node)) {
+        if (event_node->GetComparison() != Comparison::Equal) {
+            return false;
+        }
+        events.push_back(event_node->GetEvent());
+        return true;
+    }
+    return false;
+}
+
+}
+
+ConditionShape AnalyzeCondition(const shared_ptr<Node>& condition) {
+    ConditionShape shape;
+    if (CollectConjunction(condition, shape)) {
+        const bool full_range = shape.date_from == INT_MIN && shape.date_to == INT_MAX;
+        if (shape.events.empty()) {
+            shape.type = ConditionShapeType::DateRange;
+        } else if (full_range) {
+            shape.type = ConditionShapeType::EventEqual;
+        } else {
+            shape.type = ConditionShapeType::DateRangeAndEvent;
+        }
+        return shape;
+    }
+
+    ConditionShape disjunction;
+    if (CollectDisjunction(condition, disjunction.events)) {
+        disjunction.type = ConditionShapeType::EventOneOf;
+        return disjunction;
+    }
+    return ConditionShape();
+}
+
+namespace {
+
+const char* ComparisonText(Comparison cmp) {
+    switch (cmp) {
+        case Comparison::Less:
+            return "<";
+        case Comparison::LessOrEqual:
+            return "<=";
+        case Comparison::Greater:
+            return ">";
+        case Comparison::GreaterOrEqual:
+            return ">=";
+        case Comparison::Equal:
+            return "==";
+        default:
+            return "!=";
+    }
+}
+
+//операнды цепочки одинаковых логических операций: (a AND b) AND c -> a, b, c
+void CollectOperands(const shared_ptr<Node>& node, LogicalOperation operation, vector<string>& operands) {
+    auto logical = dynamic_pointer_cast<LogicalOperationNode>(node);
+    if (logical && logical->GetOperation() == operation) {
+        CollectOperands(logical->GetLeft(), operation, operands);
+        CollectOperands(logical->GetRight(), operation, operands);
+    } else {
+        operands.push_back(CanonicalCondition(node));
+    }
+}
+
+}
+
+string CanonicalCondition(const shared_ptr<Node>& condition) {
+    if (dynamic_pointer_cast<EmptyNode>(condition)) {
+        return "*";
+    }
+    if (auto date_node = dynamic_pointer_cast<DateComparisonNode>(condition)) {
+        return "date" + string(ComparisonText(date_node->GetComparison())) + date_node->GetDate().ToString();
+    }
+    if (auto event_node = dynamic_pointer_cast<EventComparisonNode>(condition)) {
+        string result = "event" + string(ComparisonText(event_node->GetComparison())) + '"';
+        for (char c : event_node->GetEvent()) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + '"';
+    }
+    if (auto logical = dynamic_pointer_cast<LogicalOperationNode>(condition)) {
+        vector<string> operands;
+        CollectOperands(condition, logical->GetOperation(), operands);
+        sort(operands.begin(), operands.end());
+        operands.erase(unique(operands.begin(), operands.end()), operands.end());
+        if (operands.size() == 1) {
+            return operands.front();
+        }
+        string result = "(";
+        for (size_t i = 0; i < operands.size(); ++i) {
+            if (i > 0) {
+                result += logical->GetOperation() == LogicalOperation::And ? '&' : '|';
+            }
+            result += operands[i];
+        }
+        return result + ')';
+    }
+    return "!";//AlwaysFalseNode
+}
+
+pair<int, int> ConditionDateRange(const shared_ptr<Node>& condition) {
+    if (dynamic_pointer_cast<AlwaysFalseNode>(condition)) {
+        return {INT_MAX, INT_MIN};
+    }
+    if (auto date_node = dynamic_pointer_cast<DateComparisonNode>(condition)) {
+        const int packed = date_node->GetDate().GetPacked();
+        switch (date_node->GetComparison()) {
+            case Comparison::Less:
+                return {INT_MIN, packed - 1};
+            case Comparison::LessOrEqual:
+                return {INT_MIN, packed};
+            case Comparison::Greater:
+                return {packed + 1, INT_MAX};
+            case Comparison::GreaterOrEqual:
+                return {packed, INT_MAX};
+            case Comparison::Equal:
+                return {packed, packed};
+            default:
+                return {INT_MIN, INT_MAX};
+        }
+    }
+    if (auto logical = dynamic_pointer_cast<LogicalOperationNode>(condition)) {
+        const auto left = ConditionDateRange(logical->GetLeft());
+        const auto right = ConditionDateRange(logical->GetRight());
+        if (logical->GetOperation() == LogicalOperation::And) {
+            return {max(left.first, right.first), min(left.second, right.second)};
+        }
+        if (left.first > left.second) {
+            return right;
+        }
+        if (right.first > right.second) {
+            return left;
+        }
+        return {min(left.first, right.first), max(left.second, right.second)};
+    }
+    return {INT_MIN, INT_MAX};//пустое условие и сравнения события
+}
@@ -2,10 +2,65 @@
 
 #include "node.h"
 
+#include <chrono>
 #include <iostream>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 using namespace std;
 
 shared_ptr<Node> ParseCondition(istream& is);
 
+//время разбора по фазам для журнала медленных запросов
+struct ParseTiming {
+    chrono::nanoseconds tokenize{0};
+    chrono::nanoseconds parse{0};//ParseExpression
+};
+
+shared_ptr<Node> ParseCondition(istream& is, ParseTiming* timing);
+
+//Постраничный вывод Find: пропустить offset записей, вывести не больше limit, при descending -
+//от последней даты к первой и от последнего события даты к первому
+struct FindOptions {
+    size_t limit = SIZE_MAX;
+    size_t offset = 0;
+    bool descending = false;
+
+    bool Paged() const {return limit != SIZE_MAX || offset != 0 || descending;}
+};
+
+//Снимает с конца текста команды Find уточнения LIMIT n, OFFSET m и DESC (в любом порядке)
+//и возвращает их; в text остаётся само условие
+FindOptions ParseFindOptions(string& text);
+
+//Событие команды Add: остаток строки без ведущих пробелов
+string ParseEvent(istream& is);
+
+//часто встречающиеся формы условий, для которых есть специализированные предикаты (predicates.h)
+enum class ConditionShapeType {
+    Generic,            //произвольное дерево, вычисляется через Node::Evaluate
+    DateRange,          //конъюнкция сравнений даты (в том числе пустое условие)
+    EventEqual,         //event == "x"
+    DateRangeAndEvent,  //сравнения даты AND event == "x"
+    EventOneOf          //event == "x" OR event == "y" OR ...
+};
+
+struct ConditionShape {
+    ConditionShapeType type = ConditionShapeType::Generic;
+    int date_from = INT_MIN;//границы включительно, в упакованном виде (Date::GetPacked)
+    int date_to = INT_MAX;
+    vector<string> events;
+};
+
+ConditionShape AnalyzeCondition(const shared_ptr<Node>& condition);
+
+//Каноническая запись условия: одинакова для равносильных написаний, отличающихся пробелами,
+//скобками, порядком и повторением операндов AND/OR. Ключ кэша результатов Find
+string CanonicalCondition(const shared_ptr<Node>& condition);
+
+//Упакованные даты [first, second], вне которых условие ложно; пустой диапазон - first > second
+pair<int, int> ConditionDateRange(const shared_ptr<Node>& condition);
+
 void TestParseCondition();
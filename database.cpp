@@ -1,57 +1,769 @@
 #include "database.h"
+#include "condition_parser.h"
+#include "predicates.h"
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <new>
+#include <utility>
 
+const size_t Database::DEFAULT_EVENT_FILTER_BITS;
+const size_t Database::MAX_EVENT_FILTER_BITS;
+const size_t Database::MAX_ADD_BUFFER;
+const size_t Database::DICTIONARY_COMPACT_MIN;
 
+Database::Storage* Database::CreateStorage(DatabaseArena* arena, const Storage* source){
+    if(!arena)
+        return source ? new Storage(*source, std::pmr::new_delete_resource()) : new Storage(std::pmr::new_delete_resource());
+    std::pmr::memory_resource* resource = arena->Resource();
+    void* place = resource->allocate(sizeof(Storage), alignof(Storage));
+    return source ? new (place) Storage(*source, resource) : new (place) Storage(resource);
+}
+
+Database::Partition::Partition(int key, DatabaseAllocation allocation, const Storage* source)
+        : key(key),
+          arena(allocation == DatabaseAllocation::Arena ? new DatabaseArena : nullptr),
+          storage(CreateStorage(arena.get(), source)) {}
+
+Database::Partition::Partition(int key, std::shared_ptr<const Segment> segment)
+        : key(key), storage(nullptr), segment(std::move(segment)) {}
+
+Database::Partition::Partition(Partition&& other) noexcept
+        : key(other.key), arena(std::move(other.arena)), storage(other.storage), segment(std::move(other.segment)) {
+    other.storage = nullptr;
+}
+
+Database::Partition& Database::Partition::operator=(Partition&& other) noexcept{
+    if(this != &other){
+        Drop();
+        key = other.key;
+        arena = std::move(other.arena);
+        storage = other.storage;
+        segment = std::move(other.segment);
+        other.storage = nullptr;
+    }
+    return *this;
+}
+
+Database::Partition::~Partition(){
+    Drop();
+}
+
+void Database::Partition::Release(){
+    if(!arena)
+        delete storage;
+    //иначе storage лежит в арене: узлы деревьев и массивы не обходятся, арена отдаёт свои куски целиком
+    arena.reset();
+    storage = nullptr;
+}
+
+void Database::Partition::Drop(){
+    Release();
+    segment.reset();
+}
+
+Database::Database(DatabaseAllocation allocation) : allocation_(allocation) {}
+
+Database::Database(const Database& other)
+        : dictionary_(other.dictionary_),
+          allocation_(other.allocation_),
+          partitioning_(other.partitioning_),
+          pending_(other.pending_),
+          partitions_dropped_(other.partitions_dropped_),
+          cold_before_(other.cold_before_),
+          segment_directory_(other.segment_directory_),
+          views_(other.views_),
+          add_buffer_(other.add_buffer_),
+          event_filter_bits_(other.event_filter_bits_) {
+    //выгруженные разделы копия делит с исходной базой: сегменты неизменяемы
+    partitions_.reserve(other.partitions_.size());
+    for(const Partition& partition : other.partitions_){
+        if(partition.storage){
+            partitions_.emplace_back(partition.key, allocation_, partition.storage);
+            partitions_.back().segment = partition.segment;
+        } else {
+            partitions_.emplace_back(partition.key, partition.segment);
+        }
+    }
+    for(const Partition& partition : partitions_)
+        if(partition.storage && Cold(partition.key))
+            SegmentBudget::Instance().Touch(this, partition.key, PartitionMemory(partition), &EvictCallback);
+}
+
+//разделы со своими аренами переходят целиком; исходной базе остаются пустые разделы и новый словарь
+Database::Database(Database&& other)
+        : dictionary_(std::exchange(other.dictionary_, std::make_shared<EventDictionary>())),
+          allocation_(other.allocation_),
+          partitioning_(other.partitioning_),
+          partitions_(std::move(other.partitions_)),
+          pending_(std::exchange(other.pending_, 0)),
+          partitions_dropped_(other.partitions_dropped_),
+          cold_before_(std::exchange(other.cold_before_, INT_MIN)),
+          segment_directory_(other.segment_directory_),
+          pages_in_(other.pages_in_),
+          evictions_(other.evictions_),
+          segments_skipped_(other.segments_skipped_),
+          views_(std::move(other.views_)),
+          cache_(std::move(other.cache_)),
+          add_buffer_(other.add_buffer_),
+          event_filter_bits_(other.event_filter_bits_) {
+    other.partitions_.clear();
+    other.views_.clear();
+    if(Tiered())//записи бюджета следуют за разделами
+        SegmentBudget::Instance().SwapOwners(this, &other);
+}
+
+Database& Database::operator=(Database other){
+    swap(other);
+    return *this;
+}
+
+Database::~Database(){
+    if(Tiered())
+        SegmentBudget::Instance().ForgetOwner(this);
+}
+
+void Database::swap(Database& other){
+    if(Tiered() || other.Tiered())//записи бюджета следуют за разделами
+        SegmentBudget::Instance().SwapOwners(this, &other);
+    std::swap(dictionary_, other.dictionary_);
+    std::swap(allocation_, other.allocation_);
+    std::swap(partitioning_, other.partitioning_);
+    std::swap(partitions_, other.partitions_);
+    std::swap(pending_, other.pending_);
+    std::swap(partitions_dropped_, other.partitions_dropped_);
+    std::swap(cold_before_, other.cold_before_);
+    std::swap(segment_directory_, other.segment_directory_);
+    std::swap(pages_in_, other.pages_in_);
+    std::swap(evictions_, other.evictions_);
+    std::swap(segments_skipped_, other.segments_skipped_);
+    std::swap(views_, other.views_);
+    std::swap(cache_, other.cache_);
+    std::swap(add_buffer_, other.add_buffer_);
+    std::swap(event_filter_bits_, other.event_filter_bits_);
+}
+
+void Database::Clear(){
+    Database cleared(allocation_);
+    for(const auto& view : views_)//представления остаются зарегистрированными, но пустыми
+        cleared.views_.emplace_back(view.Name(), view.ConditionText(), view.Condition());
+    cleared.add_buffer_ = add_buffer_;
+    cleared.partitioning_ = partitioning_;
+    cleared.partitions_dropped_ = partitions_dropped_;
+    cleared.cold_before_ = cold_before_;
+    cleared.segment_directory_ = segment_directory_;
+    cleared.event_filter_bits_ = event_filter_bits_;
+    cleared.swap(*this);
+}
 
 void Database::Add(const Date& date, const std::string& event){
-    if(!ALL_DATA_SET.count(date) || !ALL_DATA_SET.at(date).count(event)){
-        ALL_DATA[date].push_back(event);
-        ALL_DATA_SET[date].insert(event);
-    }//добавляем событие,если оно отсутствует
+    const uint32_t id = dictionary_->Intern(event);
+    const int packed = date.GetPacked();
+    Storage& storage = PartitionFor(packed);
+    if(storage.ALL_DATA_SET.Insert(packed, id)){//добавляем событие,если оно отсутствует
+        if(add_buffer_){
+            storage.PENDING.emplace_back(packed, id);
+            ++pending_;
+        } else {
+            storage.ALL_DATA.FindOrInsert(packed, dictionary_.get()).push_back(id, event_filter_bits_);
+            storage.LAST.Set(packed, id);
+        }
+        for(auto& view : views_)
+            view.OnAdd(date, event, id, dictionary_.get());
+        if(!cache_.empty())
+            cache_.Invalidate(packed, packed);
+        if(add_buffer_ && pending_ >= add_buffer_)
+            MergePending();
+    }
+
+}
+
+void Database::SetAddBuffer(size_t capacity){
+    Flush();
+    add_buffer_ = std::min(capacity, MAX_ADD_BUFFER);
+}
+
+Database::Storage* Database::FindPartition(int date) const{
+    const int key = PartitionKey(date);
+    auto partition = std::lower_bound(partitions_.begin(), partitions_.end(), key,
+                                      [](const Partition& p, int key){return p.key < key;});
+    return partition != partitions_.end() && partition->key == key ? &Resident(*partition) : nullptr;
+}
+
+Database::Storage& Database::PartitionFor(int date){
+    const int key = PartitionKey(date);
+    if(!partitions_.empty() && partitions_.back().key == key && !Cold(key))//события обычно приходят в последний раздел
+        return *partitions_.back().storage;
+    auto partition = std::lower_bound(partitions_.begin(), partitions_.end(), key,
+                                      [](const Partition& p, int key){return p.key < key;});
+    if(partition == partitions_.end() || partition->key != key)
+        partition = partitions_.emplace(partition, key, allocation_, nullptr);
+    Storage& storage = Resident(*partition);
+    partition->segment.reset();//раздел будет меняться: при выгрузке сегмент пишется заново
+    return storage;
+}
+
+void Database::RemoveDroppedPartitions(){
+    partitions_.erase(std::remove_if(partitions_.begin(), partitions_.end(), [](const Partition& partition){
+        return partition.storage == nullptr && partition.segment == nullptr;
+    }), partitions_.end());
+}
+
+void Database::DropPartition(Partition& partition){
+    if(Tiered())
+        SegmentBudget::Instance().Forget(this, partition.key);
+    partition.Drop();
+}
+
+int Database::DropWholePartition(Partition& partition, int& removed_from, int& removed_to){
+    const int first = PartitionFirstDate(partition), last = PartitionLastDate(partition);
+    for(auto& view : views_)
+        view.OnRemoveDates(first, last);
+    removed_from = std::min(removed_from, first);
+    removed_to = std::max(removed_to, last);
+    //индекс повторов хранит каждое событие раздела ровно один раз
+    const int count = static_cast<int>(partition.storage ? partition.storage->ALL_DATA_SET.size() : partition.segment->size());
+    DropPartition(partition);
+    ++partitions_dropped_;
+    return count;
+}
+
+void Database::CompactDictionary(){
+    if(dictionary_->size() < DICTIONARY_COMPACT_MIN)
+        return;
+    Flush();
+    size_t live = 0;//оценка сверху: пар (дата, событие) не меньше, чем различных событий в них
+    for(const Partition& partition : partitions_)
+        live += partition.storage ? partition.storage->ALL_DATA_SET.size() : 1;
+    if(dictionary_->size() <= 2 * live)
+        return;
+    auto compacted = std::make_shared<EventDictionary>();
+    std::vector<uint32_t> remap(dictionary_->size(), EventDictionary::NO_EVENT);
+    auto map = [&](uint32_t id){
+        if(remap[id] == EventDictionary::NO_EVENT)
+            remap[id] = compacted->Intern(dictionary_->Get(id));
+        return remap[id];
+    };
+    for(Partition& partition : partitions_){
+        if(!partition.storage){//PartitionLast ищет последнее событие сегмента в словаре
+            compacted->Intern(partition.segment->LastEvent());
+            continue;
+        }
+        Storage& storage = *partition.storage;
+        for(DateDirectory::Block& block : storage.ALL_DATA.Blocks())
+            for(EventColumn& column : block.columns)
+                column.Remap(compacted.get(), map);
+        storage.ALL_DATA_SET.Remap(map);
+        storage.LAST.Rebuild(storage.ALL_DATA);
+    }
+    for(auto& view : views_)
+        view.Remap(compacted.get(), map);
+    dictionary_ = std::move(compacted);
+}
+
+void Database::SetTiering(const Date& cold_before, const std::string& directory){
+    if(partitioning_ == DatePartitioning::None)
+        throw std::invalid_argument("Tiering needs month or year partitions");
+    if(directory.empty() && segment_directory_.empty())
+        throw std::invalid_argument("Tiering needs a segment directory");
+    Flush();
+    if(!directory.empty())
+        segment_directory_ = directory;
+    std::filesystem::create_directories(segment_directory_);
+    cold_before_ = cold_before.GetPacked();
+    ApplyTiering();
+    CompactDictionary();
+}
+
+void Database::DisableTiering(){
+    if(!Tiered())
+        return;
+    SegmentBudget::Instance().ForgetOwner(this);//загружаемые разделы больше не вытесняются
+    for(Partition& partition : partitions_){
+        if(!partition.storage)
+            LoadPartition(partition);
+        partition.segment.reset();
+    }
+    cold_before_ = INT_MIN;
+}
+
+size_t Database::EvictedPartitions() const{
+    return std::count_if(partitions_.begin(), partitions_.end(), [](const Partition& partition){
+        return partition.storage == nullptr;
+    });
+}
+
+void Database::ApplyTiering(){
+    SegmentBudget& budget = SegmentBudget::Instance();
+    for(Partition& partition : partitions_){
+        if(!Cold(partition.key)){
+            if(!partition.storage)
+                LoadPartition(partition);
+            partition.segment.reset();
+            budget.Forget(this, partition.key);
+            continue;
+        }
+        if(!partition.storage)
+            continue;
+        if(!partition.segment)
+            partition.segment = WriteSegment(*partition.storage);
+        if(partition.segment){
+            budget.Forget(this, partition.key);
+            partition.Release();
+            ++evictions_;
+        }
+    }
+}
+
+Database::Storage& Database::PageIn(Partition& partition) const{
+    if(!partition.storage)
+        LoadPartition(partition);
+    if(Cold(partition.key))//может вытеснить другие разделы, но не этот
+        SegmentBudget::Instance().Touch(this, partition.key, PartitionMemory(partition), &EvictCallback);
+    return *partition.storage;
+}
+
+void Database::LoadPartition(Partition& partition) const{
+    //раздел собирается отдельно и достаётся partition, только если сегмент прочитан целиком:
+    //при ошибке чтения partition остаётся выгруженным, а не наполовину загруженным
+    Partition loaded(partition.key, allocation_, nullptr);
+    Storage& storage = *loaded.storage;
+    partition.segment->ForEachChunk([&](const std::vector<int>& dates, const std::vector<std::string>& events){
+        EventColumn* column = nullptr;
+        for(size_t i = 0; i < dates.size(); ++i){
+            if(i == 0 || dates[i] != dates[i - 1])
+                column = &storage.ALL_DATA.FindOrInsert(dates[i], dictionary_.get());
+            const uint32_t id = dictionary_->Intern(events[i]);
+            storage.ALL_DATA_SET.Insert(dates[i], id);
+            column->push_back(id, event_filter_bits_);
+        }
+    });
+    storage.LAST.Rebuild(storage.ALL_DATA);
+    partition.arena = std::move(loaded.arena);
+    partition.storage = std::exchange(loaded.storage, nullptr);
+    ++pages_in_;
+}
 
+std::shared_ptr<const Segment> Database::WriteSegment(const Storage& storage) const{
+    Segment::Builder builder(segment_directory_);
+    for(const auto& block : storage.ALL_DATA.Blocks())
+        for(size_t i = 0; i < block.dates.size(); ++i)
+            for(const auto& event : block.columns[i])
+                builder.Append(block.dates[i], event);
+    return builder.Finish();
+}
+
+bool Database::EvictPartition(int key) const{
+    auto partition = std::lower_bound(partitions_.begin(), partitions_.end(), key,
+                                      [](const Partition& p, int key){return p.key < key;});
+    if(partition == partitions_.end() || partition->key != key || !partition->storage)
+        return true;
+    Storage& storage = *partition->storage;
+    if(!storage.PENDING.empty()){
+        pending_ -= storage.PENDING.size();
+        MergePending(storage);
+    }
+    if(!partition->segment){
+        try {
+            partition->segment = WriteSegment(storage);
+        } catch(const std::exception&){
+            return false;
+        }
+        if(!partition->segment)//пустой раздел
+            return false;
+    }
+    partition->Release();
+    ++evictions_;
+    return true;
+}
+
+bool Database::EvictCallback(const void* owner, int key){
+    return static_cast<const Database*>(owner)->EvictPartition(key);
+}
+
+size_t Database::PartitionMemory(const Partition& partition) const{
+    if(partition.arena)
+        return partition.arena->SystemCounters().BytesInUse();
+    //без арены - оценка по индексам и номерам событий
+    const Storage& storage = *partition.storage;
+    size_t events = 0;
+    for(const auto& block : storage.ALL_DATA.Blocks())
+        for(const auto& column : block.columns)
+            events += column.size();
+    return storage.ALL_DATA_SET.MemoryUsage() + events * sizeof(uint32_t)
+           + storage.ALL_DATA.size() * (sizeof(int) + sizeof(EventColumn));
+}
+
+std::optional<LastEvent> Database::PartitionLast(const Partition& partition) const{
+    if(!partition.storage){
+        const Segment& segment = *partition.segment;
+        return LastEvent{UnpackDate(segment.Last()), dictionary_->Get(dictionary_->Find(segment.LastEvent()))};
+    }
+    const LastIndex& last = partition.storage->LAST;
+    if(!last.size())
+        return std::nullopt;
+    return LastEvent{UnpackDate(last.DateAt(last.size() - 1)), dictionary_->Get(last.EventAt(last.size() - 1))};
+}
+
+void Database::SetPartitioning(DatePartitioning partitioning){
+    if(partitioning == partitioning_)
+        return;
+    if(Tiered() && partitioning == DatePartitioning::None)
+        throw std::invalid_argument("Tiering needs month or year partitions");
+    Flush();
+    //события переносятся по датам в порядке добавления; представления и кэш не меняются
+    Database moved(allocation_);
+    moved.dictionary_ = dictionary_;
+    moved.partitioning_ = partitioning;
+    moved.event_filter_bits_ = event_filter_bits_;
+    std::vector<int> dates;
+    std::vector<std::string> events;
+    for(Partition& partition : partitions_)
+        for(const auto& block : Resident(partition).ALL_DATA.Blocks())
+            for(size_t i = 0; i < block.dates.size(); ++i)
+                for(const auto& event : block.columns[i]){
+                    dates.push_back(block.dates[i]);
+                    events.push_back(event);
+                }
+    moved.AddBatch(dates, events);
+    if(Tiered())
+        SegmentBudget::Instance().ForgetOwner(this);
+    partitioning_ = partitioning;
+    partitions_.swap(moved.partitions_);
+    if(Tiered())
+        ApplyTiering();
+}
+
+void Database::MergePending() const{
+    for(const Partition& partition : partitions_){
+        if(partition.storage && !partition.storage->PENDING.empty())
+            MergePending(*partition.storage);
+    }
+    pending_ = 0;
+}
+
+void Database::MergePending(Storage& storage) const{
+    auto& pending = storage.PENDING;
+    auto by_date = [](const std::pair<int, uint32_t>& lhs, const std::pair<int, uint32_t>& rhs){
+        return lhs.first < rhs.first;
+    };
+    if(!std::is_sorted(pending.begin(), pending.end(), by_date))
+        std::stable_sort(pending.begin(), pending.end(), by_date);//события даты - в порядке добавления
+    std::vector<std::pair<int, uint32_t>> last;//последнее событие каждой даты пачки
+    DateDirectory::Position hint{0, 0};
+    for(size_t begin = 0; begin < pending.size();){
+        const int packed = pending[begin].first;
+        EventColumn& column = storage.ALL_DATA.FindOrInsert(packed, dictionary_.get(), hint);
+        size_t end = begin;
+        for(; end < pending.size() && pending[end].first == packed; ++end)
+            column.push_back(pending[end].second, event_filter_bits_);
+        last.emplace_back(packed, pending[end - 1].second);
+        begin = end;
+    }
+    storage.LAST.SetSorted(last);
+    pending.clear();
+}
+
+size_t Database::AddBatch(const std::vector<int>& dates, const std::vector<std::string>& events){
+    Flush();//события даты из буфера Add идут раньше событий пачки
+    size_t added = 0;
+    for(size_t begin = 0; begin < dates.size();){
+        size_t end = begin + 1;
+        while(end < dates.size() && dates[end] == dates[begin])
+            ++end;
+        const int packed = dates[begin];
+        const Date date = UnpackDate(packed);
+        Storage& storage = PartitionFor(packed);
+        EventColumn* column = nullptr;//заводится при первом новом событии даты
+        for(size_t i = begin; i < end; ++i){
+            const uint32_t id = dictionary_->Intern(events[i]);
+            if(!storage.ALL_DATA_SET.Insert(packed, id))
+                continue;
+            if(!column)
+                column = &storage.ALL_DATA.FindOrInsert(packed, dictionary_.get());
+            column->push_back(id, event_filter_bits_);
+            for(auto& view : views_)
+                view.OnAdd(date, events[i], id, dictionary_.get());
+            ++added;
+        }
+        if(column){
+            storage.LAST.Set(packed, column->Id(column->size() - 1));
+            if(!cache_.empty())
+                cache_.Invalidate(packed, packed);
+        }
+        begin = end;
+    }
+    return added;
+}
+
+size_t Database::Import(std::istream& input){
+    ExportReader reader(input);
+    //весь файл сначала проверяется: база меняется, только если дочитан завершающий блок
+    std::vector<int> dates, chunk_dates;
+    std::vector<std::string> events, chunk_events;
+    while(reader.NextChunk(chunk_dates, chunk_events)){
+        for(int packed : chunk_dates){
+            const Date date = UnpackDate(packed);
+            if(date.GetMonth() < 1 || date.GetMonth() > 12 || date.GetDay() < 1)
+                throw std::runtime_error("Import: invalid date " + std::to_string(packed));
+        }
+        dates.insert(dates.end(), chunk_dates.begin(), chunk_dates.end());
+        std::move(chunk_events.begin(), chunk_events.end(), std::back_inserter(events));
+    }
+    return AddBatch(dates, events);
 }
 
 bool Database::IsHere(const Date& date, const std::string& event){
-    auto it = std::find(std::begin(ALL_DATA[date]),std::end(ALL_DATA[date]),event);
-    if(it != std::end(ALL_DATA[date]))//элемент есть
+    Flush();
+    const Storage* storage = FindPartition(date.GetPacked());
+    const EventColumn* column = storage ? storage->ALL_DATA.Find(date.GetPacked()) : nullptr;
+    if(!column)
+        return true;//элемента нет
+    auto it = std::find(std::begin(*column),std::end(*column),event);
+    if(it != std::end(*column))//элемент есть
         return false;
     return true;//элемента нет
 }
 
 std::string Database::Last(const Date& date) const{
+    const auto last = LastEntry(date);
+    if(!last)
+        return "No entries";
+    return last->date.ToString() + ' ' + std::string(last->event);
+}
 
-    if(ALL_DATA.count(date))//если дата имеется в словаре(проверить случай поиска последнего события после его удаления)
-        return date.ToString() + ' ' + ALL_DATA.at(date)[ALL_DATA.at(date).size() - 1];
-    else{
-        auto it = ALL_DATA.upper_bound(date);
-        if(it == ALL_DATA.begin() || ALL_DATA.size() == 0)
-            return "No entries";
-        else{
-            return (prev(it))->first.ToString() + ' ' + *(--(prev(it)->second).end());
+std::optional<LastEvent> Database::LastEntry(const Date& date) const{
+    Flush();
+    const int packed = date.GetPacked();
+    int found = 0;
+    uint32_t id = 0;
+    //раздел даты, а если в нём нет дат не позже неё - последняя дата ближайшего раздела раньше
+    auto partition = std::upper_bound(partitions_.begin(), partitions_.end(), PartitionKey(packed),
+                                      [](int key, const Partition& p){return key < p.key;});
+    while(partition != partitions_.begin()){
+        --partition;
+        if(!partition->storage){//выгруженный раздел читается, только если дата внутри него
+            if(partition->segment->Last() <= packed)
+                return PartitionLast(*partition);
+            if(partition->segment->First() > packed)
+                continue;
         }
+        if(Resident(*partition).LAST.FindLastNotAfter(packed, found, id))
+            return LastEvent{UnpackDate(found), dictionary_->Get(id)};
     }
+    return std::nullopt;
+}
+
+std::vector<std::optional<LastEvent>> Database::LastMany(const std::vector<Date>& dates) const{
+    Flush();
+    std::vector<std::pair<int, size_t>> order;//(упакованная дата, номер запроса)
+    order.reserve(dates.size());
+    for(size_t i = 0; i < dates.size(); ++i)
+        order.emplace_back(dates[i].GetPacked(), i);
+    if(!std::is_sorted(order.begin(), order.end()))//отчёты обычно спрашивают даты подряд
+        std::sort(order.begin(), order.end());
 
+    //запросы раздела ищутся в его LastIndex одним проходом; не нашедшие там дат не позже себя
+    //получают последнюю запись ближайшего непустого раздела раньше
+    std::vector<std::optional<LastEvent>> result(dates.size());
+    std::optional<LastEvent> before;//последняя запись разделов, пройденных до текущего
+    std::vector<int> queries;
+    std::vector<size_t> positions;
+    size_t next = 0;
+    for(size_t p = 0; p < partitions_.size() && next < order.size(); ++p){
+        Partition& partition = partitions_[p];
+        const bool final = p + 1 == partitions_.size();
+        size_t end = next;
+        while(end < order.size() && PartitionKey(order[end].first) < partition.key)
+            ++end;
+        for(; next < end; ++next)//даты между разделами
+            result[order[next].second] = before;
+        while(end < order.size() && (final || PartitionKey(order[end].first) < partitions_[p + 1].key))
+            ++end;
+        //выгруженный раздел читается, только если какой-то запрос попадает внутрь его дат
+        if(!partition.storage && (next == end || order[next].first >= partition.segment->Last())){
+            const auto partition_last = PartitionLast(partition);
+            for(; next < end; ++next)
+                result[order[next].second] = partition_last;
+            before = partition_last;
+            continue;
+        }
+        const LastIndex& last = Resident(partition).LAST;
+        queries.clear();
+        for(size_t i = next; i < end; ++i)
+            queries.push_back(order[i].first);
+        last.FindLastNotAfterSorted(queries, positions);
+        for(size_t i = next; i < end; ++i){
+            const size_t position = positions[i - next];
+            if(position != LastIndex::NOT_FOUND)
+                result[order[i].second] = LastEvent{UnpackDate(last.DateAt(position)), dictionary_->Get(last.EventAt(position))};
+            else
+                result[order[i].second] = before;
+        }
+        next = end;
+        if(last.size())
+            before = LastEvent{UnpackDate(last.DateAt(last.size() - 1)), dictionary_->Get(last.EventAt(last.size() - 1))};
+    }
+    for(; next < order.size(); ++next)
+        result[order[next].second] = before;
+    return result;
+}
+
+void Database::PrintStats(std::ostream& output) const{
+    size_t dates = 0, events = 0, filtered = 0, filter_memory = 0;
+    size_t allocations = 0, deallocations = 0, bytes_in_use = 0, system_bytes = 0;
+    size_t evicted = 0, evicted_events = 0, segment_bytes = 0;
+    for(const Partition& partition : partitions_){
+        if(partition.segment)
+            segment_bytes += partition.segment->FileSize();
+        if(!partition.storage){
+            ++evicted;
+            dates += partition.segment->Dates().size();
+            evicted_events += partition.segment->size();
+            continue;
+        }
+        dates += partition.storage->ALL_DATA.size();
+        for(const auto& block : partition.storage->ALL_DATA.Blocks())
+            for(const auto& column : block.columns){
+                events += column.size();
+                filtered += column.Filtered(event_filter_bits_);
+                filter_memory += column.FilterMemory();
+            }
+        if(partition.arena){
+            allocations += partition.arena->Counters().Allocations();
+            deallocations += partition.arena->Counters().Deallocations();
+            bytes_in_use += partition.arena->Counters().BytesInUse();
+            system_bytes += partition.arena->SystemCounters().BytesInUse();
+        }
+    }
+    output << "database: dates " << dates << ", events " << events + evicted_events + Pending()
+           << ", distinct events " << dictionary_->size() << ", dictionary bytes " << dictionary_->MemoryUsage() << "\n";
+    if(partitioning_ != DatePartitioning::None)
+        output << "partitions: by " << (partitioning_ == DatePartitioning::Month ? "month" : "year") << ", count "
+               << partitions_.size() << ", dropped whole by Del " << partitions_dropped_ << "\n";
+    if(Tiered()){
+        const SegmentBudget& budget = SegmentBudget::Instance();
+        output << "tiers: cold before " << ColdBefore() << ", partitions on disk only " << evicted << " (events "
+               << evicted_events << "), segment files " << segment_bytes << " bytes, paged in " << pages_in_
+               << ", evicted " << evictions_ << ", skipped by dates " << segments_skipped_ << "\n"
+               << "segment budget: " << budget.Resident() << " of " << budget.Limit() << " bytes in use, evictions "
+               << budget.Evictions() << "\n";
+    }
+    if(add_buffer_)
+        output << "add buffer: capacity " << add_buffer_ << ", pending " << Pending() << "\n";
+    if(event_filter_bits_)
+        output << "event filters: " << event_filter_bits_ << " bits per event, dates with filter " << filtered
+               << ", memory " << filter_memory << " bytes\n";
+    if(allocation_ == DatabaseAllocation::Arena)
+        output << "arena: allocations " << allocations << ", deallocations " << deallocations
+               << ", bytes in use " << bytes_in_use << ", taken from system " << system_bytes << "\n";
+    const ResultCacheStats cache = cache_.Stats();
+    output << "result cache: hits " << cache.hits << ", misses " << cache.misses << ", entries " << cache.entries
+           << ", memory " << cache.memory << " bytes\n";
+    for(const auto& view : views_)
+        output << "view " << view.Name() << ": entries " << view.size() << ", maintenance "
+               << std::chrono::duration<double, std::micro>(view.Stats().maintenance).count() << " us\n";
+}
+
+std::string DateGroupName(int group, DateGrouping grouping){
+    const Date date = UnpackDate(group);
+    std::ostringstream os;
+    os << std::setw(4) << std::setfill('0') << date.GetYear();
+    if(grouping != DateGrouping::Year)
+        os << '-' << std::setw(2) << std::setfill('0') << date.GetMonth();
+    if(grouping == DateGrouping::Date)
+        os << '-' << std::setw(2) << std::setfill('0') << date.GetDay();
+    return os.str();
+}
+
+std::ostream& operator << (std::ostream& output, const LastEvent& last){
+    return output << last.date << ' ' << last.event;
+}
+
+
+std::shared_ptr<const std::vector<std::string>> Database::FindCached(const std::shared_ptr<Node>& condition) const{
+    const std::string key = CanonicalCondition(condition);
+    if(auto result = cache_.Find(key))
+        return result;
+    const auto range = ConditionDateRange(condition);
+    auto result = std::make_shared<const std::vector<std::string>>(DispatchCondition(condition, [this](auto predicate){
+        return FindIf(predicate);
+    }));
+    cache_.Insert(key, range.first, range.second, result);
+    return result;
+}
+
+void Database::CreateView(const std::string& name, const std::string& condition){
+    for(const auto& view : views_)
+        if(view.Name() == name)
+            throw std::invalid_argument("View already exists: " + name);
+    std::istringstream is(condition);
+    auto node = ParseCondition(is);
+    MaterializedView view(name, condition, node);
+    DispatchCondition(node, [&](auto predicate){//первичное заполнение - обычный проход FindIf
+        ScanIf(predicate, [&](int date, const EventColumn& column){
+            for(size_t j = 0; j < column.size(); ++j)
+                view.Append(date, column.Id(j), dictionary_.get());
+        }, [&](int date, const EventColumn& column, const Bitmap& selection){
+            ForEachBit(selection, [&](size_t j){
+                view.Append(date, column.Id(j), dictionary_.get());
+            });
+        });
+        return 0;
+    });
+    views_.push_back(std::move(view));
+}
+
+bool Database::DropView(const std::string& name){
+    auto it = std::find_if(views_.begin(), views_.end(), [&name](const MaterializedView& view){
+        return view.Name() == name;
+    });
+    if(it == views_.end())
+        return false;
+    views_.erase(it);
+    return true;
+}
+
+const MaterializedView& Database::GetView(const std::string& name) const{
+    for(const auto& view : views_)
+        if(view.Name() == name)
+            return view;
+    throw std::invalid_argument("Unknown view: " + name);
 }
 
+std::vector<std::string> Database::ReadView(const std::string& name) const{
+    const MaterializedView& view = GetView(name);
+    std::vector<std::string> res;
+    res.reserve(view.size());
+    for(const auto& block : view.Rows().Blocks()){
+        for(size_t i = 0; i < block.dates.size(); ++i){
+            const std::string prefix = UnpackDate(block.dates[i]).ToString() + " ";
+            for(const auto& event : block.columns[i])
+                res.push_back(prefix + event);
+        }
+    }
+    return res;
+}
 
 std::string Database::ToStringDB() const{
+    Flush();
     std::string result = "";
-    for(const auto& item : ALL_DATA){
-        result += ToStringVector(item.first,item.first.ToString());
-    }
+    for(Partition& partition : partitions_)
+        for(const auto& block : Resident(partition).ALL_DATA.Blocks()){
+            for(size_t i = 0; i < block.dates.size(); ++i)
+                result += ToStringVector(block.columns[i], UnpackDate(block.dates[i]).ToString());
+        }
     return result;
 }
 
-std::string Database::ToStringVector(const Date& date,std::string nums) const{
+std::string Database::ToStringVector(const EventColumn& column,std::string nums) const{
     std::string result = "";
-    int index = 0;
-    if(ALL_DATA.count(date)){
-        for(const auto& item : ALL_DATA.at(date)){
-            result += nums + ' ' + item;
-            if(index != ALL_DATA.at(date).size() - 1)
-                result += '\n';
-            index++;
-        }
+    size_t index = 0;
+    for(const auto& item : column){
+        result += nums + ' ' + item;
+        if(index != column.size() - 1)
+            result += '\n';
+        index++;
     }
     result += "\n";
     return result;
@@ -59,4 +771,4 @@ std::string Database::ToStringVector(const Date& date,std::string nums) const{
 
 void Database::Print(std::ostream& output) const{
     output << this->ToStringDB();
-}
\ No newline at end of file
+}
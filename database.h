@@ -1,12 +1,28 @@
 #pragma once
 #include <string>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <set>
 #include <vector>
 #include <algorithm>
 #include <functional>
+#include <optional>
+#include <string_view>
 #include <iterator>
 #include "node.h"
+#include "condition_parser.h"
+#include "event_column.h"
+#include "arena.h"
+#include "dedup_index.h"
+#include "date_directory.h"
+#include "last_index.h"
+#include "materialized_view.h"
+#include "result_cache.h"
+#include "export_format.h"
+#include "segment.h"
+#include "stats.h"
+#include <climits>
 
 template <typename T>
 ostream& operator << (ostream& out, const vector<T> v){
@@ -16,82 +32,429 @@ ostream& operator << (ostream& out, const vector<T> v){
     out << "}";
     return out;
 }
+
+//Отбор событий одной даты в selection. Если у предиката есть метод SelectEvents
+//(см. predicates.h), он обрабатывает всю дату целиком, иначе предикат вызывается для каждого события.
+template <typename T>
+auto SelectEvents(T& predicate, const Date& date, const EventColumn& column, Bitmap& selection, int)
+        -> decltype(predicate.SelectEvents(date, column, selection), void()) {
+    predicate.SelectEvents(date, column, selection);
+}
+
+template <typename T>
+void SelectEvents(T& predicate, const Date& date, const EventColumn& column, Bitmap& selection, long) {
+    ClearBitmap(selection, column.size());
+    for (size_t i = 0; i < column.size(); ++i) {
+        if (predicate(date, column[i]))
+            SetBit(selection, i);
+    }
+}
+
+//Условие только на даты (DatesOnly у предиката) проверяется пакетом по столбцу дат через SelectDates.
+template <typename T>
+auto DatesOnly(const T& predicate, int) -> decltype(predicate.DatesOnly()) {
+    return predicate.DatesOnly();
+}
+
+template <typename T>
+bool DatesOnly(const T&, long) {
+    return false;
+}
+
+template <typename T>
+auto SelectDates(T& predicate, const int* dates, size_t count, Bitmap& selection, int)
+        -> decltype(predicate.SelectDates(dates, count, selection), void()) {
+    predicate.SelectDates(dates, count, selection);
+}
+
+template <typename T>
+void SelectDates(T&, const int*, size_t count, Bitmap& selection, long) {
+    ClearBitmap(selection, count);//не вызывается: DatesOnly для таких предикатов ложно
+}
+
+//Дата пропускается без просмотра столбца, если предикат называет события (метод MayMatch,
+//см. predicates.h), а фильтр Блума столбца их исключает. Проверки и пропуски считаются в counters
+template <typename T>
+auto SkipByFilter(const T& predicate, const EventColumn& column, size_t bits_per_key, ScanCounters& counters, int)
+        -> decltype(predicate.MayMatch(column, bits_per_key)) {
+    if (!column.Filtered(bits_per_key))
+        return false;
+    ++counters.filter_checks;
+    if (predicate.MayMatch(column, bits_per_key))
+        return false;
+    ++counters.filter_skips;
+    return true;
+}
+
+template <typename T>
+bool SkipByFilter(const T&, const EventColumn&, size_t, ScanCounters&, long) {
+    return false;
+}
+
+//Диапазон упакованных дат, вне которого предикат ничего не выбирает (метод DateBounds,
+//см. predicates.h); без метода - все даты. По нему отсекаются выгруженные на диск разделы
+template <typename T>
+auto DateBounds(const T& predicate, int) -> decltype(predicate.DateBounds()) {
+    return predicate.DateBounds();
+}
+
+template <typename T>
+std::pair<int, int> DateBounds(const T&, long) {
+    return {INT_MIN, INT_MAX};
+}
+
+//Условие выбирает ровно все даты DateBounds (метод DateBoundsExact): тогда раздел целиком внутри
+//диапазона удаляется по его первой и последней дате, без проверки каждой даты
+template <typename T>
+auto DateBoundsExact(const T& predicate, int) -> decltype(predicate.DateBoundsExact()) {
+    return predicate.DateBoundsExact();
+}
+
+template <typename T>
+bool DateBoundsExact(const T&, long) {
+    return false;
+}
+
+//Откуда база берёт память: Arena - собственная арена (arena.h), освобождаемая целиком
+//при уничтожении или Clear без обхода узлов; Default - обычный new/delete.
+enum class DatabaseAllocation {
+    Arena, Default
+};
+
+//ответ Database::LastEntry без построения строки: текст события лежит в словаре базы,
+//view действителен до следующего Add или Del (Del может заменить словарь)
+struct LastEvent {
+    Date date;
+    string_view event;
+};
+
+ostream& operator << (ostream& output, const LastEvent& last);
+
+//группировка CountByIf
+enum class DateGrouping {
+    Date, Month, Year
+};
+
+//название группы CountByIf: 2017-01-05, 2017-01 или 2017
+std::string DateGroupName(int group, DateGrouping grouping);
+
+//разделы базы по датам (Database::SetPartitioning): None - один раздел на все даты
+enum class DatePartitioning {
+    None, Month, Year
+};
+
 class Database {
 public:
-    //шаблонные функции реализуются в заголовочном файле!
-    template <typename T> int RemoveIf(T predicate) {//в предикат нужно передавать параметры?
-        int count = 0;
-        for(auto i = ALL_DATA.begin();i != ALL_DATA.end(); ++i){
-            Date tmp = i->first;
-            auto it = stable_partition(ALL_DATA[i->first].begin(),ALL_DATA[i->first].end(),[predicate,tmp](const string& s){
-                return predicate(tmp,s);
-            });
+    explicit Database(DatabaseAllocation allocation = DatabaseAllocation::Arena);
+    Database(const Database& other);
+    Database(Database&& other);
+    Database& operator=(Database other);
+    ~Database();
 
-            for(auto j = ALL_DATA[i->first].begin();j != it;++j){
-                ALL_DATA_SET[i->first].erase(*j);
-            }
+    void swap(Database& other);
 
-            int size_1 = ALL_DATA.at(i->first).size();
-            ALL_DATA[i->first].erase(ALL_DATA[i->first].begin(),it);
-            int size_2 = ALL_DATA.at(i->first).size();
-            count += size_1 - size_2;
+    //удаляет все записи; в режиме Arena освобождает память за время, не зависящее от числа событий
+    void Clear();
 
-        }
-        for(auto i = ALL_DATA.begin();i != ALL_DATA.end();){//удаление пустых дат
-            if(ALL_DATA.at(i->first).empty()){
-                i = ALL_DATA.erase(i);
+    //шаблонные функции реализуются в заголовочном файле!
+    template <typename T> int RemoveIf(T predicate) {
+        Flush();
+        int count = 0;
+        bool dropped = false;
+        int removed_from = INT_MAX, removed_to = INT_MIN;//диапазон затронутых дат для кэша результатов
+        ScanCounters counters;
+        Bitmap selection;
+        const std::pair<int, int> bounds = DateBounds(predicate, 0);
+        for(Partition& partition : partitions_){
+            if(SkipSegment(predicate, partition, selection))
+                continue;
+            if(partition.storage && (partition.storage->ALL_DATA.empty() || bounds.second < PartitionFirstDate(partition)
+                                     || bounds.first > PartitionLastDate(partition)))
+                continue;//раздел вне дат условия
+            if(DatesOnly(predicate, 0) && WholePartition(predicate, partition, selection, counters)){
+                //раздел выбран целиком: события не просматриваются, а выгруженный даже не читается с диска
+                count += DropWholePartition(partition, removed_from, removed_to);
+                dropped = true;
+                continue;
             }
-            else{
-                ++i;
+            Storage& storage = Resident(partition);
+            bool emptied = false;
+            int removed = 0;
+            for(DateDirectory::Block& block : storage.ALL_DATA.Blocks()){
+                if(DatesOnly(predicate, 0)){//даты удаляются целиком
+                    SelectDates(predicate, block.dates.data(), block.dates.size(), selection, 0);
+                    counters.dates_visited += block.dates.size();
+                    ForEachBit(selection, [&](size_t i){
+                        EventColumn& column = block.columns[i];
+                        for(size_t j = 0; j < column.size(); ++j)
+                            storage.ALL_DATA_SET.Erase(block.dates[i], column.Id(j));
+                        for(auto& view : views_)
+                            view.OnRemoveDate(block.dates[i]);
+                        removed_from = std::min(removed_from, block.dates[i]);
+                        removed_to = std::max(removed_to, block.dates[i]);
+                        removed += column.size();
+                        column.clear();
+                        emptied = true;
+                    });
+                    continue;
+                }
+                counters.dates_visited += block.dates.size();
+                for(size_t i = 0; i < block.dates.size(); ++i){
+                    EventColumn& column = block.columns[i];
+                    if(SkipByFilter(predicate, column, event_filter_bits_, counters, 0))
+                        continue;
+                    SelectEvents(predicate, UnpackDate(block.dates[i]), column, selection, 0);
+                    counters.events_scanned += column.size();
+                    if(AnyBit(selection)){
+                        ForEachBit(selection, [&](size_t j){
+                            storage.ALL_DATA_SET.Erase(block.dates[i], column.Id(j));
+                        });
+                        for(auto& view : views_)
+                            view.OnRemoveEvents(block.dates[i], column, selection);
+                        removed_from = std::min(removed_from, block.dates[i]);
+                        removed_to = std::max(removed_to, block.dates[i]);
+                        removed += column.EraseSelected(selection);
+                        emptied |= column.empty();
+                    }
+                }
             }
-        }
-
-//        for(auto i = ALL_DATA_SET.begin();i!=ALL_DATA_SET.end();){
-//            Date tmp = i->first;
-//            auto it = ALL_DATA_SET[i->first].template find([predicate,tmp](const string& s){
-//                return predicate(tmp,s);
-//            });
-//
-//            //ALL_DATA_SET[i->first].erase(it.fi,it);
-//        }
-
-        for(auto i = ALL_DATA_SET.begin();i != ALL_DATA_SET.end();){//удаление пустых дат
-            if(!ALL_DATA.count(i->first)){
-                i = ALL_DATA_SET.erase(i);
+            if(emptied)//удаление пустых дат
+                storage.ALL_DATA.RemoveEmptyDates();
+            if(removed){
+                storage.LAST.Rebuild(storage.ALL_DATA);
+                partition.segment.reset();//сегмент на диске больше не совпадает с разделом
             }
-            else{
-                ++i;
+            if(storage.ALL_DATA.empty()){
+                DropPartition(partition);
+                dropped = true;
             }
+            count += removed;
         }
-
+        if(dropped)
+            RemoveDroppedPartitions();
+        if(count){
+            for(auto& view : views_)
+                view.FinishRemove();
+            cache_.Invalidate(removed_from, removed_to);
+            CompactDictionary();
+        }
+        counters.events_matched = count;
+        Stats::Instance().RecordScan(counters);
         return count;
     }
 
     template <typename T> vector<string> FindIf(T predicate) const{
         vector<string> res;
-
-        for(const pair<Date,vector<string>>& p : ALL_DATA){
-            Date tmp = p.first;
-            size_t size_1 = res.size();
-
-            copy_if(p.second.begin(),p.second.end(),back_inserter(res),[predicate,tmp](const string& s){
-                return predicate(tmp,s);
+        ScanIf(predicate, [&](int date, const EventColumn& column){
+            const std::string prefix = UnpackDate(date).ToString() + " ";
+            for(const auto& event : column)
+                res.push_back(prefix + event);
+        }, [&](int date, const EventColumn& column, const Bitmap& selection){//добавление данной даты к каждому найденному событию
+            const std::string prefix = UnpackDate(date).ToString() + " ";
+            ForEachBit(selection, [&](size_t j){
+                res.push_back(prefix + column[j]);
             });
+        });
+        return res;
+    }
 
-            size_t size_2 = res.size();
-
-            if(size_1 != size_2){//добавление данной даты к каждому новому добавленному событию
-                for (int i = size_1; i < size_2; ++i) {
-                    res[i] = tmp.ToString() + " " + res[i];
+    //Страница результата FindIf (options - см. FindOptions). Обход останавливается, набрав limit записей;
+    //при descending даты проходятся с конца каталога. Записи, пропускаемые по offset, не строятся,
+    //а при условии только на даты выбранные даты пропускаются целиком по размеру столбца
+    template <typename T> vector<string> FindIf(T predicate, const FindOptions& options) const{
+        vector<string> res;
+        size_t skip = options.offset;
+        const bool reverse = options.descending;
+        auto take = [&](int date, const EventColumn& column, size_t j){
+            if(skip){
+                --skip;
+                return true;
+            }
+            res.push_back(UnpackDate(date).ToString() + " " + column[j]);
+            return res.size() < options.limit;
+        };
+        if(options.limit == 0)
+            return res;
+        Flush();
+        ScanCounters counters;
+        Bitmap selection;
+        bool more = true;
+        for(size_t p = 0; p < partitions_.size() && more; ++p){
+            Partition& partition = partitions_[reverse ? partitions_.size() - 1 - p : p];
+            if(SkipSegment(predicate, partition, selection))
+                continue;
+            const auto& blocks = Resident(partition).ALL_DATA.Blocks();
+            for(size_t b = 0; b < blocks.size() && more; ++b){
+                const DateDirectory::Block& block = blocks[reverse ? blocks.size() - 1 - b : b];
+                if(DatesOnly(predicate, 0)){
+                    SelectDates(predicate, block.dates.data(), block.dates.size(), selection, 0);
+                    counters.dates_visited += block.dates.size();
+                    more = ForEachBitWhile(selection, reverse, [&](size_t i){
+                        const EventColumn& column = block.columns[i];
+                        if(skip >= column.size()){
+                            skip -= column.size();
+                            return true;
+                        }
+                        for(size_t k = 0; k < column.size(); ++k)
+                            if(!take(block.dates[i], column, reverse ? column.size() - 1 - k : k))
+                                return false;
+                        return true;
+                    });
+                    continue;
+                }
+                for(size_t k = 0; k < block.dates.size() && more; ++k){
+                    const size_t i = reverse ? block.dates.size() - 1 - k : k;
+                    ++counters.dates_visited;
+                    if(SkipByFilter(predicate, block.columns[i], event_filter_bits_, counters, 0))
+                        continue;
+                    SelectEvents(predicate, UnpackDate(block.dates[i]), block.columns[i], selection, 0);
+                    counters.events_scanned += block.columns[i].size();
+                    more = ForEachBitWhile(selection, reverse, [&](size_t j){
+                        return take(block.dates[i], block.columns[i], j);
+                    });
                 }
             }
-
         }
+        counters.events_matched = options.offset - skip + res.size();
+        Stats::Instance().RecordScan(counters);
+        return res;
+    }
+
+    //Агрегаты без построения строк: при условии только на даты события не просматриваются,
+    //берутся размеры столбцов выбранных дат
+    template <typename T> size_t CountIf(T predicate) const{
+        size_t count = 0;
+        ScanIf(predicate, [&](int, const EventColumn& column){
+            count += column.size();
+        }, [&](int, const EventColumn&, const Bitmap& selection){
+            count += CountBits(selection);
+        });
+        return count;
+    }
+
+    //(группа, число событий) по возрастанию групп; группа - упакованная дата с обнулёнными
+    //днём (Month) или днём и месяцем (Year), см. DateGroupName
+    template <typename T> vector<pair<int, size_t>> CountByIf(T predicate, DateGrouping grouping) const{
+        vector<pair<int, size_t>> res;
+        const int mask = GroupMask(grouping);
+        auto add = [&](int date, size_t count){//даты идут по возрастанию, группа меняется только вперёд
+            const int group = date & mask;
+            if(res.empty() || res.back().first != group)
+                res.emplace_back(group, 0);
+            res.back().second += count;
+        };
+        ScanIf(predicate, [&](int date, const EventColumn& column){
+            add(date, column.size());
+        }, [&](int date, const EventColumn&, const Bitmap& selection){
+            add(date, CountBits(selection));
+        });
+        return res;
+    }
+
+    //(событие, число дат с ним) по возрастанию текста события
+    template <typename T> vector<pair<string, size_t>> DistinctEventsIf(T predicate) const{
+        vector<size_t> counts(dictionary_->size());//по номерам словаря
+        ScanIf(predicate, [&](int, const EventColumn& column){
+            for(size_t j = 0; j < column.size(); ++j)
+                ++counts[column.Id(j)];
+        }, [&](int, const EventColumn& column, const Bitmap& selection){
+            ForEachBit(selection, [&](size_t j){
+                ++counts[column.Id(j)];
+            });
+        });
+        vector<pair<string, size_t>> res;
+        for(size_t id = 0; id < counts.size(); ++id)
+            if(counts[id])
+                res.emplace_back(dictionary_->Get(static_cast<uint32_t>(id)), counts[id]);
+        sort(res.begin(), res.end());
         return res;
     }
 
+    //f(упакованная дата, событие) для подходящих событий по возрастанию дат, внутри даты - в порядке добавления
+    template <typename T, typename F> void ForEachIf(T predicate, F f) const{
+        ScanIf(predicate, [&](int date, const EventColumn& column){
+            for(const auto& event : column)
+                f(date, event);
+        }, [&](int date, const EventColumn& column, const Bitmap& selection){
+            ForEachBit(selection, [&](size_t j){
+                f(date, column[j]);
+            });
+        });
+    }
+
+    //Выгрузка подходящих событий в двоичном формате export_format.h; возвращает их число
+    template <typename T> size_t ExportIf(T predicate, std::ostream& output) const{
+        ExportWriter writer(output);
+        ScanIf(predicate, [&](int date, const EventColumn& column){
+            for(const auto& event : column)
+                writer.Append(date, event);
+        }, [&](int date, const EventColumn& column, const Bitmap& selection){
+            ForEachBit(selection, [&](size_t j){
+                writer.Append(date, column[j]);
+            });
+        });
+        writer.Finish();
+        return writer.size();
+    }
+
+    //Загрузка файла ExportIf через AddBatch; возвращает число добавленных событий. Файл целиком
+    //читается и проверяется до первого изменения: при ошибке (runtime_error) база не меняется
+    size_t Import(std::istream& input);
+
+    //Add для многих событий; dates - упакованные даты. Подряд идущие одинаковые даты
+    //(в выгрузке все события даты идут подряд) ищутся в каталоге один раз
+    size_t AddBatch(const std::vector<int>& dates, const std::vector<std::string>& events);
+
+    //FindIf через кэш результатов: равносильные записи условия делят одну запись кэша,
+    //Add и RemoveIf выбрасывают только записи, чей диапазон дат задет изменением
+    std::shared_ptr<const std::vector<std::string>> FindCached(const std::shared_ptr<Node>& condition) const;
+    ResultCacheStats CacheStats() const {return cache_.Stats();}
+
     void Add(const Date& date, const std::string& event);
 
+    //Групповая запись Add: при capacity > 0 новые пары копятся в буфере (как memtable) и вливаются
+    //в каталог по capacity штук - сортировкой по дате и одним проходом по каталогу и LastIndex.
+    //Повторы отсеиваются, а представления и кэш обновляются сразу; чтения вливают буфер перед обходом.
+    //0 - каждое Add сразу попадает в каталог. Ёмкость больше MAX_ADD_BUFFER урезается до него
+    static const size_t MAX_ADD_BUFFER = 1u << 20;
+    void SetAddBuffer(size_t capacity);
+    size_t AddBuffer() const {return add_buffer_;}
+    size_t Pending() const {return pending_;}
+
+    //Фильтры Блума событий дат (EventColumn::MayContain) для условий на равенство события:
+    //bits_per_key бит на событие, 0 - выключены. Фильтры перестраиваются при следующем поиске.
+    //Больше MAX_EVENT_FILTER_BITS урезается до него: доля ложных срабатываний там уже ничтожна
+    static const size_t DEFAULT_EVENT_FILTER_BITS = 10;
+    static const size_t MAX_EVENT_FILTER_BITS = 64;
+    void SetEventFilter(size_t bits_per_key) {event_filter_bits_ = std::min(bits_per_key, MAX_EVENT_FILTER_BITS);}
+    size_t EventFilter() const {return event_filter_bits_;}
+
+    //Разделы по месяцам или годам: у каждого свои каталог дат, индексы и арена. Del с условием
+    //только на даты удаляет выбранные целиком разделы, не просматривая их события, и обходит
+    //даты лишь в пограничных. Смена разбиения переносит имеющиеся события в новые разделы
+    void SetPartitioning(DatePartitioning partitioning);
+    DatePartitioning Partitioning() const {return partitioning_;}
+    size_t PartitionCount() const {return partitions_.size();}
+
+    //Холодные разделы на диске: разделы, все даты которых раньше cold_before, записываются
+    //в неизменяемые сегменты (segment.h) в directory и выгружаются из памяти. Find, Last, Print и Del,
+    //чьи даты задевают такой раздел, подгружают его через mmap; подгруженные холодные разделы
+    //вытесняются по LRU общим бюджетом памяти процесса (SegmentBudget). Сегмент - единственная копия
+    //выгруженного раздела, поэтому каталог задаётся явно: пустой directory - каталог прошлого вызова.
+    //invalid_argument без разделов по месяцам или годам (SetPartitioning) и без каталога
+    void SetTiering(const Date& cold_before, const std::string& directory = "");
+    //возвращает все разделы в память
+    void DisableTiering();
+    bool Tiered() const {return cold_before_ != INT_MIN;}
+    Date ColdBefore() const {return UnpackDate(cold_before_);}
+    //разделы, которые сейчас только на диске
+    size_t EvictedPartitions() const;
+    //вливает буфер Add в каталог
+    void Flush() const{
+        if(pending_)
+            MergePending();
+    }
+
 
 
     std::string ToStringDB() const;
@@ -99,11 +462,211 @@ public:
     bool IsHere(const Date& date, const std::string& event);
 
     std::string Last(const Date& date) const;
+    std::optional<LastEvent> LastEntry(const Date& date) const;
+    //LastEntry для каждой из dates в их исходном порядке; даты упорядочиваются и обходятся одним проходом
+    std::vector<std::optional<LastEvent>> LastMany(const std::vector<Date>& dates) const;
+
+    //Словарь текстов событий. Del и SetTiering заменяют его уплотнённым, когда в словаре
+    //не меньше DICTIONARY_COMPACT_MIN текстов и больше половины из них уже нет в разделах в памяти;
+    //Clear заводит новый словарь всегда. Тексты выгруженных разделов лежат в их сегментах
+    const EventDictionary& Dictionary() const {return *dictionary_;}
+    static const size_t DICTIONARY_COMPACT_MIN = 1024;
+
+    //Материализованные представления (materialized_view.h): condition - условие в синтаксисе Find.
+    //Содержимое поддерживается при Add и RemoveIf, ReadView стоит столько же, сколько размер результата
+    void CreateView(const std::string& name, const std::string& condition);
+    bool DropView(const std::string& name);
+    //записи представления в формате FindIf
+    std::vector<std::string> ReadView(const std::string& name) const;
+    const std::vector<MaterializedView>& Views() const {return views_;}
+
+    //размеры базы, выделения памяти в арене, представления и кэш - для команды Stats
+    void PrintStats(std::ostream& output) const;
 
     void Print(std::ostream& output) const;
 
 private:
-    std::map<Date,std::vector<std::string>> ALL_DATA;
-    std::map<Date,std::set<std::string>> ALL_DATA_SET;
-    std::string ToStringVector(const Date& date,std::string nums) const;
+    struct Storage {
+        explicit Storage(std::pmr::memory_resource* resource)
+                : ALL_DATA(resource), ALL_DATA_SET(resource), LAST(resource), PENDING(resource) {}
+        Storage(const Storage& other, std::pmr::memory_resource* resource)
+                : ALL_DATA(other.ALL_DATA, resource), ALL_DATA_SET(other.ALL_DATA_SET, resource),
+                  LAST(other.LAST, resource), PENDING(other.PENDING, resource) {}
+
+        DateDirectory ALL_DATA;
+        DedupIndex ALL_DATA_SET;//пары (дата, событие), уже имеющиеся в базе, включая PENDING
+        LastIndex LAST;//последнее событие каждой даты
+        std::pmr::vector<std::pair<int, uint32_t>> PENDING;//буфер Add: (упакованная дата, номер события)
+    };
+
+    static Storage* CreateStorage(DatabaseArena* arena, const Storage* source);
+
+    //Даты одного месяца или года (при None - все) со своими каталогом, индексами, буфером Add
+    //и ареной: раздел, выбранный Del целиком, удаляется без обхода событий
+    //Холодный раздел (SetTiering) может лежать только в сегменте на диске: тогда storage пуст
+    struct Partition {
+        Partition(int key, DatabaseAllocation allocation, const Storage* source);
+        //выгруженный раздел
+        Partition(int key, std::shared_ptr<const Segment> segment);
+        Partition(Partition&& other) noexcept;
+        Partition& operator=(Partition&& other) noexcept;
+        ~Partition();
+
+        //освобождает память раздела, сегмент остаётся
+        void Release();
+        //Release и забывает сегмент; такой раздел убирается из списка RemoveDroppedPartitions
+        void Drop();
+
+        int key;//первая возможная дата раздела (PartitionKey)
+        std::unique_ptr<DatabaseArena> arena;
+        Storage* storage;//в режиме Arena размещено в arena и не разрушается: память уходит вместе с ареной
+        std::shared_ptr<const Segment> segment;//копия раздела на диске, пока он не менялся; копии базы делят её
+    };
+
+    int PartitionKey(int date) const{
+        if(partitioning_ == DatePartitioning::None)
+            return INT_MIN;
+        return date & GroupMask(partitioning_ == DatePartitioning::Month ? DateGrouping::Month : DateGrouping::Year);
+    }
+    //раздел даты или nullptr
+    Storage* FindPartition(int date) const;
+    //раздел даты; при отсутствии заводится
+    Storage& PartitionFor(int date);
+    void RemoveDroppedPartitions();
+
+    //все даты раздела раньше cold_before_
+    bool Cold(int key) const{
+        return Tiered() && (key | ~GroupMask(partitioning_ == DatePartitioning::Month ? DateGrouping::Month
+                                                                                      : DateGrouping::Year)) < cold_before_;
+    }
+    //хранилище раздела; выгруженный раздел подгружается, а холодный отмечается в LRU бюджета
+    Storage& Resident(Partition& partition) const{
+        if(!Tiered())
+            return *partition.storage;
+        return PageIn(partition);
+    }
+    Storage& PageIn(Partition& partition) const;
+    void LoadPartition(Partition& partition) const;
+    std::shared_ptr<const Segment> WriteSegment(const Storage& storage) const;
+    //выгрузка раздела key по требованию SegmentBudget; false, если сегмент не удалось записать
+    bool EvictPartition(int key) const;
+    static bool EvictCallback(const void* owner, int key);
+    size_t PartitionMemory(const Partition& partition) const;
+    //приводит разделы к cold_before_: холодные уходят на диск, остальные возвращаются в память
+    void ApplyTiering();
+    //последняя запись раздела без его подгрузки
+    std::optional<LastEvent> PartitionLast(const Partition& partition) const;
+    void DropPartition(Partition& partition);
+    //см. Dictionary; номера событий разделов, представлений и индексов переводятся на новый словарь
+    void CompactDictionary();
+    //удаляет раздел, выбранный Del целиком, и возвращает число его событий; его даты не обходятся
+    int DropWholePartition(Partition& partition, int& removed_from, int& removed_to);
+
+    //выгруженный раздел, в даты которого условие точно не попадает, не читается с диска
+    template <typename T>
+    bool SkipSegment(T& predicate, const Partition& partition, Bitmap& selection) const{
+        if(partition.storage)
+            return false;
+        const Segment& segment = *partition.segment;
+        const std::pair<int, int> bounds = DateBounds(predicate, 0);
+        bool skip = bounds.second < segment.First() || bounds.first > segment.Last();
+        if(!skip && DatesOnly(predicate, 0)){
+            SelectDates(predicate, segment.Dates().data(), segment.Dates().size(), selection, 0);
+            skip = !AnyBit(selection);
+        }
+        segments_skipped_ += skip;
+        return skip;
+    }
+
+    //все ли даты раздела выбраны условием только на даты. Для точного диапазона (DateBoundsExact)
+    //достаточно первой и последней даты раздела, иначе проверяется каждая дата
+    template <typename T>
+    static bool WholePartition(T& predicate, const Partition& partition, Bitmap& selection, ScanCounters& counters){
+        if(partition.storage && partition.storage->ALL_DATA.empty())
+            return false;
+        if(DateBoundsExact(predicate, 0)){
+            const std::pair<int, int> bounds = DateBounds(predicate, 0);
+            return bounds.first <= PartitionFirstDate(partition) && PartitionLastDate(partition) <= bounds.second;
+        }
+        if(!partition.storage){
+            const Segment& segment = *partition.segment;
+            SelectDates(predicate, segment.Dates().data(), segment.Dates().size(), selection, 0);
+            return CountBits(selection) == segment.Dates().size();
+        }
+        for(const DateDirectory::Block& block : partition.storage->ALL_DATA.Blocks()){
+            SelectDates(predicate, block.dates.data(), block.dates.size(), selection, 0);
+            counters.dates_visited += block.dates.size();
+            if(CountBits(selection) != block.dates.size())
+                return false;
+        }
+        return true;
+    }
+    //первая и последняя даты непустого раздела, в памяти или в сегменте
+    static int PartitionFirstDate(const Partition& partition){
+        return partition.storage ? partition.storage->ALL_DATA.FirstDate() : partition.segment->First();
+    }
+    static int PartitionLastDate(const Partition& partition){
+        return partition.storage ? partition.storage->ALL_DATA.LastDate() : partition.segment->Last();
+    }
+
+    //тексты событий хранятся один раз на базу; копии базы делят словарь, номера в нём не меняются.
+    //CompactDictionary не трогает общий словарь, а переводит базу на новый
+    std::shared_ptr<EventDictionary> dictionary_ = std::make_shared<EventDictionary>();
+    DatabaseAllocation allocation_;
+    DatePartitioning partitioning_ = DatePartitioning::None;
+    mutable std::vector<Partition> partitions_;//по возрастанию key; чтения подгружают выгруженные разделы
+    mutable size_t pending_ = 0;//событий в буферах Add всех разделов
+    size_t partitions_dropped_ = 0;//разделы, удалённые Del целиком
+    int cold_before_ = INT_MIN;//см. SetTiering; INT_MIN - все разделы в памяти
+    std::string segment_directory_;
+    mutable size_t pages_in_ = 0;
+    mutable size_t evictions_ = 0;
+    mutable size_t segments_skipped_ = 0;//выгруженные разделы, отсечённые по датам условия
+    std::vector<MaterializedView> views_;
+    mutable ResultCache cache_;//у копии базы кэш свой и начинается пустым
+    size_t add_buffer_ = 0;//см. SetAddBuffer
+    size_t event_filter_bits_ = DEFAULT_EVENT_FILTER_BITS;//см. SetEventFilter
+    void MergePending() const;
+    void MergePending(Storage& storage) const;
+    const MaterializedView& GetView(const std::string& name) const;
+
+    static int GroupMask(DateGrouping grouping){
+        return grouping == DateGrouping::Year ? ~511 : grouping == DateGrouping::Month ? ~31 : ~0;
+    }
+
+    //Общий обход для поиска и агрегатов: whole_date(date, column) - дата выбрана целиком
+    //условием только на даты, events(date, column, selection) - выбраны отдельные события
+    template <typename T, typename WholeDate, typename Events>
+    void ScanIf(T& predicate, WholeDate whole_date, Events events) const{
+        Flush();
+        ScanCounters counters;
+        Bitmap selection;
+        for(Partition& partition : partitions_){
+            if(SkipSegment(predicate, partition, selection))
+                continue;
+            for(const DateDirectory::Block& block : Resident(partition).ALL_DATA.Blocks()){
+                counters.dates_visited += block.dates.size();
+                if(DatesOnly(predicate, 0)){
+                    SelectDates(predicate, block.dates.data(), block.dates.size(), selection, 0);
+                    ForEachBit(selection, [&](size_t i){
+                        counters.events_matched += block.columns[i].size();
+                        whole_date(block.dates[i], block.columns[i]);
+                    });
+                    continue;
+                }
+                for(size_t i = 0; i < block.dates.size(); ++i){
+                    if(SkipByFilter(predicate, block.columns[i], event_filter_bits_, counters, 0))
+                        continue;
+                    SelectEvents(predicate, UnpackDate(block.dates[i]), block.columns[i], selection, 0);
+                    counters.events_scanned += block.columns[i].size();
+                    if(AnyBit(selection)){
+                        counters.events_matched += CountBits(selection);
+                        events(block.dates[i], block.columns[i], selection);
+                    }
+                }
+            }
+        }
+        Stats::Instance().RecordScan(counters);
+    }
+    std::string ToStringVector(const EventColumn& column,std::string nums) const;
 };
\ No newline at end of file
@@ -54,6 +54,9 @@ Date ParseDate(std::istream& stream){
     //std::istringstream stream1(stream);
     int y,m,d;
     if(stream >> y && stream.get() == '-' && stream >> m && stream.get() == '-' && stream >> d && (stream.peek() == ' ' || stream.peek() == EOF)){
+        if(y < Date::MIN_YEAR || y > Date::MAX_YEAR){
+            throw std::runtime_error("Year value is invalid: " + std::to_string(y));
+        }
         if(((m < 1 || m > 12) && (d < 1 || d > 31)) || (m < 1 || m > 12)){
             throw std::runtime_error("Month value is invalid: " + std::to_string(m));
         }else{
@@ -1,4 +1,5 @@
 #pragma once
+#include <climits>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -15,6 +16,12 @@ public:
     int GetMonth() const;
     int GetDay() const;
 
+    //дата, упакованная в одно число с сохранением порядка: year * 512 + month * 32 + day
+    int GetPacked() const {return year * 512 + month * 32 + day;}
+    //годы, для которых GetPacked помещается в int; ParseDate отвергает остальные
+    static const int MIN_YEAR = INT_MIN / 512;
+    static const int MAX_YEAR = INT_MAX / 512;
+
     std::string ToString() const;
 
 private:
@@ -37,4 +44,10 @@ bool operator == (const Date& lhs, const Date& rhs);
 
 bool operator != (const Date& lhs, const Date& rhs);
 
-Date ParseDate(std::istream& stream);
\ No newline at end of file
+Date ParseDate(std::istream& stream);
+
+//обратное к Date::GetPacked
+inline Date UnpackDate(int packed){
+    const int rest = packed & 511;
+    return {(packed - rest) / 512, rest >> 5, rest & 31};
+}
\ No newline at end of file
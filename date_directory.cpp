@@ -0,0 +1,148 @@
+#include "date_directory.h"
+
+#include <algorithm>
+
+const size_t DateDirectory::BLOCK_SIZE;
+
+DateDirectory::DateDirectory(pmr::memory_resource* resource) : blocks_(resource), fences_(resource) {}
+
+DateDirectory::DateDirectory(const DateDirectory& other, pmr::memory_resource* resource)
+        : blocks_(other.blocks_, resource), fences_(other.fences_, resource), size_(other.size_) {}
+
+DateDirectory::Position DateDirectory::LowerBound(int date) const {
+    //блок, в котором может лежать date: последний с первой датой <= date
+    auto fence = upper_bound(fences_.begin(), fences_.end(), date);
+    size_t block = fence == fences_.begin() ? 0 : static_cast<size_t>(fence - fences_.begin()) - 1;
+    const pmr::vector<int>& dates = blocks_[block].dates;
+    return {block, static_cast<size_t>(lower_bound(dates.begin(), dates.end(), date) - dates.begin())};
+}
+
+EventColumn* DateDirectory::Find(int date) {
+    return const_cast<EventColumn*>(static_cast<const DateDirectory*>(this)->Find(date));
+}
+
+const EventColumn* DateDirectory::Find(int date) const {
+    if (blocks_.empty()) {
+        return nullptr;
+    }
+    const Position position = LowerBound(date);
+    const Block& block = blocks_[position.block];
+    if (position.index < block.dates.size() && block.dates[position.index] == date) {
+        return &block.columns[position.index];
+    }
+    return nullptr;
+}
+
+EventColumn& DateDirectory::FindOrInsert(int date, const EventDictionary* dictionary) {
+    if (blocks_.empty() || date > blocks_.back().dates.back()) {//дописывание в конец
+        return Append(date, dictionary);
+    }
+    Position position = LowerBound(date);
+    return InsertAt(position, date, dictionary);
+}
+
+EventColumn& DateDirectory::FindOrInsert(int date, const EventDictionary* dictionary, Position& hint) {
+    if (blocks_.empty() || date > blocks_.back().dates.back()) {
+        EventColumn& column = Append(date, dictionary);
+        hint = {blocks_.size() - 1, blocks_.back().dates.size() - 1};
+        return column;
+    }
+    //date не меньше даты на hint: блок ищется только среди следующих
+    size_t block = min(hint.block, blocks_.size() - 1);
+    size_t from = hint.index;
+    if (block + 1 < fences_.size() && fences_[block + 1] <= date) {
+        block = static_cast<size_t>(upper_bound(fences_.begin() + block + 1, fences_.end(), date) - fences_.begin()) - 1;
+        from = 0;
+    }
+    const pmr::vector<int>& dates = blocks_[block].dates;
+    from = min(from, dates.size());
+    hint = {block, static_cast<size_t>(lower_bound(dates.begin() + from, dates.end(), date) - dates.begin())};
+    return InsertAt(hint, date, dictionary);
+}
+
+EventColumn& DateDirectory::Append(int date, const EventDictionary* dictionary) {
+    if (blocks_.empty() || blocks_.back().dates.size() == BLOCK_SIZE) {
+        blocks_.emplace_back();//арена каталога передаётся блоку через uses-allocator
+        blocks_.back().dates.reserve(BLOCK_SIZE);
+        blocks_.back().columns.reserve(BLOCK_SIZE);
+        fences_.push_back(date);
+    }
+    Block& block = blocks_.back();
+    block.dates.push_back(date);
+    block.columns.emplace_back(dictionary);
+    ++size_;
+    return block.columns.back();
+}
+
+EventColumn& DateDirectory::InsertAt(Position& position, int date, const EventDictionary* dictionary) {
+    Block* block = &blocks_[position.block];
+    if (position.index < block->dates.size() && block->dates[position.index] == date) {
+        return block->columns[position.index];
+    }
+    if (block->dates.size() == BLOCK_SIZE) {//полный блок делится пополам
+        Block right(blocks_.get_allocator());
+        right.dates.reserve(BLOCK_SIZE);
+        right.columns.reserve(BLOCK_SIZE);
+        const size_t half = BLOCK_SIZE / 2;
+        right.dates.assign(block->dates.begin() + half, block->dates.end());
+        for (size_t i = half; i < block->columns.size(); ++i) {
+            right.columns.push_back(move(block->columns[i]));
+        }
+        block->dates.resize(half);
+        block->columns.erase(block->columns.begin() + half, block->columns.end());
+        blocks_.insert(blocks_.begin() + position.block + 1, move(right));
+        fences_.insert(fences_.begin() + position.block + 1, blocks_[position.block + 1].dates.front());
+        if (position.index > half) {
+            ++position.block;
+            position.index -= half;
+        }
+        block = &blocks_[position.block];
+    }
+    block->dates.insert(block->dates.begin() + position.index, date);
+    block->columns.emplace(block->columns.begin() + position.index, dictionary);
+    fences_[position.block] = block->dates.front();
+    ++size_;
+    return block->columns[position.index];
+}
+
+bool DateDirectory::FindLastNotAfter(int date, Position& position) const {
+    if (blocks_.empty() || date < fences_.front()) {
+        return false;
+    }
+    auto fence = upper_bound(fences_.begin(), fences_.end(), date);
+    position.block = static_cast<size_t>(fence - fences_.begin()) - 1;
+    const pmr::vector<int>& dates = blocks_[position.block].dates;
+    position.index = static_cast<size_t>(upper_bound(dates.begin(), dates.end(), date) - dates.begin()) - 1;
+    return true;
+}
+
+void DateDirectory::RemoveEmptyDates() {
+    size_ = 0;
+    for (Block& block : blocks_) {
+        size_t kept = 0;
+        for (size_t i = 0; i < block.dates.size(); ++i) {
+            if (block.columns[i].empty()) {
+                continue;
+            }
+            if (kept != i) {
+                block.dates[kept] = block.dates[i];
+                block.columns[kept] = move(block.columns[i]);
+            }
+            ++kept;
+        }
+        block.dates.resize(kept);
+        block.columns.erase(block.columns.begin() + kept, block.columns.end());
+        size_ += kept;
+    }
+    blocks_.erase(remove_if(blocks_.begin(), blocks_.end(), [](const Block& block) {
+        return block.dates.empty();
+    }), blocks_.end());
+    RebuildFences();
+}
+
+void DateDirectory::RebuildFences() {
+    fences_.clear();
+    for (const Block& block : blocks_) {
+        fences_.push_back(block.dates.front());
+    }
+}
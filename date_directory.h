@@ -0,0 +1,76 @@
+#pragma once
+#include "date.h"
+#include "event_column.h"
+
+#include <memory_resource>
+#include <vector>
+
+//Каталог дат базы вместо std::map<Date, EventColumn>: отсортированные упакованные даты
+//(Date::GetPacked) лежат блоками до BLOCK_SIZE штук вместе со столбцами событий.
+//Поиск - бинарный по первым датам блоков (короткий массив, помещается в кэш), затем внутри блока.
+//Дата больше всех имеющихся дописывается в конец без поиска; обход идёт подряд по памяти.
+class DateDirectory {
+public:
+    static const size_t BLOCK_SIZE = 64;
+
+    struct Block {
+        using allocator_type = pmr::polymorphic_allocator<int>;
+
+        explicit Block(const allocator_type& allocator = {}) : dates(allocator), columns(allocator) {}
+        Block(const Block& other, const allocator_type& allocator)
+                : dates(other.dates, allocator), columns(other.columns, allocator) {}
+        Block(Block&& other, const allocator_type& allocator)
+                : dates(move(other.dates), allocator), columns(move(other.columns), allocator) {}
+        Block(const Block&) = default;
+        Block(Block&&) = default;
+        Block& operator=(const Block&) = default;
+        Block& operator=(Block&&) = default;
+
+        pmr::vector<int> dates;
+        pmr::vector<EventColumn> columns;
+    };
+
+    //позиция даты: номер блока и место в нём
+    struct Position {
+        size_t block;
+        size_t index;
+    };
+
+    explicit DateDirectory(pmr::memory_resource* resource = pmr::get_default_resource());
+    DateDirectory(const DateDirectory& other, pmr::memory_resource* resource);
+
+    size_t size() const {return size_;}
+    bool empty() const {return size_ == 0;}
+    //первая и последняя даты непустого каталога
+    int FirstDate() const {return blocks_.front().dates.front();}
+    int LastDate() const {return blocks_.back().dates.back();}
+
+    pmr::vector<Block>& Blocks() {return blocks_;}
+    const pmr::vector<Block>& Blocks() const {return blocks_;}
+
+    //столбец событий даты или nullptr
+    EventColumn* Find(int date);
+    const EventColumn* Find(int date) const;
+    //столбец событий даты; при отсутствии создаётся пустой
+    EventColumn& FindOrInsert(int date, const EventDictionary* dictionary);
+    //то же для дат, идущих по возрастанию (слияние отсортированной пачки): hint - позиция
+    //предыдущей даты, в начале {0, 0}. Поиск идёт от неё вперёд, и hint переходит на позицию date
+    EventColumn& FindOrInsert(int date, const EventDictionary* dictionary, Position& hint);
+
+    //последняя дата не позже date; false, если таких нет
+    bool FindLastNotAfter(int date, Position& position) const;
+
+    //удаляет даты с пустыми столбцами и пустые блоки
+    void RemoveEmptyDates();
+
+private:
+    Position LowerBound(int date) const;
+    EventColumn& Append(int date, const EventDictionary* dictionary);
+    //position - место date по LowerBound; после деления блока указывает на место date
+    EventColumn& InsertAt(Position& position, int date, const EventDictionary* dictionary);
+    void RebuildFences();
+
+    pmr::vector<Block> blocks_;
+    pmr::vector<int> fences_;//первая дата каждого блока
+    size_t size_ = 0;
+};
@@ -0,0 +1,80 @@
+#include "date_match.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void MatchScalar(const int* dates, size_t begin, size_t count, int from, int to, Bitmap& selection) {
+    uint64_t word = 0;
+    for (size_t i = begin; i < count; ++i) {
+        word |= uint64_t(from <= dates[i] && dates[i] <= to) << (i % 64);
+        if (i % 64 == 63 || i + 1 == count) {
+            selection[i / 64] |= word;
+            word = 0;
+        }
+    }
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+void MatchSse2(const int* dates, size_t count, int from, int to, Bitmap& selection) {
+    const __m128i low = _mm_set1_epi32(from);
+    const __m128i high = _mm_set1_epi32(to);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dates + i));
+        const __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(low, block), _mm_cmpgt_epi32(block, high));
+        const uint64_t mask = static_cast<unsigned>(~_mm_movemask_ps(_mm_castsi128_ps(outside))) & 0xFu;
+        selection[i / 64] |= mask << (i % 64);
+    }
+    MatchScalar(dates, i, count, from, to, selection);
+}
+
+SIMD_TARGET("avx2")
+void MatchAvx2(const int* dates, size_t count, int from, int to, Bitmap& selection) {
+    const __m256i low = _mm256_set1_epi32(from);
+    const __m256i high = _mm256_set1_epi32(to);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dates + i));
+        const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(low, block), _mm256_cmpgt_epi32(block, high));
+        const uint64_t mask = static_cast<unsigned>(~_mm256_movemask_ps(_mm256_castsi256_ps(outside))) & 0xFFu;
+        selection[i / 64] |= mask << (i % 64);
+    }
+    MatchScalar(dates, i, count, from, to, selection);
+}
+
+#endif
+
+void Run(SimdLevel level, const int* dates, size_t count, int from, int to, Bitmap& selection) {
+    ClearBitmap(selection, count);
+    switch (level) {
+#ifdef SIMD_X86
+        case SimdLevel::Avx2:
+            MatchAvx2(dates, count, from, to, selection);
+            return;
+        case SimdLevel::Sse2:
+            MatchSse2(dates, count, from, to, selection);
+            return;
+#endif
+        default:
+            MatchScalar(dates, 0, count, from, to, selection);
+    }
+}
+
+}
+
+void MatchDateRange(const int* dates, size_t count, int from, int to, Bitmap& selection) {
+    Run(ActiveSimdLevel(), dates, count, from, to, selection);
+}
+
+bool MatchDateRangeWith(SimdLevel level, const int* dates, size_t count, int from, int to, Bitmap& selection) {
+    if (!SimdLevelSupported(level)) {
+        return false;
+    }
+    Run(level, dates, count, from, to, selection);
+    return true;
+}
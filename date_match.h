@@ -0,0 +1,10 @@
+#pragma once
+#include "bitmap.h"
+#include "simd_dispatch.h"
+
+//Векторная проверка столбца упакованных дат (Date::GetPacked) на попадание в диапазон [from, to].
+//selection перезаписывается и получает размер count.
+void MatchDateRange(const int* dates, size_t count, int from, int to, Bitmap& selection);
+
+//для тестов и замеров: вызов конкретной реализации, если она поддерживается процессором
+bool MatchDateRangeWith(SimdLevel level, const int* dates, size_t count, int from, int to, Bitmap& selection);
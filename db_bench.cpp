@@ -0,0 +1,445 @@
+#include "database.h"
+#include "condition_parser.h"
+#include "predicates.h"
+#include "event_match.h"
+#include "date_match.h"
+#include "bench_suite.h"
+
+#include <chrono>
+#include <fstream>
+
+//db_bench [--events N ...] - набор замеров всех операций с отчётом в JSON (bench_suite.h);
+//db_bench compare - сравнения вариантов реализации: общий путь через Node::Evaluate против
+//специализированных предикатов, ядра SIMD, арена и т.п.; db_bench add N... - только Add.
+
+namespace {
+
+Database MakeDatabase(int dates, int events_per_date) {
+    Database db;
+    for (int i = 0; i < dates; ++i) {
+        const Date date(2000 + i / 360, 1 + (i / 30) % 12, 1 + i % 30);
+        for (int j = 0; j < events_per_date; ++j) {
+            db.Add(date, "event number " + to_string(j));
+        }
+    }
+    return db;
+}
+
+template <typename Predicate>
+double NanosecondsPerEvent(const Database& db, Predicate predicate, size_t events, size_t& found) {
+    const int repeats = 5;
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        found = db.FindIf(predicate).size();
+    }
+    const auto finish = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(finish - start).count() / repeats / events;
+}
+
+size_t ResidentBytes() {
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * 4096;
+}
+
+//несколько тысяч различных событий, повторяющихся по множеству дат
+void BenchMemory() {
+    const size_t before = ResidentBytes();
+    Database db;
+    const int dates = 100000;
+    const int events_per_date = 20;
+    for (int i = 0; i < dates; ++i) {
+        const Date date(1900 + i / 360, 1 + (i / 30) % 12, 1 + i % 30);
+        for (int j = 0; j < events_per_date; ++j) {
+            db.Add(date, "recurring event name " + to_string((i * 7 + j * 13) % 3000));
+        }
+    }
+    const size_t after = ResidentBytes();
+    cout << "memory: " << static_cast<double>(after - before) / (static_cast<size_t>(dates) * events_per_date)
+         << " bytes/event" << endl;
+}
+
+//наполнение и уничтожение базы: собственная арена против new/delete
+void BenchAllocation() {
+    const int dates = 200000;
+    const int events_per_date = 10;
+    const double events = static_cast<double>(dates) * events_per_date;
+    for (auto allocation : {DatabaseAllocation::Default, DatabaseAllocation::Arena}) {
+        const char* name = allocation == DatabaseAllocation::Arena ? "arena" : "default";
+        auto start = chrono::steady_clock::now();
+        {
+            Database db(allocation);
+            for (int i = 0; i < dates; ++i) {
+                const Date date(1900 + i / 360, 1 + (i / 30) % 12, 1 + i % 30);
+                for (int j = 0; j < events_per_date; ++j) {
+                    db.Add(date, "recurring event name " + to_string((i * 7 + j * 13) % 3000));
+                }
+            }
+            const auto filled = chrono::steady_clock::now();
+            cout << "ingest " << name << ": " << chrono::duration<double, nano>(filled - start).count() / events
+                 << " ns/add" << endl;
+            start = chrono::steady_clock::now();
+        }
+        const auto finish = chrono::steady_clock::now();
+        cout << "teardown " << name << ": " << chrono::duration<double, milli>(finish - start).count()
+             << " ms for " << events << " events" << endl;
+    }
+}
+
+//пропускная способность Add и занимаемая память на events событиях;
+//shuffled - даты приходят вразнобой, а не по возрастанию
+void BenchAdd(size_t events, bool shuffled) {
+    const size_t events_per_date = 20;
+    vector<string> texts;
+    for (int i = 0; i < 3000; ++i) {
+        texts.push_back("recurring event name " + to_string(i));
+    }
+    const size_t before = ResidentBytes();
+    const auto start = chrono::steady_clock::now();
+    Database db;
+    for (size_t i = 0; i < events; ++i) {
+        const size_t day = shuffled ? (i * 2654435761u) % (events / events_per_date) : i / events_per_date;
+        const Date date(1 + static_cast<int>(day / 372), 1 + static_cast<int>(day / 31 % 12), 1 + static_cast<int>(day % 31));
+        db.Add(date, texts[(i * 7919) % texts.size()]);
+    }
+    const auto finish = chrono::steady_clock::now();
+    cout << "add " << (shuffled ? "shuffled " : "") << events << ": " << chrono::duration<double, nano>(finish - start).count() / events
+         << " ns/add, " << static_cast<double>(ResidentBytes() - before) / events << " bytes/event" << endl;
+}
+
+//Last для дат вразброс по всему диапазону базы
+void BenchLast(const Database& db, int dates) {
+    const int queries = 1000000;
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        const int day = static_cast<int>((i * 2654435761u) % (dates + 400));
+        found += db.Last(Date(1999 + day / 360, 1 + (day / 30) % 12, 1 + day % 30)) != "No entries";
+    }
+    auto finish = chrono::steady_clock::now();
+    cout << "last string: " << chrono::duration<double, nano>(finish - start).count() / queries
+         << " ns/query, found " << found << endl;
+
+    found = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        const int day = static_cast<int>((i * 2654435761u) % (dates + 400));
+        const auto last = db.LastEntry(Date(1999 + day / 360, 1 + (day / 30) % 12, 1 + day % 30));
+        found += last && !last->event.empty();
+    }
+    finish = chrono::steady_clock::now();
+    cout << "last entry: " << chrono::duration<double, nano>(finish - start).count() / queries
+         << " ns/query, found " << found << endl;
+
+    //отчёт по подряд идущим датам: одиночные запросы против LastMany
+    vector<Date> report;
+    for (int day = 0; day < dates; ++day) {
+        report.push_back(Date(2000 + day / 360, 1 + (day / 30) % 12, 1 + day % 30));
+    }
+    const int repeats = 50;
+    found = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const Date& date : report) {
+            found += static_cast<bool>(db.LastEntry(date));
+        }
+    }
+    finish = chrono::steady_clock::now();
+    cout << "last report single: " << chrono::duration<double, nano>(finish - start).count() / repeats / report.size()
+         << " ns/query, found " << found / repeats << endl;
+    found = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const auto& last : db.LastMany(report)) {
+            found += static_cast<bool>(last);
+        }
+    }
+    finish = chrono::steady_clock::now();
+    cout << "last report many: " << chrono::duration<double, nano>(finish - start).count() / repeats / report.size()
+         << " ns/query, found " << found / repeats << endl;
+}
+
+//повторяющийся Find против чтения представления и цена представлений для Add
+void BenchViews() {
+    const string condition = R"(date >= 2010-01-01 AND date < 2010-02-01 AND event == "event number 7")";
+    Database db = MakeDatabase(20000, 50);
+    istringstream is(condition);
+    const NodePredicate predicate(ParseCondition(is));
+    const int repeats = 100;
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        found = db.FindIf(predicate).size();
+    }
+    auto finish = chrono::steady_clock::now();
+    cout << "view source find: " << chrono::duration<double, micro>(finish - start).count() / repeats
+         << " us/query, found " << found << endl;
+
+    for (int i = 0; i < 12; ++i) {
+        db.CreateView("view" + to_string(i), i == 0 ? condition : R"(event == "event number )" + to_string(i) + "\"");
+    }
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        found = db.ReadView("view0").size();
+    }
+    finish = chrono::steady_clock::now();
+    cout << "view read: " << chrono::duration<double, micro>(finish - start).count() / repeats
+         << " us/query, found " << found << endl;
+
+    const int adds = 200000;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < adds; ++i) {
+        db.Add(Date(2100 + i / 360, 1 + (i / 30) % 12, 1 + i % 30), "event number " + to_string(i % 50));
+    }
+    finish = chrono::steady_clock::now();
+    chrono::nanoseconds maintenance{0};
+    for (const auto& view : db.Views()) {
+        maintenance += view.Stats().maintenance;
+    }
+    cout << "add with 12 views: " << chrono::duration<double, nano>(finish - start).count() / adds
+         << " ns/add, of them views " << chrono::duration<double, nano>(maintenance).count() / adds << " ns" << endl;
+}
+
+//повторяющийся Find через кэш результатов и цена проверки кэша в Add
+void BenchResultCache() {
+    Database db = MakeDatabase(20000, 50);
+    const vector<string> spellings = {R"(event == "event number 7" AND date >= 2010-01-01)",
+                                      R"(date>=2010-01-01 AND event=="event number 7")"};
+    const int repeats = 100;
+    size_t found = 0;
+    const auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        istringstream is(spellings[r % spellings.size()]);
+        found = db.FindCached(ParseCondition(is))->size();
+    }
+    const auto finish = chrono::steady_clock::now();
+    const ResultCacheStats stats = db.CacheStats();
+    cout << "result cache find: " << chrono::duration<double, micro>(finish - start).count() / repeats
+         << " us/query, found " << found << ", hits " << stats.hits << "/" << stats.hits + stats.misses
+         << ", memory " << stats.memory << " bytes" << endl;
+}
+
+//подсчёт через Find против CountIf
+void BenchAggregates(const Database& db, size_t events) {
+    for (const auto& text : {"date >= 2005-01-01 AND date < 2050-01-01", R"(event == "event number 7")"}) {
+        istringstream is(text);
+        const auto condition = ParseCondition(is);
+        size_t found = 0;
+        const double find = NanosecondsPerEvent(db, NodePredicate(condition), events, found);
+        const int repeats = 5;
+        size_t count = 0;
+        const auto start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            count = DispatchCondition(condition, [&db](auto predicate) {return db.CountIf(predicate);});
+        }
+        const auto finish = chrono::steady_clock::now();
+        cout << "count " << text << ": find " << find << " ns/event, count "
+             << chrono::duration<double, nano>(finish - start).count() / repeats / events << " ns/event, "
+             << count << (count == found ? "" : " MISMATCH") << endl;
+    }
+}
+
+//первая и последняя страница из 50 записей против полного Find
+void BenchFindPages(const Database& db) {
+    istringstream is(R"(event != "event number 7")");
+    const auto condition = ParseCondition(is);
+    const int repeats = 100;
+    for (bool descending : {false, true}) {
+        FindOptions page;
+        page.limit = 50;
+        page.descending = descending;
+        size_t found = 0;
+        const auto start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            found = DispatchCondition(condition, [&db, &page](auto predicate) {return db.FindIf(predicate, page);}).size();
+        }
+        const auto finish = chrono::steady_clock::now();
+        cout << "find page" << (descending ? " desc" : "") << ": "
+             << chrono::duration<double, micro>(finish - start).count() / repeats << " us/page, rows " << found << endl;
+    }
+    const auto start = chrono::steady_clock::now();
+    const size_t found = db.FindIf(NodePredicate(condition)).size();
+    const auto finish = chrono::steady_clock::now();
+    cout << "find full: " << chrono::duration<double, micro>(finish - start).count() << " us, rows " << found << endl;
+}
+
+//перенос всей базы: текст Find с разбором строк против Export/Import
+void BenchExportImport(const Database& db, size_t events) {
+    auto start = chrono::steady_clock::now();
+    const vector<string> lines = db.FindIf(NodePredicate(make_shared<EmptyNode>()));
+    Database text_copy;
+    for (const string& line : lines) {
+        istringstream is(line);
+        const Date date = ParseDate(is);
+        text_copy.Add(date, ParseEvent(is));
+    }
+    auto finish = chrono::steady_clock::now();
+    cout << "transfer text: " << chrono::duration<double, nano>(finish - start).count() / events << " ns/event" << endl;
+
+    start = chrono::steady_clock::now();
+    stringstream buffer;
+    db.ExportIf(NodePredicate(make_shared<EmptyNode>()), buffer);
+    const size_t bytes = buffer.str().size();
+    Database binary_copy;
+    const size_t imported = binary_copy.Import(buffer);
+    finish = chrono::steady_clock::now();
+    cout << "transfer binary: " << chrono::duration<double, nano>(finish - start).count() / events << " ns/event, "
+         << static_cast<double>(bytes) / events << " bytes/event, imported " << imported << endl;
+}
+
+void BenchEventMatch() {
+    EventDictionary dictionary;
+    EventColumn column(&dictionary);
+    vector<string> texts;
+    for (int i = 0; i < 4096; ++i) {
+        texts.push_back(i % 3 == 0 ? "sport event " + to_string(i % 100) : "holiday " + to_string(i % 7));
+        column.push_back(dictionary.Intern(texts.back()));
+    }
+    const string needle = "sport event 42";
+    const uint32_t needle_id = dictionary.Find(needle);
+    const int repeats = 2000;
+    const size_t events = column.size() * repeats;
+
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const string& event : texts) {
+            found += event == needle;
+        }
+    }
+    auto finish = chrono::steady_clock::now();
+    cout << "event match std::string: " << chrono::duration<double, nano>(finish - start).count() / events
+         << " ns/event, matches " << found / repeats << endl;
+
+    const vector<pair<string, SimdLevel>> kernels = {
+            {"scalar", SimdLevel::Scalar}, {"sse2", SimdLevel::Sse2}, {"avx2", SimdLevel::Avx2}
+    };
+    Bitmap selection;
+    for (const auto& kernel : kernels) {
+        found = 0;
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            ClearBitmap(selection, column.size());
+            if (!MatchEventEqualWith(kernel.second, column, needle_id, selection)) {
+                break;
+            }
+            found += CountBits(selection);
+        }
+        finish = chrono::steady_clock::now();
+        cout << "event match " << kernel.first << ": "
+             << chrono::duration<double, nano>(finish - start).count() / events
+             << " ns/event, matches " << found / repeats << endl;
+    }
+}
+
+void BenchDateMatch() {
+    vector<int> dates;
+    for (int i = 0; i < 1 << 20; ++i) {
+        dates.push_back(Date(1990 + i / 360 % 40, 1 + (i / 30) % 12, 1 + i % 30).GetPacked());
+    }
+    const int from = Date(2010, 1, 1).GetPacked();
+    const int to = Date(2010, 12, 31).GetPacked();
+    const int repeats = 20;
+
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (int date : dates) {
+            found += from <= date && date <= to;
+        }
+    }
+    auto finish = chrono::steady_clock::now();
+    cout << "date range branchy loop: "
+         << chrono::duration<double, nano>(finish - start).count() / repeats / dates.size()
+         << " ns/date, matches " << found / repeats << endl;
+
+    const vector<pair<string, SimdLevel>> levels = {
+            {"scalar", SimdLevel::Scalar}, {"sse2", SimdLevel::Sse2}, {"avx2", SimdLevel::Avx2}
+    };
+    Bitmap selection;
+    for (const auto& level : levels) {
+        found = 0;
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            if (!MatchDateRangeWith(level.second, dates.data(), dates.size(), from, to, selection)) {
+                break;
+            }
+            found += CountBits(selection);
+        }
+        finish = chrono::steady_clock::now();
+        cout << "date range " << level.first << ": "
+             << chrono::duration<double, nano>(finish - start).count() / repeats / dates.size()
+             << " ns/date, matches " << found / repeats << endl;
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    //db_bench add N... - только замер Add на заданных объёмах
+    if (argc > 2 && string(argv[1]) == "add") {
+        for (int i = 2; i < argc; ++i) {
+            BenchAdd(stoull(argv[i]), false);
+            BenchAdd(stoull(argv[i]), true);
+        }
+        return 0;
+    }
+    if (argc == 1 || string(argv[1]) != "compare") {
+        string json_path;
+        try {
+            const WorkloadOptions options = ParseWorkloadOptions(vector<string>(argv + 1, argv + argc), json_path);
+            if (json_path.empty()) {
+                RunBenchSuite(options, cout);
+            } else {
+                ofstream json(json_path);
+                RunBenchSuite(options, json);
+            }
+        } catch (invalid_argument& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    const int dates = 20000;
+    const int events_per_date = 50;
+    const size_t events = static_cast<size_t>(dates) * events_per_date;
+    const Database db = MakeDatabase(dates, events_per_date);
+
+    const vector<pair<string, string>> shapes = {
+            {"date range", "date >= 2010-01-01 AND date < 2010-02-01"},
+            {"event equality", R"(event == "event number 7")"},
+            {"date range and event", R"(date >= 2010-01-01 AND date < 2020-01-01 AND event == "event number 7")"},
+            {"or of equalities", R"(event == "event number 7" OR event == "event number 8" OR event == "x")"},
+    };
+
+    cout << "events: " << events << endl;
+    for (const auto& shape : shapes) {
+        istringstream is(shape.second);
+        const auto condition = ParseCondition(is);
+
+        size_t generic_found = 0;
+        const double generic = NanosecondsPerEvent(db, NodePredicate(condition), events, generic_found);
+
+        size_t special_found = 0;
+        const double special = DispatchCondition(condition, [&](auto predicate) {
+            return NanosecondsPerEvent(db, predicate, events, special_found);
+        });
+
+        cout << shape.first << ": node " << generic << " ns/event, specialised " << special
+             << " ns/event, matches " << special_found << (generic_found == special_found ? "" : " MISMATCH")
+             << endl;
+    }
+    BenchLast(db, dates);
+    BenchAggregates(db, events);
+    BenchFindPages(db);
+    BenchExportImport(db, events);
+    BenchViews();
+    BenchResultCache();
+    BenchEventMatch();
+    BenchMemory();
+    BenchAllocation();
+    BenchDateMatch();
+    return 0;
+}
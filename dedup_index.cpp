@@ -0,0 +1,84 @@
+#include "dedup_index.h"
+
+const uint64_t DedupIndex::EMPTY;
+
+namespace {
+
+inline size_t Mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+}
+
+}
+
+DedupIndex::DedupIndex(std::pmr::memory_resource* resource) : slots_(resource) {}
+
+DedupIndex::DedupIndex(const DedupIndex& other, std::pmr::memory_resource* resource)
+        : slots_(other.slots_, resource), size_(other.size_) {}
+
+size_t DedupIndex::Slot(uint64_t key) const {
+    const size_t mask = slots_.size() - 1;
+    size_t slot = Mix(key) & mask;
+    while (slots_[slot] != EMPTY && slots_[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void DedupIndex::Rehash(size_t capacity) {
+    std::pmr::vector<uint64_t> old(capacity, EMPTY, slots_.get_allocator());
+    old.swap(slots_);
+    for (uint64_t key : old) {
+        if (key != EMPTY) {
+            slots_[Slot(key)] = key;
+        }
+    }
+}
+
+bool DedupIndex::Insert(int date, uint32_t id) {
+    if ((size_ + 1) * 4 > slots_.size() * 3) {//заполнение не выше 3/4
+        Rehash(slots_.empty() ? 64 : slots_.size() * 2);
+    }
+    const uint64_t key = Key(date, id);
+    const size_t slot = Slot(key);
+    if (slots_[slot] == key) {
+        return false;
+    }
+    slots_[slot] = key;
+    ++size_;
+    return true;
+}
+
+bool DedupIndex::Contains(int date, uint32_t id) const {
+    if (slots_.empty()) {
+        return false;
+    }
+    const uint64_t key = Key(date, id);
+    return slots_[Slot(key)] == key;
+}
+
+bool DedupIndex::Erase(int date, uint32_t id) {
+    if (slots_.empty()) {
+        return false;
+    }
+    const size_t mask = slots_.size() - 1;
+    size_t hole = Slot(Key(date, id));
+    if (slots_[hole] == EMPTY) {
+        return false;
+    }
+    //сдвиг назад: подтягиваем в дыру ключи, чья цепочка проходит через неё
+    for (size_t next = (hole + 1) & mask; slots_[next] != EMPTY; next = (next + 1) & mask) {
+        const size_t home = Mix(slots_[next]) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+    }
+    slots_[hole] = EMPTY;
+    --size_;
+    return true;
+}
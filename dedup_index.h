@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+//Множество пар (дата, номер события) для проверки повторов в Database::Add.
+//Одна таблица с открытой адресацией и линейным пробированием: ключ - упакованная дата
+//в старших 32 битах и номер из EventDictionary в младших. Номер однозначно задаёт текст,
+//поэтому совпадение ключа и есть совпадение события. Удаление - сдвигом назад, без надгробий.
+class DedupIndex {
+public:
+    explicit DedupIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    DedupIndex(const DedupIndex& other, std::pmr::memory_resource* resource);
+
+    //true, если пары ещё не было
+    bool Insert(int date, uint32_t id);
+    bool Contains(int date, uint32_t id) const;
+    bool Erase(int date, uint32_t id);
+
+    //номер события id в каждой паре заменяется на map(id); ёмкость таблицы не меняется
+    template <typename F>
+    void Remap(F map) {
+        std::pmr::vector<uint64_t> old(slots_.size(), EMPTY, slots_.get_allocator());
+        old.swap(slots_);
+        size_ = 0;
+        for (uint64_t key : old) {
+            if (key != EMPTY) {
+                Insert(int(uint32_t(key >> 32)), map(uint32_t(key)));
+            }
+        }
+    }
+
+    size_t size() const {return size_;}
+    size_t MemoryUsage() const {return slots_.capacity() * sizeof(uint64_t);}
+
+private:
+    static const uint64_t EMPTY = ~uint64_t(0);//номер UINT32_MAX не выдаётся, такого ключа нет
+
+    static uint64_t Key(int date, uint32_t id) {
+        return (uint64_t(uint32_t(date)) << 32) | id;
+    }
+
+    size_t Slot(uint64_t key) const;
+    void Rehash(size_t capacity);
+
+    std::pmr::vector<uint64_t> slots_;
+    size_t size_ = 0;
+};
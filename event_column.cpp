@@ -0,0 +1,67 @@
+#include "event_column.h"
+
+#include <algorithm>
+
+const size_t EventColumn::FILTERED_EVENTS;
+
+namespace {
+
+//Фильтр блочный: все биты номера лежат в одном 64-битном слове, проверка - одно обращение к памяти.
+//Слово выбирают старшие 32 бита хеша, номера битов в нём - по 6 бит от повторного перемешивания хеша
+inline uint64_t FilterHash(uint32_t id) {
+    uint64_t hash = (static_cast<uint64_t>(id) + 1) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+inline uint64_t FilterMask(uint64_t hash, uint8_t hashes) {
+    uint64_t mask = 0;
+    uint64_t bits = hash * 0xBF58476D1CE4E5B9ULL;
+    for (uint8_t i = 0; i < hashes; ++i, bits >>= 6) {
+        mask |= uint64_t{1} << (bits & 63);
+    }
+    return mask;
+}
+
+}
+
+size_t EventColumn::EraseSelected(const Bitmap& selection) {
+    size_t kept = 0;
+    for (size_t i = 0; i < ids_.size(); ++i) {
+        if (!TestBit(selection, i)) {
+            ids_[kept++] = ids_[i];
+        }
+    }
+    const size_t removed = ids_.size() - kept;
+    ids_.resize(kept);
+    if (removed)
+        filter_stale_ = true;
+    return removed;
+}
+
+bool EventColumn::MayContain(uint32_t id, size_t bits_per_key) const {
+    if (!Filtered(bits_per_key))
+        return true;
+    if (filter_keys_ == 0 || filter_stale_ || filter_bits_ != FilterBits(bits_per_key))
+        RebuildFilter(bits_per_key);
+    const uint64_t hash = FilterHash(id);
+    const uint64_t mask = FilterMask(hash, filter_hashes_);
+    return (filter_[(hash >> 32) % filter_.size()] & mask) == mask;
+}
+
+void EventColumn::FilterAdd(uint32_t id) const {
+    const uint64_t hash = FilterHash(id);
+    filter_[(hash >> 32) % filter_.size()] |= FilterMask(hash, filter_hashes_);
+}
+
+void EventColumn::RebuildFilter(size_t bits_per_key) const {
+    bits_per_key = FilterBits(bits_per_key);
+    filter_keys_ = static_cast<uint32_t>(ids_.size() * 2);
+    filter_bits_ = static_cast<uint8_t>(bits_per_key);
+    //0.69 * бит на ключ - число хешей с наименьшей долей ложных срабатываний; из 64 бит выходит
+    //не больше 10 номеров битов
+    filter_hashes_ = static_cast<uint8_t>(max<size_t>(1, min<size_t>(10, bits_per_key * 69 / 100)));
+    filter_.assign((filter_keys_ * bits_per_key + 63) / 64, 0);
+    filter_stale_ = false;
+    for (uint32_t id : ids_)
+        FilterAdd(id);
+}
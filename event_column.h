@@ -0,0 +1,132 @@
+#pragma once
+#include "bitmap.h"
+#include "event_dictionary.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//События одной даты: подряд идущие номера из словаря базы (EventDictionary).
+//Тексты хранятся только в словаре; сравнение на равенство идёт по номерам (event_match.h).
+//Память под номера берётся у ресурса контейнера-владельца (арена базы, arena.h).
+//У дат с FILTERED_EVENTS и больше событий есть фильтр Блума по номерам (MayContain): поиск
+//события отбрасывает такую дату без просмотра столбца, если фильтр исключает событие.
+class EventColumn {
+public:
+    using allocator_type = pmr::polymorphic_allocator<uint32_t>;
+
+    //меньшие столбцы быстрее просмотреть целиком (event_match.h), чем проверять фильтр
+    static const size_t FILTERED_EVENTS = 64;
+
+    class const_iterator {
+    public:
+        using iterator_category = bidirectional_iterator_tag;
+        using value_type = string;
+        using difference_type = ptrdiff_t;
+        using pointer = const string*;
+        using reference = const string&;
+
+        const_iterator(const EventColumn* column, size_t index) : column_(column), index_(index) {}
+
+        const string& operator*() const {return (*column_)[index_];}
+        const_iterator& operator++() {++index_; return *this;}
+        const_iterator& operator--() {--index_; return *this;}
+        bool operator==(const const_iterator& other) const {return index_ == other.index_;}
+        bool operator!=(const const_iterator& other) const {return index_ != other.index_;}
+
+    private:
+        const EventColumn* column_;
+        size_t index_;
+    };
+
+    explicit EventColumn(const EventDictionary* dictionary = nullptr, const allocator_type& allocator = {})
+            : dictionary_(dictionary), ids_(allocator), filter_(allocator) {}
+    explicit EventColumn(const allocator_type& allocator) : dictionary_(nullptr), ids_(allocator), filter_(allocator) {}
+    EventColumn(const EventColumn& other, const allocator_type& allocator)
+            : dictionary_(other.dictionary_), ids_(other.ids_, allocator), filter_(other.filter_, allocator),
+              filter_keys_(other.filter_keys_), filter_bits_(other.filter_bits_), filter_hashes_(other.filter_hashes_),
+              filter_stale_(other.filter_stale_) {}
+    EventColumn(EventColumn&& other, const allocator_type& allocator)
+            : dictionary_(other.dictionary_), ids_(move(other.ids_), allocator), filter_(move(other.filter_), allocator),
+              filter_keys_(other.filter_keys_), filter_bits_(other.filter_bits_), filter_hashes_(other.filter_hashes_),
+              filter_stale_(other.filter_stale_) {}
+    EventColumn(const EventColumn&) = default;
+    EventColumn(EventColumn&&) = default;
+    EventColumn& operator=(const EventColumn&) = default;
+    EventColumn& operator=(EventColumn&&) = default;
+
+    void push_back(uint32_t id) {
+        ids_.push_back(id);
+        if (filter_keys_ && !filter_stale_) {//фильтр пополняется сразу, пока рассчитан на такой размер
+            if (ids_.size() > filter_keys_)
+                filter_stale_ = true;
+            else
+                FilterAdd(id);
+        }
+    }
+    //push_back для столбца базы: фильтр заводится, как только столбец дорастает до FILTERED_EVENTS,
+    //и перестраивается с запасом, когда столбец его перерастает, - первый поиск не платит за построение
+    void push_back(uint32_t id, size_t bits_per_key) {
+        push_back(id);
+        if (Filtered(bits_per_key) && (filter_stale_ || filter_keys_ == 0 || filter_bits_ != FilterBits(bits_per_key)))
+            RebuildFilter(bits_per_key);
+    }
+    void clear() {
+        ids_.clear();
+        filter_stale_ = true;
+    }
+
+    size_t size() const {return ids_.size();}
+    bool empty() const {return ids_.empty();}
+
+    const string& operator[](size_t i) const {return dictionary_->Get(ids_[i]);}
+    const string& back() const {return dictionary_->Get(ids_.back());}
+
+    const_iterator begin() const {return {this, 0};}
+    const_iterator end() const {return {this, ids_.size()};}
+
+    uint32_t Id(size_t i) const {return ids_[i];}
+    const uint32_t* Ids() const {return ids_.data();}
+    const EventDictionary& Dictionary() const {return *dictionary_;}
+
+    //переводит столбец на словарь dictionary: номер id заменяется на map(id).
+    //Фильтр после этого перестраивается при следующей проверке
+    template <typename F>
+    void Remap(const EventDictionary* dictionary, F map) {
+        dictionary_ = dictionary;
+        for (uint32_t& id : ids_)
+            id = map(id);
+        filter_stale_ = true;
+    }
+
+    //удаляет отмеченные события, сохраняя порядок остальных; возвращает число удалённых.
+    //Фильтр после этого перестраивается при следующей проверке
+    size_t EraseSelected(const Bitmap& selection);
+
+    //проверяется ли столбец фильтром при bits_per_key бит на событие (0 - фильтры выключены)
+    bool Filtered(size_t bits_per_key) const {return bits_per_key && ids_.size() >= FILTERED_EVENTS;}
+    //false - события id в столбце точно нет. Для Filtered столбца фильтр строится при первой
+    //проверке, после удалений и при смене bits_per_key, с запасом на двукратный рост столбца
+    bool MayContain(uint32_t id, size_t bits_per_key) const;
+    size_t FilterMemory() const {return filter_.capacity() * sizeof(uint64_t);}
+
+private:
+    //фильтр строится не больше чем с UINT8_MAX бит на событие; сравнение с построенным - по урезанному значению
+    static size_t FilterBits(size_t bits_per_key) {return min<size_t>(bits_per_key, UINT8_MAX);}
+    void FilterAdd(uint32_t id) const;
+    void RebuildFilter(size_t bits_per_key) const;
+
+    const EventDictionary* dictionary_;
+    pmr::vector<uint32_t> ids_;
+    //фильтр Блума по номерам событий: меняется и при чтении, как кэш результатов базы
+    mutable pmr::vector<uint64_t> filter_;
+    mutable uint32_t filter_keys_ = 0;//на сколько событий рассчитан; 0 - фильтра нет
+    mutable uint8_t filter_bits_ = 0;//бит на событие, с которыми построен
+    mutable uint8_t filter_hashes_ = 0;
+    mutable bool filter_stale_ = false;
+};
@@ -0,0 +1,61 @@
+#include "event_dictionary.h"
+
+const uint32_t EventDictionary::NO_EVENT;
+atomic<uint64_t> EventDictionary::last_serial_{0};
+
+size_t EventDictionary::FindSlot(const string& event, size_t hash) const {
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const uint32_t stored = slots_[slot];
+        if (stored == 0 || (hashes_[stored - 1] == hash && events_[stored - 1] == event)) {
+            return slot;
+        }
+    }
+}
+
+void EventDictionary::Rehash(size_t capacity) {
+    slots_.assign(capacity, 0);
+    const size_t mask = capacity - 1;
+    for (uint32_t id = 0; id < events_.size(); ++id) {
+        size_t slot = hashes_[id] & mask;
+        while (slots_[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots_[slot] = id + 1;
+    }
+}
+
+uint32_t EventDictionary::Intern(const string& event) {
+    if ((events_.size() + 1) * 2 > slots_.size()) {
+        Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+    }
+    const size_t hash = std::hash<string>()(event);
+    const size_t slot = FindSlot(event, hash);
+    if (slots_[slot] != 0) {
+        return slots_[slot] - 1;
+    }
+    const uint32_t id = static_cast<uint32_t>(events_.size());
+    events_.push_back(event);
+    hashes_.push_back(hash);
+    slots_[slot] = id + 1;
+    return id;
+}
+
+uint32_t EventDictionary::Find(const string& event) const {
+    if (slots_.empty()) {
+        return NO_EVENT;
+    }
+    const uint32_t stored = slots_[FindSlot(event, std::hash<string>()(event))];
+    return stored == 0 ? NO_EVENT : stored - 1;
+}
+
+size_t EventDictionary::MemoryUsage() const {
+    size_t bytes = events_.capacity() * sizeof(string) + hashes_.capacity() * sizeof(size_t) +
+                   slots_.capacity() * sizeof(uint32_t);
+    for (const string& event : events_) {
+        if (event.capacity() > 15) {//короче - внутри самого string
+            bytes += event.capacity() + 1;
+        }
+    }
+    return bytes;
+}
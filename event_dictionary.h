@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Словарь различных текстов событий базы: каждому тексту - 32-битный номер.
+//Номера не переиспользуются, поэтому найденный номер остаётся верным всё время жизни словаря.
+//Тексты удалённых событий сам словарь не освобождает: база заменяет его уплотнённым
+//(Database::CompactDictionary), когда большинство номеров больше не встречается в данных.
+class EventDictionary {
+public:
+    static const uint32_t NO_EVENT = UINT32_MAX;
+
+    EventDictionary() : serial_(++last_serial_) {}
+    EventDictionary(const EventDictionary&) = delete;
+    EventDictionary& operator=(const EventDictionary&) = delete;
+
+    //номер события, при необходимости добавляет его в словарь
+    uint32_t Intern(const string& event);
+    //номер события или NO_EVENT, если такого текста нет
+    uint32_t Find(const string& event) const;
+
+    const string& Get(uint32_t id) const {return events_[id];}
+    size_t size() const {return events_.size();}
+
+    size_t MemoryUsage() const;
+    //номер словаря, не повторяющийся в процессе: новый словарь отличается от прежнего,
+    //даже если занял его адрес
+    uint64_t Serial() const {return serial_;}
+
+private:
+    size_t FindSlot(const string& event, size_t hash) const;
+    void Rehash(size_t capacity);
+
+    vector<string> events_;
+    vector<size_t> hashes_;
+    vector<uint32_t> slots_;//открытая адресация: номер + 1, 0 - пустая ячейка
+    uint64_t serial_;
+
+    static atomic<uint64_t> last_serial_;
+};
+
+//Номер текста события, запомненный для конкретного словаря. Пока текста в словаре нет,
+//поиск повторяется только после появления в словаре новых событий.
+class EventIdCache {
+public:
+    uint32_t Resolve(const EventDictionary& dictionary, const string& event) const {
+        if (serial_ != dictionary.Serial() || (id_ == EventDictionary::NO_EVENT && size_ != dictionary.size())) {
+            serial_ = dictionary.Serial();
+            size_ = dictionary.size();
+            id_ = dictionary.Find(event);
+        }
+        return id_;
+    }
+
+private:
+    mutable uint64_t serial_ = 0;//словари нумеруются с 1
+    mutable size_t size_ = 0;
+    mutable uint32_t id_ = EventDictionary::NO_EVENT;
+};
@@ -0,0 +1,79 @@
+#include "event_match.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void MatchScalar(const uint32_t* ids, size_t begin, size_t count, uint32_t id, Bitmap& selection) {
+    uint64_t word = 0;
+    for (size_t i = begin; i < count; ++i) {
+        word |= uint64_t(ids[i] == id) << (i % 64);
+        if (i % 64 == 63 || i + 1 == count) {
+            selection[i / 64] |= word;
+            word = 0;
+        }
+    }
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+void MatchSse2(const uint32_t* ids, size_t count, uint32_t id, Bitmap& selection) {
+    const __m128i needle = _mm_set1_epi32(static_cast<int>(id));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i));
+        const uint64_t mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, needle))));
+        selection[i / 64] |= mask << (i % 64);
+    }
+    MatchScalar(ids, i, count, id, selection);
+}
+
+SIMD_TARGET("avx2")
+void MatchAvx2(const uint32_t* ids, size_t count, uint32_t id, Bitmap& selection) {
+    const __m256i needle = _mm256_set1_epi32(static_cast<int>(id));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+        const uint64_t mask = static_cast<unsigned>(
+                _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, needle))));
+        selection[i / 64] |= mask << (i % 64);
+    }
+    MatchScalar(ids, i, count, id, selection);
+}
+
+#endif
+
+void Run(SimdLevel level, const EventColumn& column, uint32_t id, Bitmap& selection) {
+    if (id == EventDictionary::NO_EVENT) {
+        return;//такого события в базе нет
+    }
+    switch (level) {
+#ifdef SIMD_X86
+        case SimdLevel::Avx2:
+            MatchAvx2(column.Ids(), column.size(), id, selection);
+            return;
+        case SimdLevel::Sse2:
+            MatchSse2(column.Ids(), column.size(), id, selection);
+            return;
+#endif
+        default:
+            MatchScalar(column.Ids(), 0, column.size(), id, selection);
+    }
+}
+
+}
+
+void MatchEventEqual(const EventColumn& column, uint32_t id, Bitmap& selection) {
+    Run(ActiveSimdLevel(), column, id, selection);
+}
+
+bool MatchEventEqualWith(SimdLevel level, const EventColumn& column, uint32_t id, Bitmap& selection) {
+    if (!SimdLevelSupported(level)) {
+        return false;
+    }
+    Run(level, column, id, selection);
+    return true;
+}
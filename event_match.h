@@ -0,0 +1,12 @@
+#pragma once
+#include "event_column.h"
+#include "simd_dispatch.h"
+
+//Векторное сравнение номеров событий даты с номером образца (EventDictionary):
+//AVX2 - восемь событий за инструкцию, SSE2 - четыре.
+
+//устанавливает (через OR) в selection биты событий с номером id; selection должен иметь размер column.size()
+void MatchEventEqual(const EventColumn& column, uint32_t id, Bitmap& selection);
+
+//для тестов и замеров: вызов конкретной реализации, если она поддерживается процессором
+bool MatchEventEqualWith(SimdLevel level, const EventColumn& column, uint32_t id, Bitmap& selection);
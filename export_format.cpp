@@ -0,0 +1,176 @@
+#include "export_format.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+const char MAGIC[4] = {'D', 'B', 'E', 'X'};
+const uint32_t VERSION = 1;
+const uint32_t MAX_CHUNK_BYTES = 1u << 30;//защита от выделения памяти по испорченному счётчику
+
+array<uint32_t, 256> MakeCrcTable() {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+template <typename T>
+void Write(ostream& output, const T* data, size_t count) {
+    output.write(reinterpret_cast<const char*>(data), static_cast<streamsize>(count * sizeof(T)));
+}
+
+template <typename T>
+void Read(istream& input, T* data, size_t count) {
+    if (!input.read(reinterpret_cast<char*>(data), static_cast<streamsize>(count * sizeof(T)))) {
+        throw runtime_error("Import: unexpected end of file");
+    }
+}
+
+}
+
+uint32_t Crc32(const void* data, size_t size, uint32_t crc) {
+    static const array<uint32_t, 256> table = MakeCrcTable();
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+const size_t ExportWriter::CHUNK_SIZE;
+
+ExportWriter::ExportWriter(ostream& output, size_t chunk_size) : output_(output), chunk_size_(max<size_t>(chunk_size, 1)) {
+    output_.write(MAGIC, sizeof(MAGIC));
+    Write(output_, &VERSION, 1);
+    dates_.reserve(chunk_size_);
+    lengths_.reserve(chunk_size_);
+}
+
+void ExportWriter::Append(int date, const string& event) {
+    dates_.push_back(date);
+    lengths_.push_back(static_cast<uint32_t>(event.size()));
+    texts_ += event;
+    if (dates_.size() == chunk_size_) {
+        Flush();
+    }
+}
+
+void ExportWriter::Finish() {
+    if (!dates_.empty()) {
+        Flush();
+    }
+    Flush();//пустой блок - конец данных
+    output_.flush();
+    if (!output_) {
+        throw runtime_error("Export: write failed");
+    }
+}
+
+void ExportWriter::Flush() {
+    const uint32_t count = static_cast<uint32_t>(dates_.size());
+    uint32_t crc = Crc32(&count, sizeof(count));
+    crc = Crc32(dates_.data(), dates_.size() * sizeof(int), crc);
+    crc = Crc32(lengths_.data(), lengths_.size() * sizeof(uint32_t), crc);
+    crc = Crc32(texts_.data(), texts_.size(), crc);
+    Write(output_, &count, 1);
+    Write(output_, dates_.data(), dates_.size());
+    Write(output_, lengths_.data(), lengths_.size());
+    output_.write(texts_.data(), static_cast<streamsize>(texts_.size()));
+    Write(output_, &crc, 1);
+    written_ += count;
+    dates_.clear();
+    lengths_.clear();
+    texts_.clear();
+}
+
+ExportReader::ExportReader(istream& input) : input_(input) {
+    char magic[sizeof(MAGIC)];
+    uint32_t version = 0;
+    if (!input_.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), MAGIC)) {
+        throw runtime_error("Import: not an export file");
+    }
+    Read(input_, &version, 1);
+    if (version != VERSION) {
+        throw runtime_error("Import: unsupported version " + to_string(version));
+    }
+    const streampos current = input_.tellg();
+    if (current != streampos(-1) && input_.seekg(0, ios::end)) {
+        end_ = input_.tellg();
+        input_.seekg(current);
+    }
+    input_.clear();
+}
+
+size_t ExportReader::Remaining() {
+    if (end_ == streampos(-1)) {
+        return MAX_CHUNK_BYTES;
+    }
+    const streampos current = input_.tellg();
+    if (current == streampos(-1) || current > end_) {
+        return MAX_CHUNK_BYTES;
+    }
+    return min<size_t>(MAX_CHUNK_BYTES, static_cast<size_t>(end_ - current));
+}
+
+void ExportReader::Seek(streamoff offset) {
+    input_.clear();
+    input_.seekg(offset);
+    finished_ = false;
+}
+
+bool ExportReader::NextChunk(vector<int>& dates, vector<string>& events) {
+    if (finished_) {
+        return false;
+    }
+    uint32_t count = 0;
+    Read(input_, &count, 1);
+    //счётчик ещё не проверен суммой: блок не может быть длиннее остатка потока
+    const size_t remaining = Remaining();
+    if (count > remaining / (sizeof(int) + sizeof(uint32_t))) {
+        throw runtime_error("Import: corrupted chunk header");
+    }
+    vector<uint32_t> lengths(count);
+    dates.resize(count);
+    Read(input_, dates.data(), count);
+    Read(input_, lengths.data(), count);
+    size_t total = 0;
+    for (uint32_t length : lengths) {
+        total += length;
+    }
+    if (total > remaining - count * (sizeof(int) + sizeof(uint32_t))) {
+        throw runtime_error("Import: corrupted chunk lengths");
+    }
+    string texts(total, '\0');
+    Read(input_, &texts[0], total);
+    uint32_t stored = 0;
+    Read(input_, &stored, 1);
+
+    uint32_t crc = Crc32(&count, sizeof(count));
+    crc = Crc32(dates.data(), count * sizeof(int), crc);
+    crc = Crc32(lengths.data(), count * sizeof(uint32_t), crc);
+    crc = Crc32(texts.data(), texts.size(), crc);
+    if (crc != stored) {
+        throw runtime_error("Import: checksum mismatch");
+    }
+
+    events.resize(count);
+    size_t offset = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        events[i].assign(texts, offset, lengths[i]);
+        offset += lengths[i];
+    }
+    if (count == 0) {
+        finished_ = true;
+        return false;
+    }
+    return true;
+}
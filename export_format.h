@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Двоичный формат Export/Import. Файл - заголовок "DBEX" и номер версии, затем блоки до CHUNK_SIZE
+//событий, последний блок пустой. Блок хранит данные по столбцам:
+//    uint32 count | int32 date[count] | uint32 length[count] | байты событий подряд | uint32 crc32
+//Даты упакованы (Date::GetPacked), числа записаны в порядке байт машины (little-endian на x86).
+//Контрольная сумма считается по всему блоку до неё. Ни запись, ни чтение не держат в памяти
+//больше одного блока.
+class ExportWriter {
+public:
+    static const size_t CHUNK_SIZE = 4096;
+
+    //chunk_size - событий в блоке; меньшие блоки нужны для поиска по смещениям блоков (lsm_run.h)
+    explicit ExportWriter(ostream& output, size_t chunk_size = CHUNK_SIZE);
+
+    void Append(int date, const string& event);
+    //дописывает неполный блок и завершающий пустой
+    void Finish();
+
+    size_t size() const {return written_;}
+
+private:
+    void Flush();
+
+    ostream& output_;
+    size_t chunk_size_;
+    vector<int> dates_;
+    vector<uint32_t> lengths_;
+    string texts_;
+    size_t written_ = 0;
+};
+
+class ExportReader {
+public:
+    //проверяет заголовок; runtime_error, если это не файл Export
+    explicit ExportReader(istream& input);
+
+    //следующий блок; false после завершающего. runtime_error при обрыве файла или неверной сумме
+    bool NextChunk(vector<int>& dates, vector<string>& events);
+    //следующим будет прочитан блок, начинающийся со смещения offset от начала файла
+    void Seek(streamoff offset);
+
+private:
+    //байт до конца потока, не больше MAX_CHUNK_BYTES; для потоков без позиционирования - MAX_CHUNK_BYTES
+    size_t Remaining();
+
+    istream& input_;
+    streampos end_ = streampos(-1);
+    bool finished_ = false;
+};
+
+uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0);
@@ -0,0 +1,112 @@
+#include "last_index.h"
+
+#include <algorithm>
+
+const size_t LastIndex::NOT_FOUND;
+
+LastIndex::LastIndex(std::pmr::memory_resource* resource) : dates_(resource), events_(resource) {}
+
+LastIndex::LastIndex(const LastIndex& other, std::pmr::memory_resource* resource)
+        : dates_(other.dates_, resource), events_(other.events_, resource) {}
+
+void LastIndex::Set(int date, uint32_t id) {
+    if (dates_.empty() || date > dates_.back()) {
+        dates_.push_back(date);
+        events_.push_back(id);
+        return;
+    }
+    const size_t index = std::lower_bound(dates_.begin(), dates_.end(), date) - dates_.begin();
+    if (dates_[index] == date) {
+        events_[index] = id;
+        return;
+    }
+    dates_.insert(dates_.begin() + index, date);
+    events_.insert(events_.begin() + index, id);
+}
+
+void LastIndex::SetSorted(const std::vector<std::pair<int, uint32_t>>& updates) {
+    size_t added = 0;
+    size_t index = 0;
+    for (const auto& update : updates) {//имеющиеся даты обновляются на месте
+        index = std::lower_bound(dates_.begin() + index, dates_.end(), update.first) - dates_.begin();
+        if (index < dates_.size() && dates_[index] == update.first) {
+            events_[index] = update.second;
+        } else {
+            ++added;
+        }
+    }
+    if (added == 0) {
+        return;
+    }
+    size_t read = dates_.size();
+    size_t write = read + added;
+    dates_.resize(write);
+    events_.resize(write);
+    for (size_t u = updates.size(); u > 0;) {
+        const auto& update = updates[u - 1];
+        if (read > 0 && dates_[read - 1] > update.first) {
+            --read;
+            --write;
+            dates_[write] = dates_[read];
+            events_[write] = events_[read];
+        } else {
+            if (read == 0 || dates_[read - 1] != update.first) {//уже обновлённые даты остаются на месте
+                --write;
+                dates_[write] = update.first;
+                events_[write] = update.second;
+            }
+            --u;
+        }
+    }
+}
+
+bool LastIndex::FindLastNotAfter(int date, int& found_date, uint32_t& id) const {
+    size_t count = dates_.size();
+    if (count == 0 || date < dates_[0]) {
+        return false;
+    }
+    //base[0] <= date на каждом шаге; сравнение превращается в cmov, а не в переход
+    const int* base = dates_.data();
+    while (count > 1) {
+        const size_t half = count / 2;
+        base = base[half] <= date ? base + half : base;
+        count -= half;
+    }
+    const size_t index = base - dates_.data();
+    found_date = dates_[index];
+    id = events_[index];
+    return true;
+}
+
+void LastIndex::FindLastNotAfterSorted(const std::vector<int>& queries, std::vector<size_t>& positions) const {
+    positions.assign(queries.size(), NOT_FOUND);
+    //next - первая дата больше предыдущего запроса; двигается только вперёд
+    size_t next = 0;
+    for (size_t q = 0; q < queries.size(); ++q) {
+        const int date = queries[q];
+        //галоп: шаг удваивается, пока даты не превысят запрос, затем двоичный поиск в последнем шаге;
+        //для близких запросов это несколько сравнений, для далёких - логарифм от расстояния
+        size_t step = 1;
+        size_t low = next;
+        while (low + step <= dates_.size() && dates_[low + step - 1] <= date) {
+            low += step;
+            step *= 2;
+        }
+        const size_t high = std::min(low + step, dates_.size());
+        next = std::upper_bound(dates_.begin() + low, dates_.begin() + high, date) - dates_.begin();
+        if (next > 0) {
+            positions[q] = next - 1;
+        }
+    }
+}
+
+void LastIndex::Rebuild(const DateDirectory& directory) {
+    dates_.clear();
+    events_.clear();
+    for (const DateDirectory::Block& block : directory.Blocks()) {
+        for (size_t i = 0; i < block.dates.size(); ++i) {
+            dates_.push_back(block.dates[i]);
+            events_.push_back(block.columns[i].Id(block.columns[i].size() - 1));
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "date_directory.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+//Последнее добавленное событие каждой даты для Database::Last: упакованные даты по возрастанию
+//и номера событий из EventDictionary в двух параллельных массивах. Поиск - двоичный без ветвлений
+//только по массиву дат; при датах, приходящих по возрастанию, Set дописывает в конец.
+class LastIndex {
+public:
+    static const size_t NOT_FOUND = SIZE_MAX;
+
+    explicit LastIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    LastIndex(const LastIndex& other, std::pmr::memory_resource* resource);
+
+    //id - последнее событие даты date
+    void Set(int date, uint32_t id);
+    //Set для многих дат: updates упорядочены по дате без повторов. Новые даты вливаются
+    //одним проходом с конца, так что каждая запись сдвигается не больше одного раза
+    void SetSorted(const std::vector<std::pair<int, uint32_t>>& updates);
+    //последняя дата не позже date и её последнее событие; false, если таких дат нет
+    bool FindLastNotAfter(int date, int& found_date, uint32_t& id) const;
+    //то же для многих дат сразу: queries упорядочены по возрастанию, в positions - номер
+    //записи (см. DateAt/EventAt) или NOT_FOUND. Один проход слиянием с галопом по массиву дат
+    void FindLastNotAfterSorted(const std::vector<int>& queries, std::vector<size_t>& positions) const;
+
+    int DateAt(size_t position) const {return dates_[position];}
+    uint32_t EventAt(size_t position) const {return events_[position];}
+
+    //пересчёт по каталогу после удалений
+    void Rebuild(const DateDirectory& directory);
+
+    size_t size() const {return dates_.size();}
+
+private:
+    std::pmr::vector<int> dates_;
+    std::pmr::vector<uint32_t> events_;
+};
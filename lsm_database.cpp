@@ -0,0 +1,343 @@
+#include "lsm_database.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <filesystem>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+
+string MakeDirectory(const string& parent) {
+    static atomic<size_t> counter{0};
+    const filesystem::path base = parent.empty() ? filesystem::temp_directory_path() / "db_lsm" : filesystem::path(parent);
+    const filesystem::path directory = base / (to_string(chrono::steady_clock::now().time_since_epoch().count())
+                                               + "_" + to_string(counter++));
+    filesystem::create_directories(directory);
+    return directory.string();
+}
+
+string FormatEntry(int date, const string& event) {
+    return UnpackDate(date).ToString() + " " + event;
+}
+
+}
+
+LsmDatabase::LsmDatabase(const LsmOptions& options)
+        : options_(options), directory_(MakeDirectory(options.directory)) {
+    options_.memtable_events = max<size_t>(options_.memtable_events, 1);
+    options_.fanout = max<size_t>(options_.fanout, 2);
+    compactor_ = thread([this] {Compact();});
+}
+
+LsmDatabase::~LsmDatabase() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_all();
+    compactor_.join();
+    runs_.clear();//прогоны удаляют свои файлы
+    error_code ignored;
+    filesystem::remove_all(directory_, ignored);
+}
+
+LsmDatabase::Snapshot LsmDatabase::TakeSnapshot() const {
+    lock_guard<mutex> lock(mutex_);
+    return {runs_, tombstones_};
+}
+
+bool LsmDatabase::Dead(const Snapshot& snapshot, const SortedRun& run, int date, const string& event) {
+    for (const auto& tombstone : snapshot.tombstones) {
+        if (tombstone->sequence > run.Sequence() && date >= tombstone->first && date <= tombstone->last
+                && tombstone->condition(UnpackDate(date), event)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LsmDatabase::MayMatch(const SortedRun& run, const ConditionShape& shape, pair<int, int> range) {
+    if (range.first > range.second || range.second < run.MinDate() || range.first > run.MaxDate()) {
+        return false;
+    }
+    switch (shape.type) {
+        case ConditionShapeType::EventEqual:
+        case ConditionShapeType::DateRangeAndEvent:
+        case ConditionShapeType::EventOneOf:
+            return any_of(shape.events.begin(), shape.events.end(), [&run](const string& event) {
+                return run.MayContainEvent(event);
+            });
+        default:
+            return true;
+    }
+}
+
+string LsmDatabase::NewRunPath() {
+    return (filesystem::path(directory_) / ("run_" + to_string(++files_) + ".bin")).string();
+}
+
+void LsmDatabase::Add(const Date& date, const string& event) {
+    if (!memtable_.IsHere(date, event)) {//уже есть в memtable
+        return;
+    }
+    const int packed = date.GetPacked();
+    const Snapshot snapshot = TakeSnapshot();
+    for (auto it = snapshot.runs.rbegin(); it != snapshot.runs.rend(); ++it) {
+        const SortedRun& run = **it;
+        if (packed < run.MinDate() || packed > run.MaxDate() || !run.MayContainEntry(packed, event)) {
+            continue;
+        }
+        bool live = false;
+        run.ForEach(packed, packed, [&](int, const string& stored) {
+            live |= stored == event && !Dead(snapshot, run, packed, stored);
+        });
+        if (live) {
+            return;
+        }
+    }
+    memtable_.Add(date, event);
+    if (++memtable_size_ >= options_.memtable_events) {
+        Flush();
+    }
+}
+
+vector<string> LsmDatabase::FindIf(const shared_ptr<Node>& condition) const {
+    const ConditionShape shape = AnalyzeCondition(condition);
+    const pair<int, int> range = ConditionDateRange(condition);
+    return DispatchCondition(condition, [&](auto predicate) {
+        vector<string> res;
+        for (const auto& [date, event] : Collect(shape, range, predicate)) {
+            res.push_back(FormatEntry(date, event));
+        }
+        return res;
+    });
+}
+
+int LsmDatabase::RemoveIf(const shared_ptr<Node>& condition) {
+    const ConditionShape shape = AnalyzeCondition(condition);
+    const pair<int, int> range = ConditionDateRange(condition);
+    return DispatchCondition(condition, [&](auto predicate) {
+        //события прогонов только считаются: их скрывает надгробие, а выбрасывает слияние
+        size_t on_disk = 0;
+        ScanRuns(TakeSnapshot(), shape, range, predicate, [&on_disk](int, const string&) {
+            ++on_disk;
+        });
+        const int count = memtable_.RemoveIf(predicate);
+        if (on_disk > 0) {
+            auto tombstone = make_shared<const Tombstone>(Tombstone{++sequence_, range.first, range.second, predicate});
+            lock_guard<mutex> lock(mutex_);
+            tombstones_.push_back(move(tombstone));
+        }
+        return count + static_cast<int>(on_disk);
+    });
+}
+
+string LsmDatabase::Last(const Date& date) const {
+    const int packed = date.GetPacked();
+    const Snapshot snapshot = TakeSnapshot();
+    int best_date = INT_MIN;
+    string best_event;
+    bool found = false;
+    for (const auto& run : snapshot.runs) {//у более нового прогона при равной дате событие позже
+        if (run->MinDate() > packed || (found && run->MaxDate() < best_date)) {
+            continue;
+        }
+        run->ForEachReverse(found ? best_date : INT_MIN, packed, [&](int stored, const string& event) {
+            if (Dead(snapshot, *run, stored, event)) {
+                return true;
+            }
+            best_date = stored;
+            best_event = event;
+            found = true;
+            return false;
+        });
+    }
+    const auto memory = memtable_.LastEntry(date);
+    if (memory && (!found || memory->date.GetPacked() >= best_date)) {
+        return memory->date.ToString() + " " + string(memory->event);
+    }
+    if (!found) {
+        return "No entries";
+    }
+    return FormatEntry(best_date, best_event);
+}
+
+string LsmDatabase::ToStringDB() const {
+    auto all = [](const Date&, const string&) {return true;};
+    string result;
+    for (const auto& [date, event] : Collect(ConditionShape{}, {INT_MIN, INT_MAX}, all)) {
+        result += FormatEntry(date, event) + "\n";
+    }
+    return result;
+}
+
+void LsmDatabase::Print(ostream& output) const {
+    output << ToStringDB();
+}
+
+void LsmDatabase::Flush() {
+    if (memtable_size_ == 0) {
+        return;
+    }
+    string path;
+    {
+        lock_guard<mutex> lock(mutex_);
+        path = NewRunPath();
+    }
+    SortedRun::Builder builder(path, ++sequence_, memtable_size_);
+    auto all = [](const Date&, const string&) {return true;};
+    memtable_.ForEachIf(all, [&builder](int date, const string& event) {
+        builder.Append(date, event);
+    });
+    auto run = builder.Finish();
+    memtable_.Clear();
+    memtable_size_ = 0;
+    {
+        lock_guard<mutex> lock(mutex_);
+        ++flushes_;
+        if (run) {
+            runs_.push_back(move(run));
+        }
+    }
+    work_.notify_one();
+}
+
+void LsmDatabase::WaitForCompaction() const {
+    unique_lock<mutex> lock(mutex_);
+    idle_.wait(lock, [this] {return !compacting_ && PickCompaction().empty();});
+}
+
+size_t LsmDatabase::Level(size_t events) const {
+    size_t level = 0;
+    for (size_t capacity = options_.memtable_events; events > capacity; capacity *= options_.fanout) {
+        ++level;
+    }
+    return level;
+}
+
+vector<shared_ptr<const SortedRun>> LsmDatabase::PickCompaction() const {
+    if (runs_.empty() || !compaction_error_.empty()) {
+        return {};
+    }
+    const size_t level = Level(runs_.back()->size());
+    size_t first = runs_.size() - 1;
+    while (first > 0 && Level(runs_[first - 1]->size()) == level) {
+        --first;
+    }
+    if (runs_.size() - first < options_.fanout) {
+        return {};
+    }
+    return {runs_.begin() + first, runs_.end()};
+}
+
+void LsmDatabase::Compact() {
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        work_.wait(lock, [this] {return stop_ || !PickCompaction().empty();});
+        if (stop_) {
+            return;
+        }
+        const vector<shared_ptr<const SortedRun>> inputs = PickCompaction();
+        const Snapshot snapshot{runs_, tombstones_};
+        const string path = NewRunPath();
+        compacting_ = true;
+        lock.unlock();
+
+        shared_ptr<const SortedRun> output;
+        size_t dropped = 0;
+        string error;
+        try {
+            //слияние по (дата, номер прогона): внутри даты события старых прогонов идут раньше
+            size_t expected = 0;
+            vector<SortedRun::Cursor> cursors;
+            cursors.reserve(inputs.size());
+            for (const auto& run : inputs) {
+                expected += run->size();
+                cursors.emplace_back(*run);
+            }
+            vector<pair<int, string>> heads(inputs.size());
+            priority_queue<pair<int, size_t>, vector<pair<int, size_t>>, greater<>> queue;
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                if (cursors[i].Next(heads[i].first, heads[i].second)) {
+                    queue.emplace(heads[i].first, i);
+                }
+            }
+            SortedRun::Builder builder(path, inputs.back()->Sequence(), expected);
+            while (!queue.empty()) {
+                const size_t i = queue.top().second;
+                queue.pop();
+                if (Dead(snapshot, *inputs[i], heads[i].first, heads[i].second)) {
+                    ++dropped;
+                } else {
+                    builder.Append(heads[i].first, heads[i].second);
+                }
+                if (cursors[i].Next(heads[i].first, heads[i].second)) {
+                    queue.emplace(heads[i].first, i);
+                }
+            }
+            output = builder.Finish();
+        } catch (const exception& e) {
+            error = e.what();
+        }
+
+        lock.lock();
+        compacting_ = false;
+        if (!error.empty()) {
+            compaction_error_ = error;
+            idle_.notify_all();
+            continue;
+        }
+        //входы идут подряд: новые прогоны за это время только дописывались в конец
+        const auto first = find(runs_.begin(), runs_.end(), inputs.front());
+        const auto position = runs_.erase(first, first + static_cast<ptrdiff_t>(inputs.size()));
+        if (output) {
+            runs_.insert(position, move(output));
+        }
+        //надгробие нужно, пока есть прогон старше него
+        if (runs_.empty()) {
+            tombstones_.clear();
+        } else {
+            uint64_t oldest = runs_.front()->Sequence();
+            for (const auto& run : runs_) {
+                oldest = min(oldest, run->Sequence());
+            }
+            tombstones_.erase(remove_if(tombstones_.begin(), tombstones_.end(), [oldest](const auto& tombstone) {
+                return tombstone->sequence <= oldest;
+            }), tombstones_.end());
+        }
+        ++compactions_;
+        dropped_by_tombstones_ += dropped;
+        idle_.notify_all();
+    }
+}
+
+void LsmDatabase::PrintStats(ostream& output) const {
+    const Snapshot snapshot = TakeSnapshot();
+    size_t on_disk = 0, memory = 0, chunks = 0;
+    vector<size_t> levels;
+    for (const auto& run : snapshot.runs) {
+        on_disk += run->size();
+        memory += run->MemoryUsage();
+        chunks += run->ChunksRead();
+        const size_t level = Level(run->size());
+        levels.resize(max(levels.size(), level + 1));
+        ++levels[level];
+    }
+    output << "lsm: memtable events " << memtable_size_ << " of " << options_.memtable_events
+           << ", runs " << snapshot.runs.size() << ", events in runs " << on_disk
+           << ", tombstones " << snapshot.tombstones.size() << "\n";
+    output << "lsm levels:";
+    for (size_t level = 0; level < levels.size(); ++level) {
+        output << " L" << level << "=" << levels[level];
+    }
+    lock_guard<mutex> lock(mutex_);
+    output << "\nlsm: flushes " << flushes_ << ", compactions " << compactions_
+           << ", dropped by tombstones " << dropped_by_tombstones_
+           << ", runs skipped " << runs_skipped_ << ", runs scanned " << runs_scanned_
+           << ", chunks read " << chunks << ", filter and fence memory " << memory << " bytes\n";
+    if (!compaction_error_.empty()) {
+        output << "lsm compaction stopped: " << compaction_error_ << "\n";
+    }
+}
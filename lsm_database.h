@@ -0,0 +1,132 @@
+#pragma once
+#include "database.h"
+#include "lsm_run.h"
+#include "predicates.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+struct LsmOptions {
+    size_t memtable_events = 65536;//событий в памяти до сброса в прогон
+    size_t fanout = 4;//столько прогонов одного уровня сливаются в один прогон следующего
+    string directory;//где заводится каталог прогонов базы; пусто - временный каталог системы
+};
+
+//База в виде LSM-дерева для счетов с потоком Add и редкими большими Del.
+//Новые события попадают в memtable - обычную Database в памяти; заполненная memtable
+//сбрасывается в неизменяемый прогон на диске (lsm_run.h). Фоновый поток сливает прогоны
+//по уровням: как только fanout самых новых прогонов оказываются одного уровня
+//(уровень k - до memtable_events * fanout^k событий), они заменяются одним.
+//Del удаляет подходящие события из memtable сразу, а для прогонов записывает надгробие -
+//условие с диапазоном дат и порядковым номером; надгробие скрывает события прогонов старше
+//себя и выбрасывается, когда таких прогонов не остаётся. Чтения пропускают прогоны по
+//границам дат и по фильтру Блума событий, если условие называет события явно.
+//Порядок вывода тот же, что у Database: по датам, внутри даты - в порядке добавления.
+class LsmDatabase {
+public:
+    explicit LsmDatabase(const LsmOptions& options = {});
+    //останавливает слияние и удаляет файлы прогонов
+    ~LsmDatabase();
+
+    LsmDatabase(const LsmDatabase&) = delete;
+    LsmDatabase& operator=(const LsmDatabase&) = delete;
+
+    void Add(const Date& date, const string& event);
+    vector<string> FindIf(const shared_ptr<Node>& condition) const;
+    int RemoveIf(const shared_ptr<Node>& condition);
+    string Last(const Date& date) const;
+
+    string ToStringDB() const;
+    void Print(ostream& output) const;
+
+    //сбрасывает memtable в новый прогон
+    void Flush();
+    //ждёт, пока фоновому слиянию не останется работы
+    void WaitForCompaction() const;
+
+    void PrintStats(ostream& output) const;
+
+private:
+    struct Tombstone {
+        uint64_t sequence;
+        int first;
+        int last;
+        function<bool(const Date&, const string&)> condition;
+    };
+
+    //прогоны от старых к новым и надгробия на один момент: слияние не меняет их у читателя
+    struct Snapshot {
+        vector<shared_ptr<const SortedRun>> runs;
+        vector<shared_ptr<const Tombstone>> tombstones;
+    };
+
+    Snapshot TakeSnapshot() const;
+    static bool Dead(const Snapshot& snapshot, const SortedRun& run, int date, const string& event);
+    static bool MayMatch(const SortedRun& run, const ConditionShape& shape, pair<int, int> range);
+    //имя файла нового прогона; вызывается под mutex_
+    string NewRunPath();
+
+    //f(date, event) для живых подходящих событий прогонов, от старых прогонов к новым;
+    //shape и range отсекают прогоны, где нужных событий нет
+    template <typename T, typename F>
+    void ScanRuns(const Snapshot& snapshot, const ConditionShape& shape, pair<int, int> range, T& predicate, F f) const {
+        for (const auto& run : snapshot.runs) {
+            if (!MayMatch(*run, shape, range)) {
+                ++runs_skipped_;
+                continue;
+            }
+            ++runs_scanned_;
+            run->ForEach(range.first, range.second, [&](int date, const string& event) {
+                if (predicate(UnpackDate(date), event) && !Dead(snapshot, *run, date, event)) {
+                    f(date, event);
+                }
+            });
+        }
+    }
+
+    //подходящие события в порядке вывода: по датам, внутри даты - от старых прогонов к новым, затем memtable
+    template <typename T>
+    vector<pair<int, string>> Collect(const ConditionShape& shape, pair<int, int> range, T& predicate) const {
+        vector<pair<int, string>> found;
+        auto add = [&found](int date, const string& event) {
+            found.emplace_back(date, event);
+        };
+        ScanRuns(TakeSnapshot(), shape, range, predicate, add);
+        memtable_.ForEachIf(predicate, add);
+        stable_sort(found.begin(), found.end(), [](const pair<int, string>& lhs, const pair<int, string>& rhs) {
+            return lhs.first < rhs.first;
+        });
+        return found;
+    }
+
+    size_t Level(size_t events) const;
+    //самые новые прогоны одного уровня, если их набралось fanout; вызывается под mutex_
+    vector<shared_ptr<const SortedRun>> PickCompaction() const;
+    void Compact();
+
+    LsmOptions options_;
+    string directory_;
+    Database memtable_;
+    size_t memtable_size_ = 0;//принятые Add после последнего сброса
+    uint64_t sequence_ = 0;//номера прогонов и надгробий; меняется только в потоке базы
+
+    mutable mutex mutex_;//runs_, tombstones_ и состояние слияния
+    mutable condition_variable work_;
+    mutable condition_variable idle_;
+    vector<shared_ptr<const SortedRun>> runs_;
+    vector<shared_ptr<const Tombstone>> tombstones_;
+    size_t files_ = 0;
+    bool compacting_ = false;
+    bool stop_ = false;
+    string compaction_error_;//после ошибки записи слияние больше не запускается
+    size_t flushes_ = 0;
+    size_t compactions_ = 0;
+    size_t dropped_by_tombstones_ = 0;
+    mutable size_t runs_skipped_ = 0;
+    mutable size_t runs_scanned_ = 0;
+    thread compactor_;
+};
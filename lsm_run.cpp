@@ -0,0 +1,69 @@
+#include "lsm_run.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+const size_t SortedRun::CHUNK_EVENTS;
+
+SortedRun::SortedRun(const string& path, uint64_t sequence, size_t expected)
+        : path_(path), sequence_(sequence), events_(expected), entries_(expected) {}
+
+SortedRun::~SortedRun() {
+    remove(path_.c_str());
+}
+
+size_t SortedRun::MemoryUsage() const {
+    return fences_.capacity() * sizeof(Fence) + events_.MemoryUsage() + entries_.MemoryUsage();
+}
+
+string SortedRun::EntryKey(int date, const string& event) {
+    string key(sizeof(date), '\0');
+    memcpy(&key[0], &date, sizeof(date));
+    return key += event;
+}
+
+SortedRun::Builder::Builder(const string& path, uint64_t sequence, size_t expected)
+        : run_(new SortedRun(path, sequence, expected)),
+          output_(path, ios::binary | ios::trunc),
+          writer_(output_, CHUNK_EVENTS) {
+    if (!output_) {
+        throw runtime_error("Cannot open file: " + path);
+    }
+}
+
+void SortedRun::Builder::Append(int date, const string& event) {
+    if (run_->size_ % CHUNK_EVENTS == 0) {//предыдущий блок уже записан: здесь начинается следующий
+        run_->fences_.push_back({date, date, output_.tellp()});
+    } else {
+        run_->fences_.back().last = date;
+    }
+    writer_.Append(date, event);
+    run_->events_.Add(event);
+    run_->entries_.Add(EntryKey(date, event));
+    ++run_->size_;
+}
+
+shared_ptr<const SortedRun> SortedRun::Builder::Finish() {
+    writer_.Finish();
+    output_.close();
+    if (run_->size_ == 0) {
+        return nullptr;//деструктор прогона удалит пустой файл
+    }
+    return move(run_);
+}
+
+SortedRun::Cursor::Cursor(const SortedRun& run) : input_(run.path_, ios::binary), reader_(input_) {}
+
+bool SortedRun::Cursor::Next(int& date, string& event) {
+    while (index_ == dates_.size()) {
+        if (!reader_.NextChunk(dates_, events_)) {
+            return false;
+        }
+        index_ = 0;
+    }
+    date = dates_[index_];
+    event = move(events_[index_]);
+    ++index_;
+    return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "bloom_filter.h"
+#include "export_format.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Неизменяемый упорядоченный прогон LsmDatabase на диске: файл в формате Export (export_format.h)
+//с мелкими блоками. События идут по возрастанию дат, внутри даты - в порядке добавления.
+//В памяти остаются только границы блоков (первая и последняя дата, смещение в файле) и два
+//фильтра Блума: по текстам событий и по парам (дата, событие). Файл удаляется вместе с прогоном.
+class SortedRun {
+public:
+    static const size_t CHUNK_EVENTS = 256;
+
+    struct Fence {
+        int first;
+        int last;
+        streamoff offset;
+    };
+
+    //Запись нового прогона: события подаются уже упорядоченными
+    class Builder {
+    public:
+        //expected - оценка числа событий сверху, под неё заводятся фильтры
+        Builder(const string& path, uint64_t sequence, size_t expected);
+
+        void Append(int date, const string& event);
+        //nullptr, если не было ни одного события (файл тогда не остаётся)
+        shared_ptr<const SortedRun> Finish();
+
+    private:
+        shared_ptr<SortedRun> run_;
+        ofstream output_;
+        ExportWriter writer_;
+    };
+
+    //последовательное чтение всего прогона (слияние)
+    class Cursor {
+    public:
+        explicit Cursor(const SortedRun& run);
+        bool Next(int& date, string& event);
+
+    private:
+        ifstream input_;
+        ExportReader reader_;
+        vector<int> dates_;
+        vector<string> events_;
+        size_t index_ = 0;
+    };
+
+    SortedRun(const SortedRun&) = delete;
+    SortedRun& operator=(const SortedRun&) = delete;
+    ~SortedRun();
+
+    uint64_t Sequence() const {return sequence_;}
+    size_t size() const {return size_;}
+    int MinDate() const {return fences_.front().first;}
+    int MaxDate() const {return fences_.back().last;}
+    const string& Path() const {return path_;}
+    size_t MemoryUsage() const;
+
+    bool MayContainEvent(const string& event) const {return events_.MayContain(event);}
+    bool MayContainEntry(int date, const string& event) const {return entries_.MayContain(EntryKey(date, event));}
+
+    //f(date, event) для событий с датами [first, last] по возрастанию; читаются только блоки,
+    //чьи границы пересекают диапазон
+    template <typename F>
+    void ForEach(int first, int last, F f) const {
+        Scan(first, last, false, [&f](int date, const string& event) {
+            f(date, event);
+            return true;
+        });
+    }
+
+    //то же от last к first; f возвращает false, чтобы остановить обход
+    template <typename F>
+    void ForEachReverse(int first, int last, F f) const {
+        Scan(first, last, true, f);
+    }
+
+    //сколько блоков прочитано с диска за всё время (для статистики)
+    size_t ChunksRead() const {return chunks_read_;}
+
+private:
+    SortedRun(const string& path, uint64_t sequence, size_t expected);
+
+    static string EntryKey(int date, const string& event);
+
+    template <typename F>
+    void Scan(int first, int last, bool reverse, F f) const {
+        if (first > last || last < MinDate() || first > MaxDate()) {
+            return;
+        }
+        ifstream input(path_, ios::binary);
+        ExportReader reader(input);
+        vector<int> dates;
+        vector<string> events;
+        for (size_t k = 0; k < fences_.size(); ++k) {
+            const Fence& fence = fences_[reverse ? fences_.size() - 1 - k : k];
+            if (fence.last < first || fence.first > last) {
+                continue;
+            }
+            reader.Seek(fence.offset);
+            reader.NextChunk(dates, events);
+            ++chunks_read_;
+            for (size_t j = 0; j < dates.size(); ++j) {
+                const size_t i = reverse ? dates.size() - 1 - j : j;
+                if (dates[i] >= first && dates[i] <= last && !f(dates[i], events[i])) {
+                    return;
+                }
+            }
+        }
+    }
+
+    string path_;
+    uint64_t sequence_;
+    size_t size_ = 0;
+    vector<Fence> fences_;
+    BloomFilter events_;
+    BloomFilter entries_;
+    mutable size_t chunks_read_ = 0;
+};
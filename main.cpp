@@ -1,7 +1,18 @@
+//windows.h - до заголовков проекта и без макросов min/max (NOMINMAX), чтобы они не ломали std::min/std::max в них
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
 #include "database.h"
 #include "condition_parser.h"
-#include "test_functions.h"
+#include "predicates.h"
+#include "slow_query_log.h"
+#include "pipeline.h"
+#include "lsm_database.h"
 
+#include <cstdint>
 #include <set>
 #include <fstream>
 
@@ -15,18 +26,46 @@
  * 2.5. ....
  * 3. Вызовы команд
  */
-int main() {
-    TestAll();
-    system("chcp 65001");
+//размер буфера вывода REPL
+const size_t OUTPUT_BUFFER_SIZE = 1 << 18;
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);//вместо system("chcp 65001"): без запуска отдельного процесса
+#endif
+
+    //Вывод копится в буфере и уходит в поток на границе команд (или когда буфер заполнен),
+    //а не на каждой строке. Буфер задаётся до первого вывода
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+    static char output_buffer[OUTPUT_BUFFER_SIZE];
+    cout.rdbuf()->pubsetbuf(output_buffer, sizeof(output_buffer));
+
+    //--pipeline: чтение, выполнение и вывод команд в трёх потоках (pipeline.h)
+    bool pipeline = false;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--pipeline") {
+            pipeline = true;
+        } else {
+            cerr << "Unknown option: " << argv[i] << endl;
+            return 1;
+        }
+    }
 
     map<pair<string, string>, Database> ACCOUNTS;
+    //счета, переведённые командой Engine lsm на LsmDatabase; их записи в ACCOUNTS остаются пустыми
+    map<pair<string, string>, unique_ptr<LsmDatabase>> LSM_ACCOUNTS;
+    //команды, которых у LsmDatabase нет
+    const set<string> LSM_UNSUPPORTED = {"Count", "CountBy", "Distinct", "Export", "Import", "CreateView", "View",
+                                         "Views", "DropView", "CacheStats", "Ingest", "EventFilter",
+                                         "Partition", "Tier"};
 
     string login;
     string password;
 
-    cout << "Введите логин : ";
+    cout << "Введите логин : " << flush;
     cin >> login;
-    cout << "Введите пароль : ";
+    cout << "Введите пароль : " << flush;
     cin >> password;
 
     ACCOUNTS[{login, password}] = Database();
@@ -36,87 +75,565 @@ int main() {
             "Введите HELP для получения большей информации об этой модели и её возможностях;\n"
             "\n"
             "Введите CHANGE для смены аккаунта;\n"
-            "==============================================================================\n";
+            "==============================================================================\n" << flush;
 
-    for (string line; getline(cin, line);) {
+    //SlowLog: журнал команд дольше порога
+    unique_ptr<SlowQueryLog> slow_log;
+    //StatsDump: файл, куда периодически переписывается статистика
+    string dump_path;
+    chrono::steady_clock::duration dump_interval{};
+    chrono::steady_clock::time_point next_dump;
 
+    //Выполняет одну строку ввода. credentials - откуда CHANGE берёт логин и пароль, out - куда пишется ответ
+    auto execute = [&](const string &line, istream &credentials, ostream &out) {
         istringstream is(line);
 
         string command;
         is >> command;
+        //фазы команды для журнала медленных запросов (Find, Del, Last, Print)
+        QueryTrace trace;
+        PhaseClock clock(slow_log != nullptr);
+        //время команды попадает в Stats при выходе из итерации, в том числе по исключению
+        string recorded = command;
+        auto timer = MakeScopedTimer([&recorded](chrono::nanoseconds latency) {
+            if (!recorded.empty()) {
+                Stats::Instance().RecordCommand(recorded, latency);
+            }
+        });
+        const auto lsm_account = LSM_ACCOUNTS.find({login, password});
+        LsmDatabase *lsm = lsm_account == LSM_ACCOUNTS.end() ? nullptr : lsm_account->second.get();
         try {
+            if (lsm && LSM_UNSUPPORTED.count(command)) {
+                throw logic_error(command + " is not supported by the lsm engine");
+            }
             if (command == "HELP" || command == "help" || command == "Help") {
-                cout << "Add date event — добавить в базу данных пару (date, event);\n"
-                        "\n"
-                        "Print — вывести всё содержимое базы данных;\n"
-                        "\n"
-                        "Find condition — вывести все записи, содержащиеся в базе данных, которые удовлетворяют условию condition;\n"
-                        "\n"
-                        "Del condition — удалить из базы все записи, которые удовлетворяют условию condition;\n"
-                        "\n"
-                        "Last date — вывести запись с последним событием, случившимся не позже данной даты.\n"
-                        "\n"
-                        "Условия в командах Find и Del накладывают определённые ограничения на даты и события, например:\n"
-                        "\n"
-                        "Find date < 2017-11-06 — найти все события, которые случились раньше 6 ноября 2017 года;\n"
-                        "\n"
-                        "Del event != \"holiday\" — удалить из базы все события, кроме «holiday»;\n"
-                        "\n"
-                        "Find date >= 2017-01-01 AND date < 2017-07-01 AND event == \"sport event\" — найти всё события «sport event», случившиеся в первой половине 2017 года;\n"
-                        "\n"
-                        "Del date < 2017-01-01 AND (event == \"holiday\" OR event == \"sport event\") — удалить из базы все события «holiday» и «sport event», случившиеся до 2017 года.\n"
-                        "\n"
-                        "В командах обоих типов условия могут быть пустыми: под такое условие попадают все события.\n";
+                out << "Add date event — добавить в базу данных пару (date, event);\n"
+                       "\n"
+                       "Print — вывести всё содержимое базы данных;\n"
+                       "\n"
+                       "Find condition — вывести все записи, содержащиеся в базе данных, которые удовлетворяют условию condition;\n"
+                       "\n"
+                       "Find condition LIMIT n OFFSET m DESC — постранично: пропустить m записей, вывести не больше n, при DESC - начиная с последних;\n"
+                       "\n"
+                       "Del condition — удалить из базы все записи, которые удовлетворяют условию condition;\n"
+                       "\n"
+                       "Count condition — число записей, удовлетворяющих условию condition;\n"
+                       "\n"
+                       "CountBy date|month|year condition — то же по дням, месяцам или годам;\n"
+                       "\n"
+                       "Distinct event condition — различные события среди записей, удовлетворяющих условию, и число дат каждого;\n"
+                       "\n"
+                       "Last date — вывести запись с последним событием, случившимся не позже данной даты;\n"
+                       "Last date1 date2 ... — то же для нескольких дат, по строке на каждую;\n"
+                       "\n"
+                       "Export condition > file — выгрузить подходящие записи в файл в двоичном формате; последний '>' отделяет файл,\n"
+                       "    поэтому для условия со сравнением файл обязателен: Export date > 2017-01-01 > dump.bin;\n"
+                       "\n"
+                       "Import file — добавить записи из файла, созданного Export; испорченный файл не меняет базу;\n"
+                       "\n"
+                       "CreateView name condition — завести представление name с результатом Find condition, которое база обновляет сама;\n"
+                       "\n"
+                       "View name — вывести записи представления name;\n"
+                       "\n"
+                       "Views — список представлений и затраты на их поддержание;\n"
+                       "\n"
+                       "DropView name — удалить представление name;\n"
+                       "\n"
+                       "Stats — задержки команд, время разбора условий, просмотренные и найденные события, память базы;\n"
+                       "Stats reset — обнулить статистику;\n"
+                       "\n"
+                       "StatsDump file seconds — переписывать статистику в file не чаще раза в seconds секунд; StatsDump off - прекратить;\n"
+                       "\n"
+                       "SlowLog file threshold_ms — записывать в file команды Find, Del, Last и Print дольше порога, с временем по фазам; SlowLog off - выключить; SlowLog - состояние;\n"
+                       "\n"
+                       "Ingest n — копить Add пачками по n событий (не больше 1048576) и вливать их в базу одним проходом;\n"
+                       "    Ingest off или Ingest 0 - добавлять сразу;\n"
+                       "\n"
+                       "CacheStats — попадания в кэш результатов Find и занимаемая им память (не больше 64 записей и 64 МБ);\n"
+                       "\n"
+                       "EventFilter n — фильтры Блума по n (до 64) бит на событие у дат с большим числом событий: поиск конкретного события\n"
+                       "пропускает даты, где его точно нет; EventFilter off или EventFilter 0 - выключить; EventFilter - текущая настройка;\n"
+                       "\n"
+                       "Partition month|year — хранить даты разделами по месяцам или годам: Del с условием только на даты удаляет\n"
+                       "подходящие разделы целиком; Partition off - один раздел; Partition - текущее разбиение;\n"
+                       "\n"
+                       "Tier date directory — разделы раньше date записать в файлы сегментов в directory и выгрузить из памяти\n"
+                       "(нужен Partition); файлы - единственная копия этих разделов, поэтому временный каталог системы не подходит;\n"
+                       "при повторном Tier каталог можно не указывать;\n"
+                       "запросы, задевающие их даты, подгружают их обратно; Tier off - всё в память; Tier - состояние;\n"
+                       "\n"
+                       "TierBudget n — не больше n МБ подгруженных холодных разделов на процесс, лишние вытесняются по LRU;\n"
+                       "\n"
+                       "Engine lsm [n] — хранить пустой аккаунт в LSM-дереве: n событий в памяти, остальное в файлах прогонов,\n"
+                       "которые сливаются в фоне (Count, CountBy, Distinct, Export, Import, представления, CacheStats и Ingest\n"
+                       "для него недоступны); Engine memory — вернуть пустой аккаунт в память; Engine - текущий движок.\n"
+                       "\n"
+                       "Условия в командах Find и Del накладывают определённые ограничения на даты и события, например:\n"
+                       "\n"
+                       "Find date < 2017-11-06 — найти все события, которые случились раньше 6 ноября 2017 года;\n"
+                       "\n"
+                       "Del event != \"holiday\" — удалить из базы все события, кроме «holiday»;\n"
+                       "\n"
+                       "Find date >= 2017-01-01 AND date < 2017-07-01 AND event == \"sport event\" — найти всё события «sport event», случившиеся в первой половине 2017 года;\n"
+                       "\n"
+                       "Del date < 2017-01-01 AND (event == \"holiday\" OR event == \"sport event\") — удалить из базы все события «holiday» и «sport event», случившиеся до 2017 года.\n"
+                       "\n"
+                       "В командах обоих типов условия могут быть пустыми: под такое условие попадают все события.\n";
             } else if (command == "CHANGE" || command == "change" || command == "Change") {
-                cout << "Введите логин : ";
-                cin >> login;
-                cout << "Введите пароль : ";
-                cin >> password;
+                out << "Введите логин : " << flush;
+                credentials >> login;
+                out << "Введите пароль : " << flush;
+                credentials >> password;
             } else if (command == "Add" || command == "add") {
                 const auto date = ParseDate(is);
                 const auto event = ParseEvent(is);
-                ACCOUNTS[{login, password}].Add(date, event);
+                if (lsm) {
+                    lsm->Add(date, event);
+                } else {
+                    ACCOUNTS[{login, password}].Add(date, event);
+                }
             } else if (command == "Print" || command == "print") {
-                ACCOUNTS[{login, password}].Print(cout);
+                trace.command = "Print";
+                const string output = lsm ? lsm->ToStringDB() : ACCOUNTS[{login, password}].ToStringDB();
+                clock.Lap(trace.scan);//обход базы вместе со сборкой текста
+                out << output;
+                clock.Lap(trace.format);
+                if (slow_log) {
+                    trace.rows_returned = count(output.begin(), output.end(), '\n');
+                    trace.rows_scanned = trace.rows_returned;
+                }
             } else if (command == "Del" || command == "del") {
-
-                auto condition = ParseCondition(is);
-                auto predicate = [condition](const Date &date, const string &event) {
-                    return condition->Evaluate(date, event);
-                };
-
-                int count = ACCOUNTS[{login, password}].RemoveIf(predicate);
-                cout << "Removed " << count << " entries" << endl;
+                trace.command = "Del";
+                getline(is >> ws, trace.text);
+                istringstream condition_stream(trace.text);
+                ParseTiming timing;
+                auto condition = ParseCondition(condition_stream, slow_log ? &timing : nullptr);
+                clock.Lap(trace.parse);
+                Database &db = ACCOUNTS[{login, password}];
+                Stats::ThreadScan() = {};
+                int count = lsm ? lsm->RemoveIf(condition) : DispatchCondition(condition, [&db, &clock, &trace](auto predicate) {
+                    clock.Lap(trace.plan);
+                    return db.RemoveIf(predicate);
+                });
+                clock.Lap(trace.scan);
+                out << "Removed " << count << " entries\n";
+                clock.Lap(trace.format);
+                trace.tokenize = timing.tokenize;
+                trace.parse -= timing.tokenize;
+                trace.dates_visited = Stats::ThreadScan().dates_visited;
+                trace.rows_scanned = Stats::ThreadScan().events_scanned;
+                trace.rows_returned = count;
             } else if (command == "Find" || command == "find") {
-                auto condition = ParseCondition(is);
-                auto predicate = [condition](const Date &date, const string &event) {
-                    return condition->Evaluate(date, event);
-                };
-
-                const auto entries = ACCOUNTS[{login, password}].FindIf(predicate);
-                for (const auto &entry: entries) {
-                    cout << entry << endl;
+                trace.command = "Find";
+                getline(is >> ws, trace.text);
+                string text = trace.text;
+                const FindOptions options = ParseFindOptions(text);
+                clock.Lap(trace.plan);
+                istringstream condition_stream(text);
+                ParseTiming timing;
+                auto condition = ParseCondition(condition_stream, slow_log ? &timing : nullptr);
+                clock.Lap(trace.parse);
+                if (lsm && options.Paged()) {
+                    throw logic_error("Find LIMIT, OFFSET and DESC are not supported by the lsm engine");
                 }
-                cout << "Found " << entries.size() << " entries" << endl;
+                const Database &db = ACCOUNTS[{login, password}];
+                Stats::ThreadScan() = {};
+                //страница считается заново, без кэша: её стоимость и так пропорциональна размеру страницы
+                const auto entries = lsm ? make_shared<const vector<string>>(lsm->FindIf(condition))
+                        : options.Paged()
+                        ? make_shared<const vector<string>>(DispatchCondition(condition, [&db, &options, &clock, &trace](auto predicate) {
+                            clock.Lap(trace.plan);
+                            return db.FindIf(predicate, options);
+                        }))
+                        : db.FindCached(condition);
+                clock.Lap(trace.scan);
+                for (const auto &entry: *entries) {
+                    out << entry << '\n';
+                }
+                out << "Found " << entries->size() << " entries\n";
+                clock.Lap(trace.format);
+                trace.tokenize = timing.tokenize;
+                trace.parse -= timing.tokenize;
+                trace.dates_visited = Stats::ThreadScan().dates_visited;
+                trace.rows_scanned = Stats::ThreadScan().events_scanned;
+                trace.rows_returned = entries->size();
             } else if (command == "Last" || command == "last") {
+                trace.command = "Last";
+                getline(is >> ws, trace.text);
                 try {
-                    cout << ACCOUNTS[{login, password}].Last(ParseDate(is)) << endl;
+                    istringstream dates_stream(trace.text);
+                    vector<Date> dates;//Last d1 d2 ... - по строке ответа на каждую дату
+                    while (dates_stream >> ws, !dates_stream.eof())
+                        dates.push_back(ParseDate(dates_stream));
+                    if (dates.empty())
+                        throw runtime_error("Wrong date format");
+                    clock.Lap(trace.parse);
+                    if (lsm) {
+                        for (const Date &date : dates) {
+                            out << lsm->Last(date) << '\n';
+                        }
+                        clock.Lap(trace.scan);
+                    } else {
+                        const auto lasts = ACCOUNTS[{login, password}].LastMany(dates);
+                        clock.Lap(trace.scan);
+                        for (const auto &last : lasts) {
+                            if (last)
+                                out << *last << '\n';
+                            else
+                                out << "No entries" << '\n';
+                        }
+                        clock.Lap(trace.format);
+                    }
+                    trace.rows_returned = dates.size();
                 } catch (invalid_argument &) {
-                    cout << "No entries" << endl;
+                    out << "No entries" << '\n';
+                }
+            } else if (command == "Count") {
+                auto condition = ParseCondition(is);
+                const Database &db = ACCOUNTS[{login, password}];
+                out << "Count " << DispatchCondition(condition, [&db](auto predicate) {
+                    return db.CountIf(predicate);
+                }) << '\n';
+            } else if (command == "CountBy") {
+                string group;
+                is >> group;
+                DateGrouping grouping;
+                if (group == "date") {
+                    grouping = DateGrouping::Date;
+                } else if (group == "month") {
+                    grouping = DateGrouping::Month;
+                } else if (group == "year") {
+                    grouping = DateGrouping::Year;
+                } else {
+                    throw logic_error("CountBy expects date, month or year: " + group);
+                }
+                auto condition = ParseCondition(is);
+                const Database &db = ACCOUNTS[{login, password}];
+                const auto counts = DispatchCondition(condition, [&db, grouping](auto predicate) {
+                    return db.CountByIf(predicate, grouping);
+                });
+                for (const auto &count : counts) {
+                    out << DateGroupName(count.first, grouping) << ' ' << count.second << '\n';
+                }
+                out << "Found " << counts.size() << " groups" << '\n';
+            } else if (command == "Distinct") {
+                string column;
+                is >> column;
+                if (column != "event") {
+                    throw logic_error("Distinct expects event: " + column);
+                }
+                auto condition = ParseCondition(is);
+                const Database &db = ACCOUNTS[{login, password}];
+                const auto events = DispatchCondition(condition, [&db](auto predicate) {
+                    return db.DistinctEventsIf(predicate);
+                });
+                for (const auto &event : events) {
+                    out << event.first << ' ' << event.second << '\n';
+                }
+                out << "Found " << events.size() << " distinct events" << '\n';
+            } else if (command == "Export") {
+                string text;
+                getline(is, text);
+                const size_t separator = text.rfind('>');
+                if (separator == string::npos) {
+                    throw logic_error("Export expects: Export condition > file");
+                }
+                istringstream file_name(text.substr(separator + 1));
+                string path;
+                file_name >> path;
+                //файл - после последнего '>', и всё до него должно быть целым условием:
+                //в "Export date > 2017-01-01" нет файла, а не файл "2017-01-01"
+                istringstream condition_stream(text.substr(0, separator));
+                shared_ptr<Node> condition;
+                try {
+                    condition = ParseCondition(condition_stream);
+                } catch (const logic_error&) {
+                    throw logic_error("Export expects: Export condition > file");
                 }
+                if (path.empty()) {
+                    throw logic_error("Export expects: Export condition > file");
+                }
+                ofstream output(path, ios::binary);
+                if (!output) {
+                    throw runtime_error("Cannot open file: " + path);
+                }
+                const Database &db = ACCOUNTS[{login, password}];
+                const size_t count = DispatchCondition(condition, [&db, &output](auto predicate) {
+                    return db.ExportIf(predicate, output);
+                });
+                out << "Exported " << count << " entries" << '\n';
+            } else if (command == "Import") {
+                string path;
+                is >> path;
+                ifstream input(path, ios::binary);
+                if (!input) {
+                    throw runtime_error("Cannot open file: " + path);
+                }
+                out << "Imported " << ACCOUNTS[{login, password}].Import(input) << " entries" << '\n';
+            } else if (command == "CreateView") {
+                string name, condition;
+                is >> name;
+                getline(is, condition);
+                Database &db = ACCOUNTS[{login, password}];
+                db.CreateView(name, condition);
+                out << "View " << name << ": " << db.Views().back().size() << " entries" << '\n';
+            } else if (command == "View") {
+                string name;
+                is >> name;
+                const auto entries = ACCOUNTS[{login, password}].ReadView(name);
+                for (const auto &entry: entries) {
+                    out << entry << '\n';
+                }
+                out << "Found " << entries.size() << " entries" << '\n';
+            } else if (command == "Views") {
+                for (const auto &view : ACCOUNTS[{login, password}].Views()) {
+                    const ViewStats &stats = view.Stats();
+                    out << view.Name() << ":" << view.ConditionText() << "; entries " << view.size()
+                        << ", tested " << stats.events_tested << ", added " << stats.events_added
+                        << ", removed " << stats.events_removed << ", maintenance "
+                        << chrono::duration<double, micro>(stats.maintenance).count() << " us\n";
+                }
+            } else if (command == "Stats") {
+                string argument;
+                is >> argument;
+                if (argument == "reset") {
+                    Stats::Instance().Reset();
+                    out << "Stats reset" << '\n';
+                } else {
+                    Stats::Instance().Print(out);
+                    if (lsm) {
+                        lsm->PrintStats(out);
+                    } else {
+                        ACCOUNTS[{login, password}].PrintStats(out);
+                    }
+                }
+            } else if (command == "SlowLog") {
+                string path;
+                is >> path;
+                if (path.empty()) {
+                    if (slow_log) {
+                        out << "Slow log: threshold " << chrono::duration<double, milli>(slow_log->Threshold()).count()
+                            << " ms, written " << slow_log->Written() << ", dropped " << slow_log->Dropped() << '\n';
+                    } else {
+                        out << "Slow log off" << '\n';
+                    }
+                } else if (path == "off") {
+                    slow_log.reset();
+                    out << "Slow log off" << '\n';
+                } else {
+                    double milliseconds = 0;
+                    if (!(is >> milliseconds) || milliseconds < 0) {
+                        throw logic_error("SlowLog expects: SlowLog file threshold_ms");
+                    }
+                    slow_log.reset();//прежний журнал дописывается до открытия нового
+                    slow_log = make_unique<SlowQueryLog>(path, chrono::duration_cast<chrono::nanoseconds>(
+                            chrono::duration<double, milli>(milliseconds)));
+                    out << "Slow log to " << path << " for commands over " << milliseconds << " ms" << '\n';
+                }
+            } else if (command == "StatsDump") {
+                string path;
+                is >> path;
+                if (path == "off") {
+                    dump_path.clear();
+                    out << "Stats dump off" << '\n';
+                } else {
+                    double seconds = 0;
+                    if (!(is >> seconds) || seconds <= 0) {
+                        throw logic_error("StatsDump expects: StatsDump file seconds");
+                    }
+                    dump_path = path;
+                    dump_interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+                    next_dump = chrono::steady_clock::now();
+                    out << "Stats dump to " << path << " every " << seconds << " s" << '\n';
+                }
+            } else if (command == "Ingest") {
+                string argument;
+                is >> argument;
+                size_t capacity = 0;
+                if (argument != "off") {
+                    //stoull приняло бы "-1" как 2^64-1: число читается со знаком и целиком
+                    long long value = -1;
+                    size_t parsed = 0;
+                    try {
+                        value = stoll(argument, &parsed);
+                    } catch (exception &) {
+                        parsed = 0;
+                    }
+                    if (parsed == 0 || parsed != argument.size() || value < 0) {
+                        throw runtime_error("Wrong buffer size");
+                    }
+                    capacity = static_cast<size_t>(value);
+                }
+                Database &db = ACCOUNTS[{login, password}];
+                db.SetAddBuffer(capacity);
+                if (db.AddBuffer()) {
+                    out << "Add buffer: " << db.AddBuffer() << " events\n";
+                } else {
+                    out << "Add buffer off\n";
+                }
+            } else if (command == "EventFilter") {
+                string argument;
+                is >> argument;
+                Database &db = ACCOUNTS[{login, password}];
+                if (argument == "off") {
+                    db.SetEventFilter(0);
+                } else if (!argument.empty()) {
+                    long long bits = 0;
+                    size_t parsed = 0;
+                    try {
+                        bits = stoll(argument, &parsed);
+                    } catch (exception &) {
+                        throw logic_error("EventFilter expects: EventFilter n or EventFilter off");
+                    }
+                    if (parsed != argument.size() || bits < 0 || bits > static_cast<long long>(Database::MAX_EVENT_FILTER_BITS)) {
+                        throw logic_error("EventFilter expects from 0 to " + to_string(Database::MAX_EVENT_FILTER_BITS) +
+                                          " bits per event");
+                    }
+                    db.SetEventFilter(static_cast<size_t>(bits));
+                }
+                if (db.EventFilter()) {
+                    out << "Event filters: " << db.EventFilter() << " bits per event\n";
+                } else {
+                    out << "Event filters off\n";
+                }
+            } else if (command == "Partition") {
+                string argument;
+                is >> argument;
+                Database &db = ACCOUNTS[{login, password}];
+                if (argument == "month") {
+                    db.SetPartitioning(DatePartitioning::Month);
+                } else if (argument == "year") {
+                    db.SetPartitioning(DatePartitioning::Year);
+                } else if (argument == "off") {
+                    db.SetPartitioning(DatePartitioning::None);
+                } else if (!argument.empty()) {
+                    throw logic_error("Partition expects: Partition month, Partition year or Partition off");
+                }
+                if (db.Partitioning() == DatePartitioning::None) {
+                    out << "Partitions off\n";
+                } else {
+                    out << "Partitions by " << (db.Partitioning() == DatePartitioning::Month ? "month" : "year")
+                        << ": " << db.PartitionCount() << "\n";
+                }
+            } else if (command == "Tier") {
+                string argument;
+                is >> argument;
+                Database &db = ACCOUNTS[{login, password}];
+                if (argument == "off") {
+                    db.DisableTiering();
+                } else if (!argument.empty()) {
+                    istringstream date_stream(argument);
+                    const Date cold_before = ParseDate(date_stream);
+                    string directory;
+                    is >> directory;
+                    db.SetTiering(cold_before, directory);
+                }
+                if (db.Tiered()) {
+                    out << "Cold before " << db.ColdBefore() << ": " << db.EvictedPartitions() << " of "
+                        << db.PartitionCount() << " partitions on disk only\n";
+                } else {
+                    out << "Tiering off\n";
+                }
+            } else if (command == "TierBudget") {
+                string argument;
+                is >> argument;
+                SegmentBudget &budget = SegmentBudget::Instance();
+                if (!argument.empty()) {
+                    //как в Ingest: число со знаком целиком, и чтобы n << 20 не переполнилось
+                    long long megabytes = -1;
+                    size_t parsed = 0;
+                    try {
+                        megabytes = stoll(argument, &parsed);
+                    } catch (exception &) {
+                        parsed = 0;
+                    }
+                    if (parsed == 0 || parsed != argument.size() || megabytes < 0 ||
+                        static_cast<unsigned long long>(megabytes) > (SIZE_MAX >> 20)) {
+                        throw runtime_error("Wrong budget size");
+                    }
+                    budget.SetLimit(static_cast<size_t>(megabytes) << 20);
+                }
+                out << "Tier budget: " << budget.Resident() << " of " << budget.Limit() << " bytes in use\n";
+            } else if (command == "CacheStats") {
+                const ResultCacheStats stats = ACCOUNTS[{login, password}].CacheStats();
+                const size_t lookups = stats.hits + stats.misses;
+                out << "hits " << stats.hits << ", misses " << stats.misses << ", hit rate "
+                    << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "%, invalidated " << stats.invalidated
+                    << ", evicted " << stats.evicted << ", entries " << stats.entries << ", memory "
+                    << stats.memory << " bytes" << '\n';
+            } else if (command == "DropView") {
+                string name;
+                is >> name;
+                out << (ACCOUNTS[{login, password}].DropView(name) ? "Dropped " : "Unknown view: ") << name << '\n';
+            } else if (command == "Engine") {
+                string engine;
+                is >> engine;
+                Database &db = ACCOUNTS[{login, password}];
+                if (!engine.empty()) {
+                    const bool empty = lsm ? lsm->ToStringDB().empty()
+                                           : db.CountIf([](const Date &, const string &) {return true;}) == 0;
+                    if (!empty) {
+                        throw logic_error("Engine can be changed only for an empty account");
+                    }
+                }
+                if (engine == "lsm") {
+                    LsmOptions options;
+                    if (is >> ws, !is.eof() && !(is >> options.memtable_events)) {
+                        throw logic_error("Engine expects: Engine lsm [memtable_events]");
+                    }
+                    //прежнее дерево останавливает слияние и удаляет свои файлы
+                    LSM_ACCOUNTS[{login, password}] = make_unique<LsmDatabase>(options);
+                    lsm = LSM_ACCOUNTS[{login, password}].get();
+                } else if (engine == "memory") {
+                    LSM_ACCOUNTS.erase({login, password});
+                    lsm = nullptr;
+                } else if (!engine.empty()) {
+                    throw logic_error("Engine expects lsm or memory: " + engine);
+                }
+                out << "Engine: " << (lsm ? "lsm" : "memory") << '\n';
             } else if (command.empty()) {
-                continue;
+                //пустая строка: только сбросить вывод ниже
             } else {
                 //возможно сделать исключение, когда будет убрано из main
                 //throw logic_error("Unknown command: " + command);
 
-                cout << "Unknown command:" + command << endl;
+                recorded = "Unknown";
+                out << "Unknown command:" + command << '\n';
             }
         } catch (logic_error e) {
-            cout << e.what() << "\n";
+            out << e.what() << "\n";
         }
         catch(runtime_error r){
-            cout << r.what() << "\n";
+            out << r.what() << "\n";
+        }
+        //Ответы команд, пришедших пачкой, уходят одной записью: сбрасываем буфер,
+        //только когда прочитанный ввод исчерпан и следующая команда ещё не пришла
+        if (!pipeline && cin.rdbuf()->in_avail() <= 0) {
+            out.flush();
+        }
+        clock.Lap(trace.write);
+        if (slow_log && !trace.command.empty()) {
+            trace.total = clock.Total();
+            trace.account = login;
+            slow_log->Submit(move(trace));
+        }
+        if (!dump_path.empty() && chrono::steady_clock::now() >= next_dump) {
+            ofstream dump(dump_path, ios::trunc);
+            Stats::Instance().Print(dump);
+            if (lsm) {
+                lsm->PrintStats(dump);
+            } else {
+                ACCOUNTS[{login, password}].PrintStats(dump);
+            }
+            next_dump = chrono::steady_clock::now() + dump_interval;
+        }
+    };
+
+    if (pipeline) {
+        RunPipeline(cin, cout, execute);
+    } else {
+        for (string line; getline(cin, line);) {
+            execute(line, cin, cout);
         }
     }
 
@@ -0,0 +1,83 @@
+#include "materialized_view.h"
+
+MaterializedView::MaterializedView(string name, string condition_text, shared_ptr<Node> condition)
+        : name_(move(name)), condition_text_(move(condition_text)), condition_(move(condition)) {}
+
+void MaterializedView::Append(int date, uint32_t id, const EventDictionary* dictionary) {
+    rows_.FindOrInsert(date, dictionary).push_back(id);
+    ++size_;
+}
+
+void MaterializedView::OnAdd(const Date& date, const string& event, uint32_t id, const EventDictionary* dictionary) {
+    const auto start = chrono::steady_clock::now();
+    ++stats_.events_tested;
+    if (condition_->Evaluate(date, event)) {
+        Append(date.GetPacked(), id, dictionary);
+        ++stats_.events_added;
+    }
+    stats_.maintenance += chrono::steady_clock::now() - start;
+}
+
+void MaterializedView::OnRemoveDate(int date) {
+    const auto start = chrono::steady_clock::now();
+    if (EventColumn* rows = rows_.Find(date)) {
+        size_ -= rows->size();
+        stats_.events_removed += rows->size();
+        rows->clear();
+        emptied_ = true;
+    }
+    stats_.maintenance += chrono::steady_clock::now() - start;
+}
+
+void MaterializedView::OnRemoveDates(int from, int to) {
+    const auto start = chrono::steady_clock::now();
+    for (DateDirectory::Block& block : rows_.Blocks()) {
+        if (block.dates.back() < from) {
+            continue;
+        }
+        if (block.dates.front() > to) {
+            break;
+        }
+        for (size_t i = 0; i < block.dates.size(); ++i) {
+            if (from <= block.dates[i] && block.dates[i] <= to && !block.columns[i].empty()) {
+                size_ -= block.columns[i].size();
+                stats_.events_removed += block.columns[i].size();
+                block.columns[i].clear();
+                emptied_ = true;
+            }
+        }
+    }
+    stats_.maintenance += chrono::steady_clock::now() - start;
+}
+
+void MaterializedView::OnRemoveEvents(int date, const EventColumn& column, const Bitmap& selection) {
+    const auto start = chrono::steady_clock::now();
+    if (EventColumn* rows = rows_.Find(date)) {
+        //строки представления - подпоследовательность столбца базы в том же порядке,
+        //так что удаляемые строки находятся одним совместным проходом
+        ClearBitmap(selection_, rows->size());
+        size_t row = 0;
+        for (size_t i = 0; i < column.size() && row < rows->size(); ++i) {
+            if (column.Id(i) == rows->Id(row)) {
+                if (TestBit(selection, i)) {
+                    SetBit(selection_, row);
+                }
+                ++row;
+            }
+        }
+        const size_t removed = rows->EraseSelected(selection_);
+        size_ -= removed;
+        stats_.events_removed += removed;
+        emptied_ |= rows->empty();
+    }
+    stats_.maintenance += chrono::steady_clock::now() - start;
+}
+
+void MaterializedView::FinishRemove() {
+    if (emptied_) {
+        const auto start = chrono::steady_clock::now();
+        rows_.RemoveEmptyDates();
+        emptied_ = false;
+        stats_.maintenance += chrono::steady_clock::now() - start;
+    }
+}
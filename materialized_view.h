@@ -0,0 +1,64 @@
+#pragma once
+#include "node.h"
+#include "date_directory.h"
+#include "bitmap.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+//Затраты на поддержание представления с момента его создания
+struct ViewStats {
+    size_t events_tested = 0;//событий, проверенных условием при Add
+    size_t events_added = 0;
+    size_t events_removed = 0;
+    chrono::nanoseconds maintenance{0};//время в Add и RemoveIf, потраченное на это представление
+};
+
+//Материализованное представление: результат условия Find, который база поддерживает сама.
+//Строки лежат в таком же каталоге дат, как и база, и в том же порядке событий внутри даты,
+//поэтому чтение стоит столько же, сколько размер результата, и совпадает с выводом FindIf.
+//Add проверяет условием только новое событие, RemoveIf вычёркивает удалённые строки.
+class MaterializedView {
+public:
+    MaterializedView(string name, string condition_text, shared_ptr<Node> condition);
+
+    const string& Name() const {return name_;}
+    const string& ConditionText() const {return condition_text_;}
+    const shared_ptr<Node>& Condition() const {return condition_;}
+    const DateDirectory& Rows() const {return rows_;}
+    size_t size() const {return size_;}
+    const ViewStats& Stats() const {return stats_;}
+
+    //первичное заполнение: события в порядке их следования в базе
+    void Append(int date, uint32_t id, const EventDictionary* dictionary);
+
+    void OnAdd(const Date& date, const string& event, uint32_t id, const EventDictionary* dictionary);
+    //дата удалена из базы целиком
+    void OnRemoveDate(int date);
+    //удалены целиком все даты от from до to: просматриваются только строки представления в этом диапазоне
+    void OnRemoveDates(int from, int to);
+    //из столбца базы column даты date удаляются события, отмеченные в selection
+    void OnRemoveEvents(int date, const EventColumn& column, const Bitmap& selection);
+    //завершение RemoveIf: убирает опустевшие даты
+    void FinishRemove();
+    //база сменила словарь (Database::CompactDictionary): номер id строк становится map(id)
+    template <typename F>
+    void Remap(const EventDictionary* dictionary, F map) {
+        for (DateDirectory::Block& block : rows_.Blocks())
+            for (EventColumn& column : block.columns)
+                column.Remap(dictionary, map);
+    }
+
+private:
+    string name_;
+    string condition_text_;
+    shared_ptr<Node> condition_;
+    DateDirectory rows_;
+    size_t size_ = 0;
+    bool emptied_ = false;
+    Bitmap selection_;
+    ViewStats stats_;
+};
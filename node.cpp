@@ -1,8 +1,14 @@
 #include "node.h"
+#include "event_match.h"
+#include "date_match.h"
+
+#include <climits>
 
 
 bool EmptyNode::Evaluate(Date date,string s) {return true;}
 bool AlwaysFalseNode::Evaluate(Date date, string event) {return false;}
+void EmptyNode::EvaluateBatch(const EventBatch& batch, Bitmap& selection) {FillBitmap(selection, batch.size);}
+void AlwaysFalseNode::EvaluateBatch(const EventBatch& batch, Bitmap& selection) {ClearBitmap(selection, batch.size);}
 DateComparisonNode::DateComparisonNode(Comparison cmp,Date date) : cmp_(cmp),date_(date){}
 
 bool DateComparisonNode::Evaluate(Date date,string s) {
@@ -20,6 +26,35 @@ bool DateComparisonNode::Evaluate(Date date,string s) {
         return date_ >= date;
 }
 
+void DateComparisonNode::EvaluateBatch(const EventBatch& batch, Bitmap& selection) {
+    //любое сравнение сводится к диапазону [from, to], != - к дополнению точки
+    const int packed = date_.GetPacked();
+    int from = INT_MIN, to = INT_MAX;
+    if(cmp_ == Comparison::Equal || cmp_ == Comparison::NotEqual)
+        from = to = packed;
+    else if(cmp_ == Comparison::Greater)
+        from = packed + 1;
+    else if(cmp_ == Comparison::GreaterOrEqual)
+        from = packed;
+    else if(cmp_ == Comparison::Less)
+        to = packed - 1;
+    else if(cmp_ == Comparison::LessOrEqual)
+        to = packed;
+
+    if(batch.dates)
+        MatchDateRange(batch.dates, batch.size, from, to, selection);
+    else if(from <= batch.date && batch.date <= to)
+        FillBitmap(selection, batch.size);
+    else
+        ClearBitmap(selection, batch.size);
+
+    if(cmp_ == Comparison::NotEqual)
+        InvertBitmap(selection, batch.size);
+}
+
+Comparison DateComparisonNode::GetComparison() const {return cmp_;}
+Date DateComparisonNode::GetDate() const {return date_;}
+
 EventComparisonNode::EventComparisonNode(Comparison cmp, string s) : cmp_(cmp),s_(s) {}
 
 bool EventComparisonNode::Evaluate(Date date, string s) {
@@ -39,6 +74,24 @@ bool EventComparisonNode::Evaluate(Date date, string s) {
         return s_ != s;
 }
 
+Comparison EventComparisonNode::GetComparison() const {return cmp_;}
+const string& EventComparisonNode::GetEvent() const {return s_;}
+
+void EventComparisonNode::EvaluateBatch(const EventBatch& batch, Bitmap& selection) {
+    const EventColumn& column = *batch.events;
+    ClearBitmap(selection, batch.size);
+    if (cmp_ == Comparison::Equal || cmp_ == Comparison::NotEqual) {
+        MatchEventEqual(column, id_.Resolve(column.Dictionary(), s_), selection);
+        if (cmp_ == Comparison::NotEqual)
+            InvertBitmap(selection, batch.size);
+        return;
+    }
+    for (size_t i = 0; i < batch.size; ++i) {
+        if (Evaluate({0, 0, 0}, column[i]))
+            SetBit(selection, i);
+    }
+}
+
 LogicalOperationNode::LogicalOperationNode(LogicalOperation cmp, shared_ptr<Node> r, shared_ptr<Node> l) : cmp_(cmp),r_(r),l_(l) {}
 
 bool LogicalOperationNode::Evaluate(Date date, string s) {
@@ -46,4 +99,24 @@ bool LogicalOperationNode::Evaluate(Date date, string s) {
         return r_->Evaluate(date,s) && l_->Evaluate(date,s);
     if(cmp_ == LogicalOperation::Or)
         return r_->Evaluate(date,s) || l_->Evaluate(date,s);
-}
\ No newline at end of file
+}
+
+LogicalOperation LogicalOperationNode::GetOperation() const {return cmp_;}
+shared_ptr<Node> LogicalOperationNode::GetLeft() const {return l_;}
+shared_ptr<Node> LogicalOperationNode::GetRight() const {return r_;}
+
+void LogicalOperationNode::EvaluateBatch(const EventBatch& batch, Bitmap& selection) {
+    r_->EvaluateBatch(batch, selection);
+    if(cmp_ == LogicalOperation::And && !AnyBit(selection))
+        return;
+    Bitmap other;
+    l_->EvaluateBatch(batch, other);
+    if(cmp_ == LogicalOperation::And){
+        for (size_t i = 0; i < selection.size(); ++i)
+            selection[i] &= other[i];
+    }
+    if(cmp_ == LogicalOperation::Or){
+        for (size_t i = 0; i < selection.size(); ++i)
+            selection[i] |= other[i];
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "date.h"
+#include "event_column.h"
 
 enum class LogicalOperation{
     And,Or
@@ -9,14 +10,28 @@ enum class Comparison{
     Less,LessOrEqual,Greater,GreaterOrEqual,Equal,NotEqual
 };
 
+//Пакет для векторного вычисления условия: элемент i имеет упакованную дату dates[i]
+//(или общую дату date, если dates == nullptr) и событие (*events)[i].
+//Пакет из одних дат (events == nullptr) подходит только для условий без UsesEvents().
+struct EventBatch {
+    const int* dates = nullptr;
+    int date = 0;
+    const EventColumn* events = nullptr;
+    size_t size = 0;
+};
+
 class Node{
 public:
     virtual bool Evaluate(Date date,string s) = 0;
+    //записывает в selection (размера batch.size) элементы пакета, удовлетворяющие условию
+    virtual void EvaluateBatch(const EventBatch& batch, Bitmap& selection) = 0;
+    virtual bool UsesEvents() const {return false;}
 };
 
 class EmptyNode : public Node{
 public:
     bool Evaluate(Date date,string s) override;
+    void EvaluateBatch(const EventBatch& batch, Bitmap& selection) override;
 };
 
 class DateComparisonNode : public Node{
@@ -24,6 +39,10 @@ public:
 
     DateComparisonNode(Comparison cmp,Date date);// : cmp_(cmp),date_(date){}
     bool Evaluate(Date date,string s) override;
+    void EvaluateBatch(const EventBatch& batch, Bitmap& selection) override;
+
+    Comparison GetComparison() const;
+    Date GetDate() const;
 
 private:
     Comparison cmp_;
@@ -34,16 +53,29 @@ class EventComparisonNode : public Node{
 public:
     EventComparisonNode(Comparison cmp,string s);
     bool Evaluate(Date date,string s) override;
+    //== и != идут через векторное сравнение (event_match.h)
+    void EvaluateBatch(const EventBatch& batch, Bitmap& selection) override;
+    bool UsesEvents() const override {return true;}
+
+    Comparison GetComparison() const;
+    const string& GetEvent() const;
 
 private:
     Comparison cmp_;
     string s_;
+    EventIdCache id_;
 };
 
 class LogicalOperationNode : public Node{
 public:
     LogicalOperationNode(LogicalOperation cmp,shared_ptr<Node> r,shared_ptr<Node> l);
     bool Evaluate(Date date,string s) override;
+    void EvaluateBatch(const EventBatch& batch, Bitmap& selection) override;
+    bool UsesEvents() const override {return r_->UsesEvents() || l_->UsesEvents();}
+
+    LogicalOperation GetOperation() const;
+    shared_ptr<Node> GetLeft() const;
+    shared_ptr<Node> GetRight() const;
 
 private:
     LogicalOperation cmp_;
@@ -54,4 +86,5 @@ private:
 class AlwaysFalseNode : public Node {
 public:
     bool Evaluate(Date date,string event) override;
+    void EvaluateBatch(const EventBatch& batch, Bitmap& selection) override;
 };
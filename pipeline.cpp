@@ -0,0 +1,224 @@
+#include "pipeline.h"
+#include "spsc_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct CommandBatch {
+    vector<string> lines;//CHANGE, если есть, всегда последняя строка пачки
+    bool last = false;//ввод закончился
+};
+
+struct OutputChunk {
+    string text;
+    bool last = false;
+    atomic<bool>* written = nullptr;//если задан, поток записи выставляет его, когда текст выведен
+};
+
+//Ожидание соседней стадии: сначала несколько раз уступаем процессор, затем засыпаем
+//на condition_variable до звонка другой стадии, так что простаивающий конвейер
+//(интерактивный ввод) не занимает ядро. Стадия звонит после каждого изменения, которого
+//может ждать другая: элемент или место в кольце, выполненная CHANGE, выведенный текст
+class Doorbell {
+public:
+    void Ring() {
+        {
+            lock_guard<mutex> lock(mutex_);//ожидающий либо уже спит, либо проверит условие после нас
+        }
+        woken_.notify_all();
+    }
+
+    template <typename Ready>
+    void Wait(Ready ready) {
+        for (unsigned spin = 0; spin < SPINS; ++spin) {
+            if (ready()) {
+                return;
+            }
+            this_thread::yield();
+        }
+        unique_lock<mutex> lock(mutex_);
+        woken_.wait(lock, ready);
+    }
+
+private:
+    static const unsigned SPINS = 64;
+
+    mutex mutex_;
+    condition_variable woken_;
+};
+
+template <typename T>
+void Push(SpscRing<T>& ring, T&& value, Doorbell& doorbell) {
+    doorbell.Wait([&] {return ring.TryPush(move(value));});
+    doorbell.Ring();
+}
+
+template <typename T>
+void Pop(SpscRing<T>& ring, T& value, Doorbell& doorbell) {
+    doorbell.Wait([&] {return ring.TryPop(value);});
+    doorbell.Ring();
+}
+
+//Ответы пачки копятся в одной строке, которую затем забирает поток записи
+class StringOutput : public streambuf {
+public:
+    string Take() {
+        text_.resize(Used());
+        string text = move(text_);
+        text_ = string();
+        setp(nullptr, nullptr);
+        return text;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        const size_t used = Used();
+        text_.resize(max<size_t>(256, text_.size() * 2));
+        setp(&text_[0] + used, &text_[0] + text_.size());
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    size_t Used() const {
+        return text_.empty() ? 0 : pptr() - text_.data();
+    }
+
+    string text_;
+};
+
+//Ввод логина и пароля для CHANGE прямо из входного потока, пока поток чтения ждёт.
+//Перед каждым чтением то, что команда успела вывести (приглашение), отдаётся потоку записи,
+//и чтение ждёт, пока оно не окажется на экране
+class PromptedInput : public streambuf {
+public:
+    PromptedInput(streambuf* input, function<void()> before_read)
+            : input_(input), before_read_(move(before_read)) {}
+
+protected:
+    int_type underflow() override {
+        before_read_();
+        return input_->sgetc();
+    }
+
+    int_type uflow() override {
+        before_read_();
+        return input_->sbumpc();
+    }
+
+private:
+    streambuf* input_;
+    function<void()> before_read_;
+};
+
+bool IsChange(const string& line) {
+    const size_t begin = line.find_first_not_of(" \t");
+    if (begin == string::npos) {
+        return false;
+    }
+    const size_t end = min(line.find_first_of(" \t", begin), line.size());
+    const string command = line.substr(begin, end - begin);
+    return command == "CHANGE" || command == "change" || command == "Change";
+}
+
+//CHANGE читает логин и пароль из input сама, после своих приглашений: пачка с ней уходит сразу,
+//а чтение ждёт, пока changes_done не догонит число отправленных CHANGE
+void ReadCommands(istream& input, SpscRing<CommandBatch>& commands, size_t batch_size,
+                  const atomic<size_t>& changes_done, Doorbell& doorbell) {
+    CommandBatch batch;
+    size_t changes = 0;
+    for (string line; getline(input, line);) {
+        const bool change = IsChange(line);
+        batch.lines.push_back(move(line));
+        if (change || batch.lines.size() >= batch_size || input.rdbuf()->in_avail() <= 0) {
+            Push(commands, move(batch), doorbell);
+            batch = CommandBatch();
+        }
+        if (change) {
+            ++changes;
+            doorbell.Wait([&] {return changes_done.load(memory_order_acquire) >= changes;});
+        }
+    }
+    batch.last = true;
+    Push(commands, move(batch), doorbell);
+}
+
+void WriteOutput(ostream& output, SpscRing<OutputChunk>& outputs, Doorbell& doorbell) {
+    OutputChunk chunk;
+    while (true) {
+        if (outputs.TryPop(chunk)) {
+            doorbell.Ring();
+        } else {
+            output.flush();//ответов больше нет: отдаём накопленное, пока следующие готовятся
+            Pop(outputs, chunk, doorbell);
+        }
+        output.write(chunk.text.data(), chunk.text.size());
+        if (chunk.written) {
+            output.flush();
+            chunk.written->store(true, memory_order_release);
+            doorbell.Ring();
+        }
+        if (chunk.last) {
+            output.flush();
+            return;
+        }
+    }
+}
+
+}
+
+void RunPipeline(istream& input, ostream& output, const CommandExecutor& execute, const PipelineOptions& options) {
+    SpscRing<CommandBatch> commands(options.queue_capacity);
+    SpscRing<OutputChunk> outputs(options.queue_capacity);
+    atomic<size_t> changes_done{0};
+    Doorbell doorbell;
+    thread reader([&] {ReadCommands(input, commands, options.batch_size, changes_done, doorbell);});
+    thread writer([&] {WriteOutput(output, outputs, doorbell);});
+
+    StringOutput buffer;
+    ostream out(&buffer);
+    //выводит накопленное и ждёт, пока поток записи его не выведет
+    PromptedInput prompted(input.rdbuf(), [&] {
+        out.flush();
+        atomic<bool> written{false};
+        OutputChunk chunk{buffer.Take(), false, &written};
+        if (chunk.text.empty()) {
+            return;
+        }
+        Push(outputs, move(chunk), doorbell);
+        doorbell.Wait([&] {return written.load(memory_order_acquire);});
+    });
+    istream credentials(&prompted);
+    istringstream no_credentials;
+    CommandBatch batch;
+    do {
+        Pop(commands, batch, doorbell);
+        for (const string& line : batch.lines) {
+            if (IsChange(line)) {
+                credentials.clear();
+                execute(line, credentials, out);
+                changes_done.fetch_add(1, memory_order_release);
+                doorbell.Ring();
+            } else {
+                execute(line, no_credentials, out);
+            }
+        }
+        OutputChunk chunk{buffer.Take(), batch.last};
+        if (!chunk.text.empty() || chunk.last) {
+            Push(outputs, move(chunk), doorbell);
+        }
+    } while (!batch.last);
+
+    reader.join();
+    writer.join();
+}
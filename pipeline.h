@@ -0,0 +1,24 @@
+#pragma once
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//Выполняет одну строку ввода: credentials - откуда CHANGE читает логин и пароль, out - куда пишется ответ
+using CommandExecutor = function<void(const string& line, istream& credentials, ostream& out)>;
+
+struct PipelineOptions {
+    size_t batch_size = 256;//строк в пачке, если ввод идёт сплошным потоком
+    size_t queue_capacity = 64;//пачек между соседними стадиями
+};
+
+//Конвейерный режим REPL: поток чтения режет ввод на пачки строк, текущий поток выполняет их
+//по порядку через execute, поток записи выводит ответы. Между стадиями - кольцевые буферы
+//без блокировок (spsc_ring.h). Команды выполняются строго в порядке ввода, ответы выводятся
+//в том же порядке; пачка уходит дальше, как только прочитанный ввод исчерпан, так что
+//в интерактивном режиме ответ не ждёт заполнения пачки.
+//CHANGE читает логин и пароль из следующих слов ввода: поток чтения останавливается на ней,
+//а выполняющий поток выводит её приглашения и читает ответы на них из input сам.
+void RunPipeline(istream& input, ostream& output, const CommandExecutor& execute,
+                 const PipelineOptions& options = {});
@@ -0,0 +1,203 @@
+#pragma once
+#include "node.h"
+#include "condition_parser.h"
+#include "event_match.h"
+#include "date_match.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//Предикаты для частых форм условий. В отличие от лямбды с shared_ptr<Node>
+//это обычные значения без виртуальных вызовов, поэтому FindIf/RemoveIf,
+//инстанцированные ими, полностью встраиваются компилятором.
+
+class DateRangePredicate {
+public:
+    DateRangePredicate(int from, int to) : from_(from), to_(to) {}
+
+    bool Contains(const Date& date) const {
+        const int packed = date.GetPacked();
+        return from_ <= packed && packed <= to_;
+    }
+
+    bool operator()(const Date& date, const string&) const {
+        return Contains(date);
+    }
+
+    void SelectEvents(const Date& date, const EventColumn& column, Bitmap& selection) const {
+        if (Contains(date))
+            FillBitmap(selection, column.size());
+        else
+            ClearBitmap(selection, column.size());
+    }
+
+    bool DatesOnly() const {
+        return true;
+    }
+
+    void SelectDates(const int* dates, size_t count, Bitmap& selection) const {
+        MatchDateRange(dates, count, from_, to_, selection);
+    }
+
+    pair<int, int> DateBounds() const {
+        return {from_, to_};
+    }
+
+    bool DateBoundsExact() const {
+        return true;
+    }
+
+private:
+    int from_;
+    int to_;
+};
+
+class EventEqualPredicate {
+public:
+    explicit EventEqualPredicate(string event) : event_(move(event)) {}
+
+    bool operator()(const Date&, const string& event) const {
+        return event == event_;
+    }
+
+    void SelectEvents(const Date&, const EventColumn& column, Bitmap& selection) const {
+        ClearBitmap(selection, column.size());
+        MatchEventEqual(column, id_.Resolve(column.Dictionary(), event_), selection);
+    }
+
+    //false - события нет в столбце по его фильтру Блума (EventColumn::MayContain), дата пропускается
+    bool MayMatch(const EventColumn& column, size_t bits_per_key) const {
+        return column.MayContain(id_.Resolve(column.Dictionary(), event_), bits_per_key);
+    }
+
+private:
+    string event_;
+    EventIdCache id_;
+};
+
+class DateRangeAndEventPredicate {
+public:
+    DateRangeAndEventPredicate(int from, int to, string event) : dates_(from, to), event_(move(event)) {}
+
+    bool operator()(const Date& date, const string& event) const {
+        return dates_.Contains(date) && event_(date, event);
+    }
+
+    void SelectEvents(const Date& date, const EventColumn& column, Bitmap& selection) const {
+        if (dates_.Contains(date))
+            event_.SelectEvents(date, column, selection);
+        else
+            ClearBitmap(selection, column.size());
+    }
+
+    bool MayMatch(const EventColumn& column, size_t bits_per_key) const {
+        return event_.MayMatch(column, bits_per_key);
+    }
+
+    pair<int, int> DateBounds() const {
+        return dates_.DateBounds();
+    }
+
+private:
+    DateRangePredicate dates_;
+    EventEqualPredicate event_;
+};
+
+class EventOneOfPredicate {
+public:
+    explicit EventOneOfPredicate(vector<string> events) : events_(move(events)), ids_(events_.size()) {}
+
+    bool operator()(const Date&, const string& event) const {
+        return any_of(events_.begin(), events_.end(), [&event](const string& e) {
+            return e == event;
+        });
+    }
+
+    void SelectEvents(const Date&, const EventColumn& column, Bitmap& selection) const {
+        ClearBitmap(selection, column.size());
+        for (size_t i = 0; i < events_.size(); ++i) {
+            MatchEventEqual(column, ids_[i].Resolve(column.Dictionary(), events_[i]), selection);
+        }
+    }
+
+    bool MayMatch(const EventColumn& column, size_t bits_per_key) const {
+        for (size_t i = 0; i < events_.size(); ++i) {
+            if (column.MayContain(ids_[i].Resolve(column.Dictionary(), events_[i]), bits_per_key))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    vector<string> events_;
+    vector<EventIdCache> ids_;
+};
+
+//общий путь: произвольное дерево условий
+class NodePredicate {
+public:
+    explicit NodePredicate(shared_ptr<Node> condition)
+            : condition_(move(condition)), dates_only_(!condition_->UsesEvents()),
+              bounds_(ConditionDateRange(condition_)),
+              bounds_exact_(dates_only_ && AnalyzeCondition(condition_).type == ConditionShapeType::DateRange) {}
+
+    bool operator()(const Date& date, const string& event) const {
+        return condition_->Evaluate(date, event);
+    }
+
+    void SelectEvents(const Date& date, const EventColumn& column, Bitmap& selection) const {
+        EventBatch batch;
+        batch.date = date.GetPacked();
+        batch.events = &column;
+        batch.size = column.size();
+        condition_->EvaluateBatch(batch, selection);
+    }
+
+    bool DatesOnly() const {
+        return dates_only_;
+    }
+
+    void SelectDates(const int* dates, size_t count, Bitmap& selection) const {
+        EventBatch batch;
+        batch.dates = dates;
+        batch.size = count;
+        condition_->EvaluateBatch(batch, selection);
+    }
+
+    //даты вне диапазона условие не выбирает (ConditionDateRange)
+    pair<int, int> DateBounds() const {
+        return bounds_;
+    }
+
+    //условие - конъюнкция сравнений даты и выбирает все даты диапазона
+    bool DateBoundsExact() const {
+        return bounds_exact_;
+    }
+
+private:
+    shared_ptr<Node> condition_;
+    bool dates_only_;
+    pair<int, int> bounds_;
+    bool bounds_exact_;
+};
+
+//Выбирает предикат по форме условия один раз и вызывает callback(predicate).
+//callback обычно - обобщённая лямбда вида [&](auto predicate){ return db.FindIf(predicate); }
+template <typename Callback>
+auto DispatchCondition(const shared_ptr<Node>& condition, Callback callback)
+        -> decltype(callback(NodePredicate(condition))) {
+    ConditionShape shape = AnalyzeCondition(condition);
+    switch (shape.type) {
+        case ConditionShapeType::DateRange:
+            return callback(DateRangePredicate(shape.date_from, shape.date_to));
+        case ConditionShapeType::EventEqual:
+            return callback(EventEqualPredicate(move(shape.events.front())));
+        case ConditionShapeType::DateRangeAndEvent:
+            return callback(DateRangeAndEventPredicate(shape.date_from, shape.date_to, move(shape.events.front())));
+        case ConditionShapeType::EventOneOf:
+            return callback(EventOneOfPredicate(move(shape.events)));
+        default:
+            return callback(NodePredicate(condition));
+    }
+}
@@ -0,0 +1,93 @@
+#include "result_cache.h"
+
+namespace {
+
+size_t ResultMemory(const string& key, const vector<string>& result) {
+    size_t memory = key.capacity() + result.capacity() * sizeof(string);
+    for (const string& line : result) {
+        memory += line.capacity();
+    }
+    return memory;
+}
+
+}
+
+const size_t ResultCache::DEFAULT_MAX_MEMORY;
+
+ResultCache::ResultCache(size_t capacity, size_t max_memory) : capacity_(capacity), max_memory_(max_memory) {}
+
+ResultCache::Result ResultCache::Find(const string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    lru_.splice(lru_.begin(), lru_, entries_[it->second]);
+    return entries_[it->second]->result;
+}
+
+void ResultCache::Insert(const string& key, int date_from, int date_to, Result result) {
+    const size_t memory = ResultMemory(key, *result);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        Erase(it->second);
+    }
+    if (capacity_ == 0 || memory > max_memory_) {
+        return;
+    }
+    while (entries_.size() == capacity_ || memory_ + memory > max_memory_) {
+        auto last = index_.find(lru_.back().key);
+        Erase(last->second);
+        ++stats_.evicted;
+    }
+    lru_.push_front({key, move(result), memory});
+    memory_ += memory;
+    index_[key] = entries_.size();
+    from_.push_back(date_from);
+    to_.push_back(date_to);
+    entries_.push_back(lru_.begin());
+}
+
+void ResultCache::Invalidate(int date_from, int date_to) {
+    for (size_t slot = 0; slot < entries_.size();) {
+        if (from_[slot] <= date_to && date_from <= to_[slot]) {
+            Erase(slot);//на место slot встаёт последняя запись, её тоже нужно проверить
+            ++stats_.invalidated;
+        } else {
+            ++slot;
+        }
+    }
+}
+
+void ResultCache::Clear() {
+    lru_.clear();
+    index_.clear();
+    from_.clear();
+    to_.clear();
+    entries_.clear();
+    memory_ = 0;
+}
+
+ResultCacheStats ResultCache::Stats() const {
+    ResultCacheStats stats = stats_;
+    stats.entries = entries_.size();
+    stats.memory = memory_;
+    return stats;
+}
+
+void ResultCache::Erase(size_t slot) {
+    const size_t last = entries_.size() - 1;
+    memory_ -= entries_[slot]->memory;
+    index_.erase(entries_[slot]->key);
+    lru_.erase(entries_[slot]);
+    if (slot != last) {
+        from_[slot] = from_[last];
+        to_[slot] = to_[last];
+        entries_[slot] = entries_[last];
+        index_[entries_[slot]->key] = slot;
+    }
+    from_.pop_back();
+    to_.pop_back();
+    entries_.pop_back();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct ResultCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t invalidated = 0;//записи, выброшенные из-за изменений в их диапазоне дат
+    size_t evicted = 0;//записи, вытесненные по LRU
+    size_t entries = 0;
+    size_t memory = 0;//байт в строках результатов и ключах
+};
+
+//Ограниченный LRU-кэш результатов Find: не больше capacity записей и max_memory байт в них
+//(результат крупнее max_memory не кэшируется). Ключ - каноническая запись условия (CanonicalCondition),
+//у каждой записи - диапазон дат условия (ConditionDateRange). Изменение даты d выбрасывает
+//только записи, в диапазон которых d попадает; для этого хватает прохода по плотному массиву границ.
+class ResultCache {
+public:
+    using Result = shared_ptr<const vector<string>>;
+
+    static const size_t DEFAULT_MAX_MEMORY = 64u << 20;
+
+    explicit ResultCache(size_t capacity = 64, size_t max_memory = DEFAULT_MAX_MEMORY);
+
+    //результат или nullptr
+    Result Find(const string& key);
+    void Insert(const string& key, int date_from, int date_to, Result result);
+    //даты [date_from, date_to] изменились
+    void Invalidate(int date_from, int date_to);
+    void Clear();
+
+    bool empty() const {return entries_.empty();}
+    ResultCacheStats Stats() const;
+
+private:
+    struct Entry {
+        string key;
+        Result result;
+        size_t memory;
+    };
+    using Lru = list<Entry>;
+
+    void Erase(size_t slot);
+
+    size_t capacity_;
+    size_t max_memory_;
+    Lru lru_;//в начале - последние использованные
+    unordered_map<string, size_t> index_;//ключ -> номер в entries_
+    //параллельные массивы записей: проверка диапазонов при изменении - линейный проход без указателей
+    vector<int> from_;
+    vector<int> to_;
+    vector<Lru::iterator> entries_;
+    size_t memory_ = 0;
+    ResultCacheStats stats_;
+};
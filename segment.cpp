@@ -0,0 +1,328 @@
+#include "segment.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <streambuf>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const size_t SegmentBudget::DEFAULT_LIMIT;
+
+namespace {
+
+//файл, отображённый в память только для чтения: mmap в POSIX, MapViewOfFile в Windows
+class MappedFile {
+public:
+#ifdef _WIN32
+    explicit MappedFile(const string& path) {
+        const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw runtime_error("Cannot open file: " + path);
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw runtime_error("Cannot stat file: " + path);
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_) {
+            const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                data_ = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);//отображение держится открытым видом
+            }
+        }
+        CloseHandle(file);
+        if (size_ && !data_) {
+            throw runtime_error("Cannot map file: " + path);
+        }
+    }
+
+    ~MappedFile() {
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+    }
+#else
+    explicit MappedFile(const string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open file: " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw runtime_error("Cannot stat file: " + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        void* data = size_ ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw runtime_error("Cannot map file: " + path);
+        }
+        data_ = static_cast<const char*>(data);
+        if (data_) {
+            madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    ~MappedFile() {
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {return data_;}
+    size_t size() const {return size_;}
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+//istream поверх отображённой памяти: ExportReader читает блоки без копирования файла в буфер потока
+class MemoryBuffer : public streambuf {
+public:
+    MemoryBuffer(const char* data, size_t size) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    //позиционирование нужно ExportReader, чтобы сверять длины блоков с размером файла
+    pos_type seekoff(off_type offset, ios_base::seekdir dir, ios_base::openmode which) override {
+        if (!(which & ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+        const off_type base = dir == ios_base::beg ? 0 : dir == ios_base::cur ? gptr() - eback() : egptr() - eback();
+        const off_type target = base + offset;
+        if (target < 0 || target > egptr() - eback()) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + target, egptr());
+        return pos_type(target);
+    }
+
+    pos_type seekpos(pos_type position, ios_base::openmode which) override {
+        return seekoff(off_type(position), ios_base::beg, which);
+    }
+};
+
+//Новый пустой файл сегмента в directory. Имя - номер процесса, метка steady_clock и счётчик,
+//а файл создаётся только если его ещё нет (O_EXCL, CREATE_NEW): сегмент другого процесса
+//в том же каталоге - единственная копия его раздела - не перезаписывается и при совпадении имён
+string CreateSegmentFile(const string& directory) {
+    static atomic<size_t> counter{0};
+#ifdef _WIN32
+    const unsigned long process = GetCurrentProcessId();
+#else
+    const long process = static_cast<long>(getpid());
+#endif
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        const string path = (filesystem::path(directory) / ("segment_" + to_string(process) + "_"
+                + to_string(chrono::steady_clock::now().time_since_epoch().count()) + "_"
+                + to_string(counter++) + ".bin")).string();
+#ifdef _WIN32
+        const HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+            return path;
+        }
+        if (GetLastError() != ERROR_FILE_EXISTS) {
+            break;
+        }
+#else
+        const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) {
+            close(fd);
+            return path;
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+#endif
+    }
+    throw runtime_error("Cannot create segment file in " + directory);
+}
+
+}
+
+Segment::Builder::Builder(const string& directory)
+        : segment_(new Segment(CreateSegmentFile(directory))),
+          output_(segment_->path_, ios::binary | ios::trunc),
+          writer_(output_) {
+    if (!output_) {
+        throw runtime_error("Cannot open file: " + segment_->path_);
+    }
+}
+
+void Segment::Builder::Append(int date, const string& event) {
+    if (segment_->dates_.empty() || segment_->dates_.back() != date) {
+        segment_->dates_.push_back(date);
+    }
+    writer_.Append(date, event);
+    segment_->last_event_ = event;
+    ++segment_->size_;
+}
+
+shared_ptr<const Segment> Segment::Builder::Finish() {
+    writer_.Finish();
+    segment_->file_size_ = static_cast<size_t>(output_.tellp());
+    output_.close();
+    if (!output_) {
+        throw runtime_error("Cannot write file: " + segment_->path_);
+    }
+    if (segment_->size_ == 0) {
+        return nullptr;//деструктор сегмента удалит пустой файл
+    }
+    segment_->dates_.shrink_to_fit();
+    return move(segment_);
+}
+
+Segment::~Segment() {
+    remove(path_.c_str());
+}
+
+void Segment::ForEachChunk(const function<void(const vector<int>&, const vector<string>&)>& f) const {
+    const MappedFile file(path_);
+    MemoryBuffer buffer(file.data(), file.size());
+    istream input(&buffer);
+    ExportReader reader(input);
+    vector<int> dates;
+    vector<string> events;
+    while (reader.NextChunk(dates, events)) {
+        f(dates, events);
+    }
+}
+
+SegmentBudget& SegmentBudget::Instance() {
+    static SegmentBudget budget;
+    return budget;
+}
+
+void SegmentBudget::SetLimit(size_t bytes) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        limit_ = bytes;
+    }
+    Shrink(nullptr);
+}
+
+size_t SegmentBudget::Limit() const {
+    lock_guard<mutex> lock(mutex_);
+    return limit_;
+}
+
+size_t SegmentBudget::Resident() const {
+    lock_guard<mutex> lock(mutex_);
+    return resident_;
+}
+
+size_t SegmentBudget::Evictions() const {
+    lock_guard<mutex> lock(mutex_);
+    return evictions_;
+}
+
+void SegmentBudget::Touch(const void* owner, int key, size_t bytes, Evict evict) {
+    const Entry* keep;
+    {
+        lock_guard<mutex> lock(mutex_);
+        const auto found = index_.find({owner, key});
+        if (found != index_.end()) {
+            resident_ -= found->second->bytes;
+            found->second->bytes = bytes;
+            lru_.splice(lru_.begin(), lru_, found->second);
+        } else {
+            lru_.push_front({owner, key, bytes, evict});
+            index_[{owner, key}] = lru_.begin();
+        }
+        resident_ += bytes;
+        if (resident_ <= limit_) {
+            return;
+        }
+        keep = &lru_.front();
+    }
+    Shrink(keep);
+}
+
+void SegmentBudget::Forget(const void* owner, int key) {
+    lock_guard<mutex> lock(mutex_);
+    const auto found = index_.find({owner, key});
+    if (found != index_.end()) {
+        Erase(found->second);
+    }
+}
+
+void SegmentBudget::ForgetOwner(const void* owner) {
+    lock_guard<mutex> lock(mutex_);
+    for (auto entry = lru_.begin(); entry != lru_.end();) {
+        const auto current = entry++;
+        if (current->owner == owner) {
+            Erase(current);
+        }
+    }
+}
+
+void SegmentBudget::SwapOwners(const void* first, const void* second) {
+    lock_guard<mutex> lock(mutex_);
+    bool changed = false;
+    for (Entry& entry : lru_) {
+        if (entry.owner == first || entry.owner == second) {
+            entry.owner = entry.owner == first ? second : first;
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    index_.clear();
+    for (auto entry = lru_.begin(); entry != lru_.end(); ++entry) {
+        index_[{entry->owner, entry->key}] = entry;
+    }
+}
+
+void SegmentBudget::Erase(list<Entry>::iterator entry) {
+    resident_ -= entry->bytes;
+    index_.erase({entry->owner, entry->key});
+    lru_.erase(entry);
+}
+
+void SegmentBudget::Shrink(const Entry* keep) {
+    vector<Entry> victims;
+    {
+        lock_guard<mutex> lock(mutex_);
+        while (resident_ > limit_ && !lru_.empty() && &lru_.back() != keep) {
+            victims.push_back(lru_.back());
+            Erase(prev(lru_.end()));
+        }
+    }
+    for (const Entry& victim : victims) {
+        if (victim.evict(victim.owner, victim.key)) {
+            lock_guard<mutex> lock(mutex_);
+            ++evictions_;
+        } else {
+            lock_guard<mutex> lock(mutex_);//остаётся в памяти и снова учитывается
+            lru_.push_front(victim);
+            index_[{victim.owner, victim.key}] = lru_.begin();
+            resident_ += victim.bytes;
+        }
+    }
+}
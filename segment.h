@@ -0,0 +1,109 @@
+#pragma once
+#include "export_format.h"
+
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Неизменяемый файл холодного раздела Database (Database::SetTiering) в формате Export (export_format.h).
+//В памяти остаются даты раздела, число событий и последнее событие: этого хватает, чтобы отсечь
+//раздел по датам условия и ответить Last на более поздние даты, не читая файл.
+//Файл читается через отображение в память (mmap или MapViewOfFile) и удаляется вместе с сегментом.
+class Segment {
+public:
+    //Запись нового сегмента: события подаются по возрастанию дат, внутри даты - в порядке добавления
+    class Builder {
+    public:
+        //файл с новым уникальным именем в directory; runtime_error, если его не удалось создать
+        explicit Builder(const string& directory);
+
+        void Append(int date, const string& event);
+        //nullptr, если не было ни одного события (файл тогда не остаётся);
+        //runtime_error, если файл не удалось записать
+        shared_ptr<const Segment> Finish();
+
+    private:
+        shared_ptr<Segment> segment_;
+        ofstream output_;
+        ExportWriter writer_;
+    };
+
+    Segment(const Segment&) = delete;
+    Segment& operator=(const Segment&) = delete;
+    ~Segment();
+
+    const vector<int>& Dates() const {return dates_;}
+    int First() const {return dates_.front();}
+    int Last() const {return dates_.back();}
+    size_t size() const {return size_;}
+    //последнее событие последней даты
+    const string& LastEvent() const {return last_event_;}
+    size_t FileSize() const {return file_size_;}
+
+    //f(dates, events) для блоков файла по порядку; файл отображается в память на время чтения
+    void ForEachChunk(const function<void(const vector<int>&, const vector<string>&)>& f) const;
+
+private:
+    explicit Segment(const string& path) : path_(path) {}
+
+    string path_;
+    vector<int> dates_;
+    size_t size_ = 0;
+    string last_event_;
+    size_t file_size_ = 0;
+};
+
+//Общий на процесс бюджет памяти подгруженных холодных разделов всех баз. Разделы стоят
+//в очереди LRU; когда сумма их размеров превышает лимит, самые давно использованные выгружаются
+//через evict(owner, key) своей базы. Вытеснение трогает разделы чужих баз, поэтому базы
+//с холодными разделами используются из одного потока, как в REPL.
+class SegmentBudget {
+public:
+    static const size_t DEFAULT_LIMIT = 256u << 20;
+
+    //false - выгрузить не удалось (например, не записался сегмент): раздел остаётся в памяти
+    using Evict = bool (*)(const void* owner, int key);
+
+    static SegmentBudget& Instance();
+
+    //новый лимит сразу вытесняет лишнее
+    void SetLimit(size_t bytes);
+    size_t Limit() const;
+    size_t Resident() const;
+    size_t Evictions() const;
+
+    //раздел использован и занимает bytes: он становится самым новым, а лишнее вытесняется -
+    //кроме него самого, даже если он один больше лимита
+    void Touch(const void* owner, int key, size_t bytes, Evict evict);
+    void Forget(const void* owner, int key);
+    void ForgetOwner(const void* owner);
+    //после обмена содержимым баз (Database::swap) их разделы меняются владельцами
+    void SwapOwners(const void* first, const void* second);
+
+private:
+    struct Entry {
+        const void* owner;
+        int key;
+        size_t bytes;
+        Evict evict;
+    };
+
+    SegmentBudget() = default;
+    //снимает с очереди лишние записи под mutex_, а выгружает их уже без него
+    void Shrink(const Entry* keep);
+    void Erase(list<Entry>::iterator entry);
+
+    mutable mutex mutex_;
+    list<Entry> lru_;//от новых к старым
+    map<pair<const void*, int>, list<Entry>::iterator> index_;
+    size_t limit_ = DEFAULT_LIMIT;
+    size_t resident_ = 0;
+    size_t evictions_ = 0;
+};
@@ -0,0 +1,68 @@
+#include "simd_dispatch.h"
+
+#include <cstdlib>
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+
+//CPUID: SSE2 - бит 26 EDX листа 1, AVX2 - бит 5 EBX листа 7. Для AVX2 нужна и ОС:
+//OSXSAVE и AVX в ECX листа 1 и сохранение регистров XMM и YMM в XCR0
+bool CpuidSupports(SimdLevel level) {
+    int info[4];
+    __cpuid(info, 0);
+    const int leaves = info[0];
+    __cpuid(info, 1);
+    if (level == SimdLevel::Sse2) {
+        return (info[3] & (1 << 26)) != 0;
+    }
+    const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (!avx || leaves < 7) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+#endif
+
+SimdLevel DetectSimdLevel() {
+    if (getenv("SIMD_SCALAR")) {
+        return SimdLevel::Scalar;
+    }
+    if (SimdLevelSupported(SimdLevel::Avx2)) {
+        return SimdLevel::Avx2;
+    }
+    if (SimdLevelSupported(SimdLevel::Sse2)) {
+        return SimdLevel::Sse2;
+    }
+    return SimdLevel::Scalar;
+}
+
+}
+
+bool SimdLevelSupported(SimdLevel level) {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    if (level == SimdLevel::Avx2 || level == SimdLevel::Sse2) {
+        return CpuidSupports(level);
+    }
+#elif defined(SIMD_X86)
+    if (level == SimdLevel::Avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (level == SimdLevel::Sse2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return level == SimdLevel::Scalar;
+}
+
+SimdLevel ActiveSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
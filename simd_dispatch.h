@@ -0,0 +1,26 @@
+#pragma once
+
+//Уровень векторных инструкций для ядер сравнения (event_match.h, date_match.h).
+//Выбирается один раз по возможностям процессора; SIMD_SCALAR в окружении
+//принудительно включает скалярные реализации.
+
+//Ядра SSE2 и AVX2 собираются для x86 на GCC, Clang и MSVC. GCC и Clang включают набор
+//инструкций для одной функции атрибутом target (SIMD_TARGET), MSVC разрешает их без флагов
+#if (defined(__GNUC__) || defined(_MSC_VER)) && \
+    (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define SIMD_X86
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+enum class SimdLevel {
+    Scalar, Sse2, Avx2
+};
+
+SimdLevel ActiveSimdLevel();
+
+bool SimdLevelSupported(SimdLevel level);
@@ -0,0 +1,75 @@
+#include "slow_query_log.h"
+
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const auto IDLE_SLEEP = chrono::milliseconds(5);
+
+double Microseconds(chrono::nanoseconds duration) {
+    return duration.count() / 1000.0;
+}
+
+}
+
+string FormatQueryTrace(const QueryTrace& trace) {
+    ostringstream line;
+    line << fixed << setprecision(1) << "total_us=" << Microseconds(trace.total) << " command=" << trace.command
+         << " account=" << trace.account << " tokenize_us=" << Microseconds(trace.tokenize)
+         << " parse_us=" << Microseconds(trace.parse) << " plan_us=" << Microseconds(trace.plan) << " scan_us=" << Microseconds(trace.scan)
+         << " format_us=" << Microseconds(trace.format) << " write_us=" << Microseconds(trace.write)
+         << " dates_visited=" << trace.dates_visited << " rows_scanned=" << trace.rows_scanned << " rows_returned=" << trace.rows_returned << " text=\"";
+    for (char c : trace.text) {
+        if (c == '"' || c == '\\') {
+            line << '\\';
+        }
+        line << c;
+    }
+    line << '"';
+    return line.str();
+}
+
+SlowQueryLog::SlowQueryLog(const string& path, chrono::nanoseconds threshold, size_t capacity)
+        : threshold_(threshold), output_(path, ios::app), ring_(capacity) {
+    if (!output_) {
+        throw runtime_error("Cannot open file: " + path);
+    }
+    writer_ = thread([this] {Run();});
+}
+
+SlowQueryLog::~SlowQueryLog() {
+    stop_.store(true, memory_order_release);
+    writer_.join();
+}
+
+void SlowQueryLog::Submit(QueryTrace&& trace) {
+    if (trace.total < threshold_) {
+        return;
+    }
+    if (!ring_.TryPush(move(trace))) {
+        dropped_.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void SlowQueryLog::Run() {
+    while (!stop_.load(memory_order_acquire)) {
+        Drain();
+        this_thread::sleep_for(IDLE_SLEEP);
+    }
+    Drain();//записи, отданные до остановки
+}
+
+void SlowQueryLog::Drain() {
+    QueryTrace trace;
+    bool any = false;
+    while (ring_.TryPop(trace)) {
+        output_ << FormatQueryTrace(trace) << '\n';
+        written_.fetch_add(1, memory_order_relaxed);
+        any = true;
+    }
+    if (any) {
+        output_.flush();
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+//Запись журнала медленных запросов: время по фазам выполнения команды
+struct QueryTrace {
+    string command;
+    string account;
+    string text;//условие или аргументы команды как введены
+    chrono::nanoseconds tokenize{0};
+    chrono::nanoseconds parse{0};//ParseExpression
+    chrono::nanoseconds plan{0};//LIMIT/OFFSET/DESC и выбор предиката по дереву условия (DispatchCondition)
+    chrono::nanoseconds scan{0};//работа базы: FindIf, RemoveIf, LastMany
+    chrono::nanoseconds format{0};//сборка текста ответа
+    chrono::nanoseconds write{0};//вывод ответа в поток
+    chrono::nanoseconds total{0};
+    uint64_t dates_visited = 0;
+    uint64_t rows_scanned = 0;//события, проверенные условием по одному
+    uint64_t rows_returned = 0;
+};
+
+//Секундомер фаз команды: Lap прибавляет к фазе время с предыдущей отметки.
+//Выключенный не читает часы, так что без журнала команды ничего не платят
+class PhaseClock {
+public:
+    explicit PhaseClock(bool enabled)
+            : enabled_(enabled), start_(enabled ? chrono::steady_clock::now() : chrono::steady_clock::time_point()),
+              last_(start_) {}
+
+    void Lap(chrono::nanoseconds& phase) {
+        if (enabled_) {
+            const auto now = chrono::steady_clock::now();
+            phase += chrono::duration_cast<chrono::nanoseconds>(now - last_);
+            last_ = now;
+        }
+    }
+
+    chrono::nanoseconds Total() const {
+        return chrono::duration_cast<chrono::nanoseconds>(last_ - start_);
+    }
+
+private:
+    bool enabled_;
+    chrono::steady_clock::time_point start_;
+    chrono::steady_clock::time_point last_;
+};
+
+//Журнал медленных запросов. Команда передаёт запись через кольцевой буфер без блокировок,
+//в файл её пишет фоновый поток; при переполненном буфере запись отбрасывается и учитывается
+//в Dropped, команда никогда не ждёт диска.
+class SlowQueryLog {
+public:
+    SlowQueryLog(const string& path, chrono::nanoseconds threshold, size_t capacity = 1024);
+    //дописывает оставшиеся записи и останавливает поток
+    ~SlowQueryLog();
+
+    SlowQueryLog(const SlowQueryLog&) = delete;
+    SlowQueryLog& operator=(const SlowQueryLog&) = delete;
+
+    chrono::nanoseconds Threshold() const {return threshold_;}
+
+    //записывает trace, если trace.total не меньше порога; вызывается из одного потока
+    void Submit(QueryTrace&& trace);
+
+    uint64_t Written() const {return written_.load(memory_order_relaxed);}
+    uint64_t Dropped() const {return dropped_.load(memory_order_relaxed);}
+
+private:
+    void Run();
+    void Drain();
+
+    chrono::nanoseconds threshold_;
+    ofstream output_;
+    SpscRing<QueryTrace> ring_;
+    atomic<bool> stop_{false};
+    atomic<uint64_t> written_{0};
+    atomic<uint64_t> dropped_{0};
+    thread writer_;
+};
+
+//строка журнала: поля key=value, текст условия в кавычках
+string FormatQueryTrace(const QueryTrace& trace);
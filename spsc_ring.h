@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//Кольцевой буфер без блокировок для одного писателя и одного читателя. Ёмкость - степень двойки.
+//Писатель и читатель владеют каждый своим индексом; чужой индекс читается с acquire,
+//свой публикуется с release, поэтому элемент виден читателю целиком.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots_(RoundUp(capacity)), mask_(slots_.size() - 1) {}
+
+    //false, если буфер полон: писатель не ждёт читателя
+    bool TryPush(T&& value) {
+        const size_t tail = tail_.load(memory_order_relaxed);
+        if (tail - head_.load(memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+        slots_[tail & mask_] = move(value);
+        tail_.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value) {
+        const size_t head = head_.load(memory_order_relaxed);
+        if (head == tail_.load(memory_order_acquire)) {
+            return false;
+        }
+        value = move(slots_[head & mask_]);
+        head_.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const {return slots_.size();}
+
+private:
+    static size_t RoundUp(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    vector<T> slots_;
+    const size_t mask_;
+    alignas(64) atomic<size_t> head_{0};//следующий элемент для читателя
+    alignas(64) atomic<size_t> tail_{0};//следующее место для писателя
+};
@@ -0,0 +1,146 @@
+#include "stats.h"
+#include "bit_ops.h"
+
+#include <iomanip>
+
+const size_t LatencyHistogram::BUCKETS;
+const uint32_t Stats::PARSE_SAMPLE;
+
+void LatencyHistogram::Record(chrono::nanoseconds latency) {
+    const uint64_t ns = static_cast<uint64_t>(max<chrono::nanoseconds::rep>(latency.count(), 0));
+    const size_t bucket = ns == 0 ? 0 : min<size_t>(BUCKETS - 1, HighestBit(ns));
+    buckets_[bucket].fetch_add(1, memory_order_relaxed);
+    count_.fetch_add(1, memory_order_relaxed);
+    total_.fetch_add(ns, memory_order_relaxed);
+    uint64_t previous = max_.load(memory_order_relaxed);
+    while (ns > previous && !max_.compare_exchange_weak(previous, ns, memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::MeanNanoseconds() const {
+    const uint64_t count = Count();
+    return count ? static_cast<double>(total_.load(memory_order_relaxed)) / count : 0.0;
+}
+
+double LatencyHistogram::PercentileNanoseconds(double p) const {
+    const uint64_t count = Count();
+    if (count == 0) {
+        return 0.0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(p * (count - 1));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += buckets_[bucket].load(memory_order_relaxed);
+        if (seen > rank) {
+            return min(static_cast<double>(MaxNanoseconds()), static_cast<double>(uint64_t(2) << bucket));
+        }
+    }
+    return static_cast<double>(MaxNanoseconds());
+}
+
+Stats& Stats::Instance() {
+    static Stats stats;
+    return stats;
+}
+
+void Stats::RecordCommand(const string& command, chrono::nanoseconds latency) {
+    LatencyHistogram* histogram;
+    {
+        lock_guard<mutex> lock(commands_mutex_);
+        histogram = &commands_[command];//узлы map не перемещаются
+    }
+    histogram->Record(latency);
+}
+
+void Stats::RecordParse(chrono::nanoseconds latency) {
+    parse_.Record(latency);
+}
+
+ScanCounters& Stats::ThreadScan() {
+    static thread_local ScanCounters counters;
+    return counters;
+}
+
+void Stats::RecordScan(const ScanCounters& counters) {
+    ScanCounters& thread_scan = ThreadScan();
+    thread_scan.dates_visited += counters.dates_visited;
+    thread_scan.events_scanned += counters.events_scanned;
+    thread_scan.events_matched += counters.events_matched;
+    thread_scan.filter_checks += counters.filter_checks;
+    thread_scan.filter_skips += counters.filter_skips;
+    if (!Enabled()) {
+        return;
+    }
+    scans_.fetch_add(1, memory_order_relaxed);
+    dates_visited_.fetch_add(counters.dates_visited, memory_order_relaxed);
+    events_scanned_.fetch_add(counters.events_scanned, memory_order_relaxed);
+    events_matched_.fetch_add(counters.events_matched, memory_order_relaxed);
+    filter_checks_.fetch_add(counters.filter_checks, memory_order_relaxed);
+    filter_skips_.fetch_add(counters.filter_skips, memory_order_relaxed);
+}
+
+ScanCounters Stats::ScanTotals() const {
+    ScanCounters counters;
+    counters.dates_visited = dates_visited_.load(memory_order_relaxed);
+    counters.events_scanned = events_scanned_.load(memory_order_relaxed);
+    counters.events_matched = events_matched_.load(memory_order_relaxed);
+    counters.filter_checks = filter_checks_.load(memory_order_relaxed);
+    counters.filter_skips = filter_skips_.load(memory_order_relaxed);
+    return counters;
+}
+
+namespace {
+
+void PrintHistogram(ostream& output, const string& name, const LatencyHistogram& histogram) {
+    output << "  " << name << ": count " << histogram.Count() << fixed << setprecision(1)
+           << ", mean " << histogram.MeanNanoseconds() / 1000 << " us, p50 <= "
+           << histogram.PercentileNanoseconds(0.5) / 1000 << " us, p99 <= "
+           << histogram.PercentileNanoseconds(0.99) / 1000 << " us, max "
+           << histogram.MaxNanoseconds() / 1000.0 << " us\n";
+    output << defaultfloat;
+}
+
+}
+
+void Stats::Print(ostream& output) const {
+    output << "commands:\n";
+    {
+        lock_guard<mutex> lock(commands_mutex_);
+        for (const auto& command : commands_) {
+            PrintHistogram(output, command.first, command.second);
+        }
+    }
+    output << "parser:\n";
+    PrintHistogram(output, "ParseCondition (1 in " + to_string(PARSE_SAMPLE) + " sampled)", parse_);
+    output << "scans: " << scans_.load(memory_order_relaxed)
+           << ", dates visited " << dates_visited_.load(memory_order_relaxed)
+           << ", events scanned " << events_scanned_.load(memory_order_relaxed)
+           << ", events matched " << events_matched_.load(memory_order_relaxed) << "\n";
+    const uint64_t checks = filter_checks_.load(memory_order_relaxed);
+    const uint64_t skips = filter_skips_.load(memory_order_relaxed);
+    output << "event filters: dates checked " << checks << ", skipped " << skips << ", skip rate "
+           << (checks ? 100.0 * skips / checks : 0.0) << "%\n";
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, memory_order_relaxed);
+    }
+    count_.store(0, memory_order_relaxed);
+    total_.store(0, memory_order_relaxed);
+    max_.store(0, memory_order_relaxed);
+}
+
+void Stats::Reset() {
+    lock_guard<mutex> lock(commands_mutex_);
+    for (auto& command : commands_) {//гистограммы не удаляются: на них могут ссылаться записывающие
+        command.second.Reset();
+    }
+    parse_.Reset();
+    scans_ = 0;
+    dates_visited_ = 0;
+    events_scanned_ = 0;
+    events_matched_ = 0;
+    filter_checks_ = 0;
+    filter_skips_ = 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+//Гистограмма задержек: корзина k - от 2^k до 2^(k+1) наносекунд. Запись - несколько
+//атомарных инкрементов без блокировок, перцентили оцениваются верхней границей корзины.
+class LatencyHistogram {
+public:
+    static const size_t BUCKETS = 48;
+
+    void Record(chrono::nanoseconds latency);
+    void Reset();
+
+    uint64_t Count() const {return count_.load(memory_order_relaxed);}
+    double MeanNanoseconds() const;
+    double PercentileNanoseconds(double p) const;
+    uint64_t MaxNanoseconds() const {return max_.load(memory_order_relaxed);}
+
+private:
+    array<atomic<uint64_t>, BUCKETS> buckets_{};
+    atomic<uint64_t> count_{0};
+    atomic<uint64_t> total_{0};
+    atomic<uint64_t> max_{0};
+};
+
+//счётчики одного прохода FindIf/RemoveIf и агрегатов, копятся в локальной переменной
+//и добавляются в статистику один раз за запрос
+struct ScanCounters {
+    uint64_t dates_visited = 0;
+    uint64_t events_scanned = 0;//события, проверенные условием по одному
+    uint64_t events_matched = 0;
+    uint64_t filter_checks = 0;//даты, проверенные фильтром Блума событий (EventColumn::MayContain)
+    uint64_t filter_skips = 0;//из них пропущенные без просмотра
+};
+
+//Статистика процесса для команды Stats. Включена всегда; SetEnabled(false) нужен
+//только для замера её собственной стоимости в db_bench
+class Stats {
+public:
+    static Stats& Instance();
+
+    bool Enabled() const {return enabled_.load(memory_order_relaxed);}
+    void SetEnabled(bool enabled) {enabled_.store(enabled, memory_order_relaxed);}
+
+    void RecordCommand(const string& command, chrono::nanoseconds latency);
+    //замеряется каждый PARSE_SAMPLE-й разбор условия
+    static const uint32_t PARSE_SAMPLE = 8;
+    void RecordParse(chrono::nanoseconds latency);
+    void RecordScan(const ScanCounters& counters);
+
+    ScanCounters ScanTotals() const;
+    //сумма проходов, выполненных этим потоком с последнего обнуления (журнал медленных запросов);
+    //копится и при выключенной статистике
+    static ScanCounters& ThreadScan();
+    const LatencyHistogram& ParseLatency() const {return parse_;}
+
+    void Print(ostream& output) const;
+    void Reset();
+
+private:
+    Stats() = default;
+
+    atomic<bool> enabled_{true};
+    mutable mutex commands_mutex_;//только для поиска гистограммы по имени команды
+    map<string, LatencyHistogram> commands_;
+    LatencyHistogram parse_;
+    atomic<uint64_t> scans_{0};
+    atomic<uint64_t> dates_visited_{0};
+    atomic<uint64_t> events_scanned_{0};
+    atomic<uint64_t> events_matched_{0};
+    atomic<uint64_t> filter_checks_{0};
+    atomic<uint64_t> filter_skips_{0};
+};
+
+//замер участка кода: записывает время жизни объекта через record(latency), если статистика включена
+//и sampled (для частых коротких операций замеряется лишь часть вызовов: часы читаются около 40 нс)
+template <typename Record>
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Record record, bool sampled = true)
+            : record_(record), enabled_(sampled && Stats::Instance().Enabled()),
+              start_(enabled_ ? chrono::steady_clock::now() : chrono::steady_clock::time_point()) {}
+
+    ~ScopedTimer() {
+        if (enabled_) {
+            record_(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_));
+        }
+    }
+
+private:
+    Record record_;
+    bool enabled_;
+    chrono::steady_clock::time_point start_;
+};
+
+template <typename Record>
+ScopedTimer<Record> MakeScopedTimer(Record record, bool sampled = true) {
+    return ScopedTimer<Record>(record, sampled);
+}
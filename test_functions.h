@@ -80,13 +80,6 @@ inline void Assert(bool b, const string &hint) {
     AssertEqual(b, true, hint);
 }
 
-std::string ParseEvent(std::istream &is) {
-    std::string res;
-    is >> std::ws;
-    std::getline(is, res);
-    return res;
-}
-
 class TestRunner {
 public:
     template<class TestFunc>
@@ -116,22 +109,51 @@ TestRunner::~TestRunner() {
     }
 }
 
+//Воспроизводимая последовательность для случайных тестов (LCG из MMIX): одинаковая на любой
+//платформе, Next() - старшие 31 бит состояния
+class TestRandom {
+public:
+    explicit TestRandom(uint64_t seed) : state_(seed) {}
+
+    int Next() {
+        state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<int>(state_ >> 33);
+    }
+
+private:
+    uint64_t state_;
+};
+
 int DoRemove(Database &db, const string &str) {
     istringstream is(str);
     auto condition = ParseCondition(is);
-    auto predicate = [condition](const Date &date, const string &event) {
-        return condition->Evaluate(date, event);
-    };
-    return db.RemoveIf(predicate);
+    return DispatchCondition(condition, [&db](auto predicate) {
+        return db.RemoveIf(predicate);
+    });
 }
 
 string DoFind(Database &db, const string &str) {
     istringstream is(str);
     auto condition = ParseCondition(is);
-    auto predicate = [condition](const Date &date, const string &event) {
-        return condition->Evaluate(date, event);
-    };
-    const auto entries = db.FindIf(predicate);
+    const auto entries = DispatchCondition(condition, [&db](auto predicate) {
+        return db.FindIf(predicate);
+    });
+    ostringstream os;
+    for (const auto &entry : entries) {
+        os << entry << endl;
+    }
+    os << entries.size();
+    return os.str();
+}
+
+int DoRemove(LsmDatabase &db, const string &str) {
+    istringstream is(str);
+    return db.RemoveIf(ParseCondition(is));
+}
+
+string DoFind(LsmDatabase &db, const string &str) {
+    istringstream is(str);
+    const auto entries = db.FindIf(ParseCondition(is));
     ostringstream os;
     for (const auto &entry : entries) {
         os << entry << endl;
@@ -140,9 +162,15 @@ string DoFind(Database &db, const string &str) {
     return os.str();
 }
 
+//LsmDatabase для тестов поведения: прогон на каждое событие, слияние по два
+struct SmallLsmDatabase : LsmDatabase {
+    SmallLsmDatabase() : LsmDatabase({1, 2, ""}) {}
+};
+
+template <typename DB>
 void TestDbAdd() {
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 7}, "xmas");
         ostringstream out;
@@ -150,7 +178,7 @@ void TestDbAdd() {
         AssertEqual("2017-01-01 new year\n2017-01-07 xmas\n", out.str(), "straight ordering");
     }
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 1}, "holiday");
         ostringstream out;
@@ -158,7 +186,7 @@ void TestDbAdd() {
         AssertEqual("2017-01-01 new year\n2017-01-01 holiday\n", out.str(), "several in one day");
     }
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 7}, "xmas");
         db.Add({2017, 1, 1}, "new year");
         ostringstream out;
@@ -166,7 +194,7 @@ void TestDbAdd() {
         AssertEqual("2017-01-01 new year\n2017-01-07 xmas\n", out.str(), "reverse ordering");
     }
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 1}, "xmas");
@@ -177,9 +205,10 @@ void TestDbAdd() {
     }
 }
 
+template <typename DB>
 void TestDbFind() {
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 7}, "xmas");
         AssertEqual("2017-01-01 new year\n1", DoFind(db, "date == 2017-01-01"), "simple find by date");
@@ -188,7 +217,7 @@ void TestDbFind() {
         AssertEqual("2017-01-01 new year\n1", DoFind(db, R"(event != "xmas")"), "multiple find by holiday");
     }
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 1}, "new year2");
         db.Add({2017, 1, 7}, "xmas");
@@ -202,8 +231,9 @@ void TestDbFind() {
     }
 }
 
+template <typename DB>
 void TestDbLast() {
-    Database db;
+    DB db;
     db.Add({2017, 1, 1}, "new year");
     db.Add({2017, 1, 7}, "xmas");
     {
@@ -232,9 +262,10 @@ void TestDbLast() {
     }
 }
 
+template <typename DB>
 void TestDbRemoveIf() {
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 7}, "xmas");
         AssertEqual(0, DoRemove(db, R"(event == "something")"), "Remove nothing");
@@ -244,7 +275,7 @@ void TestDbRemoveIf() {
         AssertEqual("2017-01-07 xmas\n", out.str(), "Remove by date, left");
     }
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 7}, "xmas");
         AssertEqual(1, DoRemove(db, R"(event == "xmas")"), "Remove by event");
@@ -253,7 +284,7 @@ void TestDbRemoveIf() {
         AssertEqual("2017-01-01 new year\n", out.str(), "Remove by event, left");
     }
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 7}, "xmas");
         db.Add({2017, 1, 7}, "new year");
@@ -264,9 +295,10 @@ void TestDbRemoveIf() {
     }
 }
 
+template <typename DB>
 void TestInsertionOrder() {
     {
-        Database db;
+        DB db;
         db.Add({2017, 1, 1}, "new year");
         db.Add({2017, 1, 7}, "xmas");
         db.Add({2017, 1, 7}, "party");
@@ -661,6 +693,28 @@ void TestDatabase() {
     }
 }
 
+void TestDateYearRange() {
+    auto parse = [](const string &text) {
+        istringstream is(text);
+        return ParseDate(is);
+    };
+    const Date last = parse(to_string(Date::MAX_YEAR) + "-12-31");
+    const Date first = parse(to_string(Date::MIN_YEAR) + "-01-01");
+    Assert(first.GetPacked() < Date(0, 1, 1).GetPacked() && Date(0, 1, 1).GetPacked() < last.GetPacked(),
+           "packed order at the edges");
+    AssertEqual(UnpackDate(last.GetPacked()), last, "max year round trip");
+    AssertEqual(UnpackDate(first.GetPacked()), first, "min year round trip");
+    for (const string &text : {to_string(Date::MAX_YEAR + 1) + "-01-01", to_string(Date::MIN_YEAR - 1) + "-12-31",
+                               string("2147483647-01-01")}) {
+        try {
+            parse(text);
+            Assert(false, "year out of range: " + text);
+        } catch (runtime_error &e) {
+            AssertEqual(string(e.what()), "Year value is invalid: " + text.substr(0, text.find('-', 1)), text);
+        }
+    }
+}
+
 void TestDateComparisonNode() {
     {
         DateComparisonNode dcn(Comparison::Equal, {2017, 11, 18});
@@ -853,6 +907,1453 @@ void TestParseCondition() {
 }
 
 
+void TestConditionDispatch() {
+    auto shape_of = [](const string &str) {
+        istringstream is(str);
+        return AnalyzeCondition(ParseCondition(is)).type;
+    };
+    Assert(shape_of("") == ConditionShapeType::DateRange, "empty condition is a date range");
+    Assert(shape_of("date >= 2017-01-01 AND date < 2017-07-01") == ConditionShapeType::DateRange,
+           "date range");
+    Assert(shape_of(R"(event == "holiday")") == ConditionShapeType::EventEqual, "event equality");
+    Assert(shape_of(R"(date >= 2017-01-01 AND date < 2017-07-01 AND event == "sport event")") ==
+           ConditionShapeType::DateRangeAndEvent, "date range and event");
+    Assert(shape_of(R"(event == "holiday" OR (event == "sport event" OR event == "xmas"))") ==
+           ConditionShapeType::EventOneOf, "or of equalities");
+    Assert(shape_of(R"(event != "holiday")") == ConditionShapeType::Generic, "not equal falls back");
+    Assert(shape_of(R"(date < 2017-01-01 AND (event == "holiday" OR event == "sport event"))") ==
+           ConditionShapeType::Generic, "mixed tree falls back");
+
+    Database db;
+    db.Add({2016, 12, 31}, "holiday");
+    db.Add({2017, 1, 1}, "holiday");
+    db.Add({2017, 1, 1}, "sport event");
+    db.Add({2017, 6, 30}, "sport event");
+    db.Add({2017, 7, 1}, "sport event");
+    db.Add({2017, 7, 1}, "xmas");
+    const vector<string> conditions = {
+            "",
+            "date > 2017-01-01",
+            "date <= 2017-01-01",
+            "date == 2017-07-01",
+            "date >= 2017-01-01 AND date < 2017-07-01",
+            "date > 2017-07-01 AND date < 2017-01-01",
+            R"(event == "sport event")",
+            R"(date >= 2017-01-01 AND date < 2017-07-01 AND event == "sport event")",
+            R"(event == "holiday" OR event == "xmas")",
+    };
+    for (const string &condition : conditions) {
+        istringstream is(condition);
+        NodePredicate generic(ParseCondition(is));
+        ostringstream expected;
+        for (const auto &entry : db.FindIf(generic)) {
+            expected << entry << endl;
+        }
+        expected << db.FindIf(generic).size();
+        AssertEqual(DoFind(db, condition), expected.str(), "dispatched find: " + condition);
+    }
+    AssertEqual(DoRemove(db, R"(date >= 2017-01-01 AND date < 2017-07-01 AND event == "sport event")"), 2,
+                "dispatched remove");
+    AssertEqual(DoFind(db, ""), "2016-12-31 holiday\n2017-01-01 holiday\n2017-07-01 sport event\n2017-07-01 xmas\n4",
+                "dispatched remove, left");
+}
+
+void TestEventMatch() {
+    const vector<string> samples = {
+            "", "a", "holiday", "holiday ", "sport event", "0123456789abcdef", "0123456789abcdeF",
+            "0123456789abcdef!", "0123456789abcdef?", "a very long event name that spans several prefixes",
+            "a very long event name that spans several prefixeS", "xmas", "holiday"
+    };
+    EventDictionary dictionary;
+    EventColumn column(&dictionary);
+    for (int round = 0; round < 5; ++round) {
+        for (const string &s : samples) {
+            column.push_back(dictionary.Intern(s));
+        }
+    }
+    for (const string &needle : {samples[0], samples[2], samples[5], samples[9], string("absent")}) {
+        Bitmap expected;
+        ClearBitmap(expected, column.size());
+        for (size_t i = 0; i < column.size(); ++i) {
+            if (column[i] == needle) {
+                SetBit(expected, i);
+            }
+        }
+        for (auto kernel : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2}) {
+            Bitmap selection;
+            ClearBitmap(selection, column.size());
+            if (MatchEventEqualWith(kernel, column, dictionary.Find(needle), selection)) {
+                Assert(selection == expected, "event match kernel " + to_string(static_cast<int>(kernel)) +
+                                              " for \"" + needle + "\"");
+            }
+        }
+    }
+
+    EventComparisonNode not_equal(Comparison::NotEqual, "holiday");
+    EventBatch batch;
+    batch.events = &column;
+    batch.size = column.size();
+    Bitmap selection;
+    not_equal.EvaluateBatch(batch, selection);
+    AssertEqual(CountBits(selection), column.size() - 10, "not equal through the kernel");
+
+    Bitmap erase;
+    ClearBitmap(erase, column.size());
+    SetBit(erase, 0);
+    SetBit(erase, 2);
+    AssertEqual(column.EraseSelected(erase), 2u, "erase selected");
+    AssertEqual(column[0], samples[1], "erase keeps order");
+    AssertEqual(column[1], samples[3], "erase keeps order after gap");
+}
+
+void TestEventDictionary() {
+    EventDictionary dictionary;
+    AssertEqual(dictionary.Find("holiday"), EventDictionary::NO_EVENT, "empty dictionary");
+    const uint32_t holiday = dictionary.Intern("holiday");
+    AssertEqual(dictionary.Intern("sport event"), holiday + 1, "ids are sequential");
+    AssertEqual(dictionary.Intern("holiday"), holiday, "same text, same id");
+    for (int i = 0; i < 1000; ++i) {
+        dictionary.Intern("event " + to_string(i));
+    }
+    AssertEqual(dictionary.size(), 1002u, "dictionary size");
+    AssertEqual(dictionary.Find("holiday"), holiday, "find after rehash");
+    AssertEqual(dictionary.Get(dictionary.Find("event 500")), "event 500", "text by id");
+
+    Database db;
+    db.Add({2017, 1, 1}, "holiday");
+    db.Add({2017, 1, 2}, "holiday");
+    db.Add({2017, 1, 2}, "workday");
+    db.Add({2017, 1, 2}, "holiday");
+    AssertEqual(db.Dictionary().size(), 2u, "events are stored once");
+    EventEqualPredicate xmas("xmas");
+    AssertEqual(db.FindIf(xmas).size(), 0u, "event not yet in dictionary");
+    db.Add({2017, 1, 3}, "xmas");
+    AssertEqual(db.FindIf(xmas), vector<string>{"2017-01-03 xmas"}, "event added after first lookup");
+
+    Database copy = db;
+    copy.Add({2017, 1, 4}, "copy only");
+    ostringstream out;
+    db.Print(out);
+    AssertEqual(out.str(), "2017-01-01 holiday\n2017-01-02 holiday\n2017-01-02 workday\n2017-01-03 xmas\n",
+                "copy does not change the original");
+}
+
+void TestDictionaryCompaction() {
+    Database db;
+    db.SetPartitioning(DatePartitioning::Month);
+    for (int i = 0; i < 3000; ++i) {
+        db.Add({2017, 1, 1 + i % 28}, "event " + to_string(i));
+    }
+    db.Add({2017, 1, 5}, "holiday");
+    db.Add({2017, 3, 8}, "holiday");
+    db.Add({2017, 3, 8}, "event 7");
+    db.CreateView("holidays", R"(event == "holiday")");
+    db.CreateView("march", "date >= 2017-03-01");
+    EventEqualPredicate holiday("holiday");
+    AssertEqual(db.FindIf(holiday).size(), 2u, "before compaction");
+    const size_t before = db.Dictionary().size();
+
+    AssertEqual(DoRemove(db, R"(event != "holiday" AND date < 2017-01-28)"), 2893, "remove most events");
+    Assert(db.Dictionary().size() < before / 2, "dictionary is compacted");
+    AssertEqual(db.FindIf(holiday), vector<string>{"2017-01-05 holiday", "2017-03-08 holiday"},
+                "cached event id follows the new dictionary");
+    AssertEqual(DoFind(db, R"(event == "event 7")"), "2017-03-08 event 7\n1", "find after compaction");
+    AssertEqual(db.Last({2017, 3, 9}), "2017-03-08 event 7", "last after compaction");
+    AssertEqual(db.ReadView("holidays"), vector<string>{"2017-01-05 holiday", "2017-03-08 holiday"},
+                "view after compaction");
+    AssertEqual(db.ReadView("march"), vector<string>{"2017-03-08 holiday", "2017-03-08 event 7"},
+                "view after compaction");
+    db.Add({2017, 1, 27}, "event 26");
+    AssertEqual(db.FindIf(EventEqualPredicate("event 26")).size(), 1u, "duplicate check after compaction");
+
+    const size_t compacted = db.Dictionary().size();
+    AssertEqual(DoRemove(db, R"(event == "holiday")"), 2, "small remove");
+    AssertEqual(db.Dictionary().size(), compacted, "dictionary below the threshold is kept");
+}
+
+void TestDatabaseAllocation() {
+    auto fill = [](Database &db) {
+        for (int day = 1; day <= 28; ++day) {
+            for (int i = 0; i < day; ++i) {
+                db.Add({2017, 2, day}, "event " + to_string(i % 5) + (i > 5 ? " with a text longer than sso" : ""));
+            }
+        }
+        return DoRemove(db, R"(event == "event 3" OR date == 2017-02-10)");
+    };
+    Database arena(DatabaseAllocation::Arena);
+    Database plain(DatabaseAllocation::Default);
+    AssertEqual(fill(arena), fill(plain), "same removals");
+    AssertEqual(DoFind(arena, ""), DoFind(plain, ""), "same contents");
+
+    Database copy = arena;
+    copy.Add({2018, 1, 1}, "copy only");
+    DoRemove(arena, "date < 2017-02-05");
+    AssertEqual(DoFind(copy, "date >= 2018-01-01"), "2018-01-01 copy only\n1", "copy has its own storage");
+    AssertEqual(DoFind(arena, "date >= 2018-01-01"), "0", "original is not changed by the copy");
+
+    Database moved = move(copy);
+    AssertEqual(DoFind(copy, ""), "0", "moved-from database is empty");
+    copy.Add({2019, 1, 1}, "reused");
+    AssertEqual(DoFind(copy, ""), "2019-01-01 reused\n1", "moved-from database is usable");
+
+    //крупные массивы событий возвращаются системе: при постоянном числе живых дат память не растёт
+    Database churn(DatabaseAllocation::Arena);
+    auto system_bytes = [&churn]() {
+        ostringstream os;
+        churn.PrintStats(os);
+        const string stats = os.str();
+        return stoull(stats.substr(stats.find("taken from system ") + 18));
+    };
+    auto day_date = [](int day) {
+        return Date(2017 + day / 336, 1 + day / 28 % 12, 1 + day % 28);
+    };
+    size_t after_first = 0;
+    for (int day = 0; day < 400; ++day) {
+        const Date date = day_date(day);
+        for (int i = 0; i < 2000; ++i) {
+            churn.Add(date, to_string(i));
+        }
+        if (day >= 10) {
+            DoRemove(churn, "date == " + day_date(day - 10).ToString());
+        }
+        if (day == 20) {
+            after_first = system_bytes();
+        }
+    }
+    Assert(system_bytes() < 2 * after_first, "arena memory stays bounded under churn");
+
+    moved.Clear();
+    AssertEqual(DoFind(moved, ""), "0", "clear");
+    moved.Add({2020, 1, 1}, "after clear");
+    AssertEqual(moved.Last({2020, 1, 2}), "2020-01-01 after clear", "add after clear");
+}
+
+void TestDedupIndex() {
+    DedupIndex index;
+    set<pair<int, uint32_t>> expected;
+    TestRandom random(12345);
+    for (int step = 0; step < 20000; ++step) {
+        const int date = Date(2000 + random.Next() % 3, 1 + random.Next() % 12, 1 + random.Next() % 28).GetPacked();
+        const uint32_t id = random.Next() % 50;
+        if (random.Next() % 3 == 0) {
+            AssertEqual(index.Erase(date, id), expected.erase({date, id}) == 1, "erase");
+        } else {
+            AssertEqual(index.Insert(date, id), expected.insert({date, id}).second, "insert");
+        }
+    }
+    AssertEqual(index.size(), expected.size(), "size");
+    for (const auto &item : expected) {
+        Assert(index.Contains(item.first, item.second), "contains after erases");
+    }
+    Assert(!index.Contains(Date(1999, 1, 1).GetPacked(), 1), "absent date");
+    Assert(!index.Contains(Date(2000, 1, 1).GetPacked(), 50), "absent event");
+
+    DedupIndex copy(index, pmr::new_delete_resource());
+    AssertEqual(copy.size(), index.size(), "copy");
+
+    Database db;
+    db.Add({2017, 1, 1}, "holiday");
+    db.Add({2017, 1, 1}, "holiday");
+    DoRemove(db, R"(event == "holiday")");
+    db.Add({2017, 1, 1}, "holiday");
+    AssertEqual(DoFind(db, ""), "2017-01-01 holiday\n1", "add again after remove");
+}
+
+void TestDateDirectory() {
+    DateDirectory directory;
+    EventDictionary dictionary;
+    map<int, size_t> expected;//дата -> число событий
+    TestRandom random(777);
+    for (int step = 0; step < 5000; ++step) {
+        const int date = Date(1990 + random.Next() % 20, 1 + random.Next() % 12, 1 + random.Next() % 28).GetPacked();
+        directory.FindOrInsert(date, &dictionary).push_back(0);
+        ++expected[date];
+    }
+    AssertEqual(directory.size(), expected.size(), "size after random inserts");
+    vector<int> walked;
+    for (const auto &block : directory.Blocks()) {
+        Assert(block.dates.size() <= DateDirectory::BLOCK_SIZE, "block size");
+        for (size_t i = 0; i < block.dates.size(); ++i) {
+            walked.push_back(block.dates[i]);
+            AssertEqual(block.columns[i].size(), expected[block.dates[i]], "column of date");
+        }
+    }
+    Assert(is_sorted(walked.begin(), walked.end()), "dates sorted across blocks");
+    AssertEqual(walked.size(), expected.size(), "walk covers all dates");
+
+    for (int step = 0; step < 2000; ++step) {
+        const int date = Date(1989 + random.Next() % 22, 1 + random.Next() % 12, 1 + random.Next() % 31).GetPacked();
+        AssertEqual(directory.Find(date) != nullptr, expected.count(date) == 1, "find");
+        DateDirectory::Position position;
+        auto it = expected.upper_bound(date);
+        const bool found = directory.FindLastNotAfter(date, position);
+        AssertEqual(found, it != expected.begin(), "last not after: found");
+        if (found) {
+            AssertEqual(directory.Blocks()[position.block].dates[position.index], prev(it)->first,
+                        "last not after: date");
+        }
+    }
+
+    for (auto &block : directory.Blocks()) {//опустошаем каждую вторую дату
+        for (size_t i = 0; i < block.dates.size(); i += 2) {
+            expected.erase(block.dates[i]);
+            block.columns[i].clear();
+        }
+    }
+    directory.RemoveEmptyDates();
+    AssertEqual(directory.size(), expected.size(), "size after removing empty dates");
+    for (const auto &item : expected) {
+        Assert(directory.Find(item.first) != nullptr, "kept date");
+    }
+
+    DateDirectory copy(directory, pmr::new_delete_resource());
+    AssertEqual(copy.size(), directory.size(), "copy");
+
+    Database db;
+    for (int day = 28; day >= 1; --day) {//даты по убыванию: вставка в начало и деление блоков
+        for (int month = 12; month >= 1; --month) {
+            db.Add({2017, month, day}, "event");
+        }
+    }
+    AssertEqual(db.Last({2017, 6, 30}), "2017-06-28 event", "last between months");
+    AssertEqual(db.Last({2016, 12, 31}), "No entries", "last before first date");
+    AssertEqual(DoRemove(db, "date < 2017-12-01"), 308, "remove dates");
+    AssertEqual(db.Last({2018, 1, 1}), "2017-12-28 event", "last after remove");
+    AssertEqual(db.Last({2017, 11, 30}), "No entries", "last of removed range");
+}
+
+void TestLastIndex() {
+    LastIndex index;
+    map<int, uint32_t> expected;
+    TestRandom random(99);
+    for (int step = 0; step < 3000; ++step) {
+        const int date = Date(2000 + random.Next() % 10, 1 + random.Next() % 12, 1 + random.Next() % 28).GetPacked();
+        const uint32_t id = random.Next() % 100;
+        index.Set(date, id);
+        expected[date] = id;
+    }
+    AssertEqual(index.size(), expected.size(), "size");
+    for (int step = 0; step < 3000; ++step) {
+        const int date = Date(1999 + random.Next() % 12, 1 + random.Next() % 12, 1 + random.Next() % 31).GetPacked();
+        int found = 0;
+        uint32_t id = 0;
+        auto it = expected.upper_bound(date);
+        AssertEqual(index.FindLastNotAfter(date, found, id), it != expected.begin(), "found");
+        if (it != expected.begin()) {
+            AssertEqual(found, prev(it)->first, "date");
+            AssertEqual(id, prev(it)->second, "event");
+        }
+    }
+
+    Database db;
+    db.Add({2017, 1, 5}, "a");
+    db.Add({2017, 1, 1}, "b");
+    db.Add({2017, 1, 5}, "c");
+    db.Add({2017, 1, 5}, "a");
+    AssertEqual(db.Last({2017, 1, 6}), "2017-01-05 c", "last added event of date");
+    ostringstream os;
+    os << *db.LastEntry({2017, 1, 4});
+    AssertEqual(os.str(), "2017-01-01 b", "entry view");
+    Assert(!db.LastEntry({2016, 12, 31}), "no entry");
+    DoRemove(db, R"(event == "c")");
+    AssertEqual(db.Last({2017, 1, 6}), "2017-01-05 a", "last after removing last event");
+    DoRemove(db, "date == 2017-01-05");
+    AssertEqual(db.Last({2017, 1, 6}), "2017-01-01 b", "last after removing date");
+    Database copy(db);
+    copy.Add({2017, 2, 1}, "d");
+    AssertEqual(db.Last({2017, 3, 1}), "2017-01-01 b", "copy is independent");
+    AssertEqual(copy.Last({2017, 3, 1}), "2017-02-01 d", "copy gets own entries");
+}
+
+void TestLastMany() {
+    Database db;
+    for (int day = 1; day <= 28; day += 3) {
+        db.Add({2018, 3, day}, "day " + to_string(day));
+    }
+    vector<Date> dates;
+    TestRandom random(5);
+    for (int i = 0; i < 500; ++i) {
+        dates.push_back({2018, 2 + random.Next() % 3, 1 + random.Next() % 31});
+    }
+    const auto many = db.LastMany(dates);
+    AssertEqual(many.size(), dates.size(), "one answer per date");
+    for (size_t i = 0; i < dates.size(); ++i) {
+        const auto single = db.LastEntry(dates[i]);
+        AssertEqual(static_cast<bool>(many[i]), static_cast<bool>(single), "found as single");
+        if (single) {
+            AssertEqual(many[i]->date, single->date, "date as single");
+            AssertEqual(many[i]->event, single->event, "event as single");
+        }
+    }
+    const auto ordered = db.LastMany({{2018, 3, 30}, {2018, 3, 1}, {2018, 2, 28}, {2018, 3, 5}});
+    ostringstream os;
+    for (const auto &last : ordered) {
+        if (last) {
+            os << *last << ';';
+        } else {
+            os << "No entries;";
+        }
+    }
+    AssertEqual(os.str(), "2018-03-28 day 28;2018-03-01 day 1;No entries;2018-03-04 day 4;", "caller order");
+    Assert(Database().LastMany({{2018, 1, 1}})[0] == nullopt, "empty database");
+}
+
+void TestMaterializedViews() {
+    Database db;
+    db.Add({2017, 1, 1}, "holiday");
+    db.Add({2017, 1, 1}, "sport event");
+    db.Add({2017, 3, 8}, "holiday");
+    db.CreateView("holidays", R"(event == "holiday")");
+    db.CreateView("spring", "date >= 2017-03-01 AND date < 2017-06-01");
+    db.CreateView("all", "");
+    AssertEqual(db.ReadView("holidays"), vector<string>{"2017-01-01 holiday", "2017-03-08 holiday"}, "initial fill");
+    Assert(!db.DropView("missing"), "drop unknown");
+    try {
+        db.CreateView("all", "");
+        Assert(false, "duplicate name");
+    } catch (invalid_argument &) {
+    }
+
+    db.Add({2017, 4, 1}, "holiday");
+    db.Add({2016, 12, 31}, "holiday");
+    db.Add({2017, 4, 1}, "holiday");
+    db.Add({2017, 4, 1}, "meeting");
+    AssertEqual(db.ReadView("holidays"), vector<string>{"2016-12-31 holiday", "2017-01-01 holiday",
+                                                        "2017-03-08 holiday", "2017-04-01 holiday"}, "add");
+    AssertEqual(db.ReadView("spring"), vector<string>{"2017-03-08 holiday", "2017-04-01 holiday",
+                                                      "2017-04-01 meeting"}, "add to date range");
+    AssertEqual(db.Views()[0].Stats().events_tested, 3u, "each new event tested once");
+
+    DoRemove(db, "date == 2017-03-08");
+    DoRemove(db, R"(event == "holiday" AND date > 2017-01-01)");
+    AssertEqual(db.ReadView("holidays"), vector<string>{"2016-12-31 holiday", "2017-01-01 holiday"}, "remove");
+    AssertEqual(db.ReadView("spring"), vector<string>{"2017-04-01 meeting"}, "remove from date range");
+    AssertEqual(db.Views()[1].Stats().events_removed, 2u, "removed metric");
+
+    //после любой последовательности изменений представление совпадает с Find
+    TestRandom random(3);
+    for (int step = 0; step < 2000; ++step) {
+        const Date date(2017, 1 + random.Next() % 6, 1 + random.Next() % 28);
+        if (random.Next() % 5 == 0) {
+            DoRemove(db, "date == " + date.ToString() + " AND event == \"e" + to_string(random.Next() % 4) + "\"");
+        } else {
+            db.Add(date, random.Next() % 3 == 0 ? "holiday" : "e" + to_string(random.Next() % 4));
+        }
+    }
+    Database copy(db);
+    copy.Add({2018, 5, 5}, "holiday");
+    for (const auto &view : db.Views()) {
+        AssertEqual(db.ReadView(view.Name()), db.FindIf(NodePredicate(view.Condition())), "view equals find: " + view.Name());
+        AssertEqual(db.ReadView(view.Name()).size(), view.size(), "view size");
+    }
+    AssertEqual(copy.ReadView("holidays").size(), db.ReadView("holidays").size() + 1, "copy keeps own views");
+
+    db.Clear();
+    AssertEqual(db.Views().size(), 3u, "clear keeps views");
+    Assert(db.ReadView("all").empty(), "clear empties views");
+    Assert(db.DropView("all"), "drop");
+    AssertEqual(db.Views().size(), 2u, "dropped");
+}
+
+shared_ptr<Node> Condition(const string &text) {
+    istringstream is(text);
+    return ParseCondition(is);
+}
+
+void TestResultCache() {
+    AssertEqual(CanonicalCondition(Condition(R"(event == "a" AND date > 2017-01-01)")),
+                CanonicalCondition(Condition(R"((date>2017-01-01) AND event=="a" AND event == "a")")), "canonical and");
+    AssertEqual(CanonicalCondition(Condition(R"(event == "a" OR (event == "b" OR event == "c"))")),
+                CanonicalCondition(Condition(R"((event == "c" OR event == "b") OR event == "a")")), "canonical or");
+    Assert(CanonicalCondition(Condition(R"(event == "a" AND date > 2017-01-01)")) !=
+           CanonicalCondition(Condition(R"(event == "a" OR date > 2017-01-01)")), "and differs from or");
+    Assert(CanonicalCondition(Condition(R"(event == "a\" OR event == \"b")")) !=
+           CanonicalCondition(Condition(R"(event == "a" OR event == "b")")), "quotes escaped");
+    Assert(ConditionDateRange(Condition("date >= 2017-01-01 AND date < 2017-02-01")) ==
+           make_pair(Date(2017, 1, 1).GetPacked(), Date(2017, 2, 1).GetPacked() - 1), "range and");
+    Assert(ConditionDateRange(Condition(R"(date == 2017-01-01 OR date == 2017-03-01)")) ==
+           make_pair(Date(2017, 1, 1).GetPacked(), Date(2017, 3, 1).GetPacked()), "range or");
+    Assert(ConditionDateRange(Condition(R"(date == 2017-01-01 OR event == "a")")) == make_pair(INT_MIN, INT_MAX),
+           "range with event");
+
+    Database db;
+    db.Add({2017, 1, 1}, "a");
+    db.Add({2017, 3, 1}, "b");
+    const auto january = db.FindCached(Condition("date < 2017-02-01"));
+    AssertEqual(*january, vector<string>{"2017-01-01 a"}, "miss");
+    Assert(db.FindCached(Condition("date<2017-02-01")) == january, "hit for other spelling");
+    db.FindCached(Condition("date > 2017-02-01"));
+    db.Add({2017, 3, 2}, "c");
+    Assert(db.FindCached(Condition("date < 2017-02-01")) == january, "unrelated add keeps entry");
+    AssertEqual(*db.FindCached(Condition("date > 2017-02-01")), vector<string>{"2017-03-01 b", "2017-03-02 c"},
+                "overlapping add invalidates");
+    DoRemove(db, R"(event == "a")");
+    Assert(db.FindCached(Condition("date < 2017-02-01"))->empty(), "remove invalidates");
+    ResultCacheStats stats = db.CacheStats();
+    AssertEqual(stats.hits, 2u, "hits");
+    AssertEqual(stats.misses, 4u, "misses");
+    AssertEqual(stats.invalidated, 2u, "invalidated");
+    AssertEqual(stats.entries, 2u, "entries");
+    Assert(stats.memory > 0, "memory");
+
+    ResultCache cache(2);
+    auto result = make_shared<const vector<string>>(vector<string>{"x"});
+    cache.Insert("1", 0, 0, result);
+    cache.Insert("2", 0, 0, result);
+    cache.Find("1");
+    cache.Insert("3", 0, 0, result);
+    Assert(cache.Find("2") == nullptr, "least recently used evicted");
+    Assert(cache.Find("1") != nullptr && cache.Find("3") != nullptr, "recent entries kept");
+    AssertEqual(cache.Stats().evicted, 1u, "evicted");
+
+    //байтовый лимит: крупные результаты вытесняют старые записи, а слишком крупный не кэшируется
+    const auto big = make_shared<const vector<string>>(vector<string>(10, string(100, 'x')));
+    const size_t big_memory = [&big]() {
+        ResultCache measure;
+        measure.Insert("a", 0, 0, big);
+        return measure.Stats().memory;
+    }();
+    ResultCache bounded(100, 2 * big_memory + big_memory / 2);
+    bounded.Insert("a", 0, 0, big);
+    bounded.Insert("b", 0, 0, big);
+    bounded.Find("a");
+    bounded.Insert("c", 0, 0, big);
+    Assert(bounded.Find("b") == nullptr && bounded.Find("a") != nullptr, "evicted by memory");
+    Assert(bounded.Stats().memory <= 2 * big_memory + big_memory / 2, "memory within budget");
+    bounded.Insert("huge", 0, 0, make_shared<const vector<string>>(vector<string>(100, string(100, 'x'))));
+    Assert(bounded.Find("huge") == nullptr && bounded.Find("a") != nullptr, "oversized result not cached");
+
+    //после любых изменений кэшированный ответ совпадает с FindIf
+    const vector<string> conditions = {"", "date < 2017-03-01", "date >= 2017-05-01 AND date <= 2017-05-31",
+                                       R"(event == "e1" OR date == 2017-02-02)", R"(event != "e2")"};
+    TestRandom random(11);
+    for (int step = 0; step < 1000; ++step) {
+        const Date date(2017, 1 + random.Next() % 6, 1 + random.Next() % 28);
+        const int action = random.Next() % 10;
+        if (action < 5) {
+            const auto condition = Condition(conditions[random.Next() % conditions.size()]);
+            AssertEqual(*db.FindCached(condition), db.FindIf(NodePredicate(condition)), "cached equals find");
+        } else if (action < 9) {
+            db.Add(date, "e" + to_string(random.Next() % 4));
+        } else {
+            DoRemove(db, "date == " + date.ToString());
+        }
+    }
+}
+
+void TestAggregates() {
+    Database db;
+    db.Add({2017, 1, 1}, "holiday");
+    db.Add({2017, 1, 1}, "sport");
+    db.Add({2017, 1, 7}, "holiday");
+    db.Add({2017, 2, 1}, "work");
+    db.Add({2018, 1, 1}, "holiday");
+    const auto all = Condition("");
+    const auto holidays = Condition(R"(event == "holiday")");
+    const auto year2017 = Condition("date >= 2017-01-01 AND date <= 2017-12-31");
+
+    AssertEqual(db.CountIf(NodePredicate(all)), 5u, "count all");
+    AssertEqual(DispatchCondition(year2017, [&db](auto predicate) {return db.CountIf(predicate);}), 4u, "count dates");
+    AssertEqual(DispatchCondition(holidays, [&db](auto predicate) {return db.CountIf(predicate);}), 3u, "count events");
+
+    const auto by_month = db.CountByIf(NodePredicate(all), DateGrouping::Month);
+    vector<string> months;
+    for (const auto &count : by_month) {
+        months.push_back(DateGroupName(count.first, DateGrouping::Month) + " " + to_string(count.second));
+    }
+    AssertEqual(months, vector<string>{"2017-01 3", "2017-02 1", "2018-01 1"}, "count by month");
+    const auto by_year = DispatchCondition(holidays, [&db](auto predicate) {
+        return db.CountByIf(predicate, DateGrouping::Year);
+    });
+    AssertEqual(by_year.size(), 2u, "count by year groups");
+    AssertEqual(DateGroupName(by_year[0].first, DateGrouping::Year), "2017", "year name");
+    AssertEqual(by_year[0].second, 2u, "count by year");
+    const auto by_date = db.CountByIf(NodePredicate(year2017), DateGrouping::Date);
+    AssertEqual(DateGroupName(by_date[0].first, DateGrouping::Date) + " " + to_string(by_date[0].second),
+                string("2017-01-01 2"), "count by date");
+
+    const auto distinct = DispatchCondition(year2017, [&db](auto predicate) {return db.DistinctEventsIf(predicate);});
+    AssertEqual(distinct.size(), 3u, "distinct");
+    AssertEqual(distinct[0].first + " " + to_string(distinct[0].second), string("holiday 2"), "distinct sorted");
+    Assert(db.DistinctEventsIf(NodePredicate(Condition(R"(event == "none")"))).empty(), "distinct none");
+
+    //агрегаты согласованы с Find при любых формах условия
+    const vector<string> texts = {"", "date < 2017-02-01", R"(event != "holiday")", R"(event == "work" OR event == "sport")"};
+    for (const string &text : texts) {
+        const auto condition = Condition(text);
+        const size_t found = db.FindIf(NodePredicate(condition)).size();
+        AssertEqual(DispatchCondition(condition, [&db](auto predicate) {return db.CountIf(predicate);}), found,
+                    "count equals find: " + text);
+        size_t grouped = 0;
+        for (const auto &count : db.CountByIf(NodePredicate(condition), DateGrouping::Month)) {
+            grouped += count.second;
+        }
+        AssertEqual(grouped, found, "groups sum to count: " + text);
+    }
+}
+
+void TestFindPages() {
+    string text = R"(date > 2017-01-01 AND event == "LIMIT 5" LIMIT 10 DESC OFFSET 3)";
+    FindOptions options = ParseFindOptions(text);
+    AssertEqual(text, R"(date > 2017-01-01 AND event == "LIMIT 5" )", "condition left");
+    AssertEqual(options.limit, 10u, "limit");
+    AssertEqual(options.offset, 3u, "offset");
+    Assert(options.descending, "desc");
+    text = R"(event == "a LIMIT 5")";
+    Assert(!ParseFindOptions(text).Paged(), "keyword inside quotes");
+    AssertEqual(text, R"(event == "a LIMIT 5")", "quoted event kept");
+    {
+        Database quoted;
+        quoted.Add({2017, 2, 1}, "a LIMIT 5");
+        quoted.Add({2017, 2, 1}, "a");
+        AssertEqual(DoFind(quoted, text), "2017-02-01 a LIMIT 5\n1", "event containing LIMIT");
+    }
+    text = R"(event == "x DESC" OR event == "OFFSET 2" LIMIT 4)";
+    AssertEqual(ParseFindOptions(text).limit, 4u, "limit after quoted keywords");
+    AssertEqual(text, R"(event == "x DESC" OR event == "OFFSET 2" )", "quoted keywords kept");
+    text = "";
+    Assert(!ParseFindOptions(text).Paged(), "no options");
+    text = "LIMIT x";
+    try {
+        ParseFindOptions(text);
+        Assert(false, "bad limit");
+    } catch (logic_error &) {
+    }
+
+    Database db;
+    for (int day = 1; day <= 20; ++day) {
+        for (int j = 0; j < day % 4; ++j) {
+            db.Add({2017, 1, day}, "e" + to_string(j));
+        }
+    }
+    const vector<string> conditions = {"", "date >= 2017-01-05 AND date < 2017-01-17", R"(event == "e1")",
+                                       R"(event != "e0")", "date != 2017-01-10"};
+    for (const string &condition_text : conditions) {
+        const auto condition = Condition(condition_text);
+        const vector<string> all = db.FindIf(NodePredicate(condition));
+        for (bool descending : {false, true}) {
+            vector<string> ordered = all;
+            if (descending) {
+                reverse(ordered.begin(), ordered.end());
+            }
+            for (size_t offset : {0u, 1u, 7u, 100u}) {
+                for (size_t limit : {0u, 1u, 5u, 1000u}) {
+                    FindOptions page;
+                    page.limit = limit;
+                    page.offset = offset;
+                    page.descending = descending;
+                    vector<string> expected;
+                    for (size_t i = offset; i < ordered.size() && expected.size() < limit; ++i) {
+                        expected.push_back(ordered[i]);
+                    }
+                    AssertEqual(DispatchCondition(condition, [&db, &page](auto predicate) {
+                        return db.FindIf(predicate, page);
+                    }), expected, "page of " + condition_text);
+                }
+            }
+        }
+    }
+}
+
+void TestExportImport() {
+    Database source;
+    for (int i = 0; i < 5000; ++i) {
+        source.Add({2000 + i % 7, 1 + i % 12, 1 + i % 28}, "event " + to_string(i % 3000));
+    }
+    const auto condition = Condition(R"(event != "event 1")");
+    ostringstream output;
+    const size_t exported = source.ExportIf(NodePredicate(condition), output);
+    AssertEqual(exported, source.FindIf(NodePredicate(condition)).size(), "exported count");
+    Assert(exported > ExportWriter::CHUNK_SIZE, "several chunks");
+
+    Database target;
+    target.Add({2001, 1, 1}, "already here");
+    target.CreateView("late", "date >= 2005-01-01");
+    istringstream input(output.str());
+    AssertEqual(target.Import(input), exported, "imported count");
+    AssertEqual(target.FindIf(NodePredicate(Condition(R"(event != "already here")"))),
+                source.FindIf(NodePredicate(condition)), "same rows after import");
+    AssertEqual(target.ReadView("late"), target.FindIf(NodePredicate(Condition("date >= 2005-01-01"))), "views updated");
+    AssertEqual(target.Last({2003, 1, 1}), source.Last({2003, 1, 1}), "last after import");
+    istringstream again(output.str());
+    AssertEqual(target.Import(again), 0u, "reimport adds nothing");
+
+    string corrupted = output.str();
+    corrupted[100] ^= 1;
+    istringstream bad(corrupted);
+    try {
+        Database().Import(bad);
+        Assert(false, "checksum");
+    } catch (runtime_error &) {
+    }
+    istringstream truncated(output.str().substr(0, output.str().size() - 10));
+    try {
+        Database().Import(truncated);
+        Assert(false, "truncated");
+    } catch (runtime_error &) {
+    }
+    Database untouched;
+    untouched.Add({2001, 1, 1}, "already here");
+    string late_corruption = output.str();
+    late_corruption[late_corruption.size() - 30] ^= 1;//последний блок с данными
+    istringstream late(late_corruption);
+    try {
+        untouched.Import(late);
+        Assert(false, "late checksum");
+    } catch (runtime_error &) {
+    }
+    AssertEqual(untouched.FindIf(NodePredicate(Condition(""))).size(), 1u, "failed import changes nothing");
+
+    string huge_count = output.str().substr(0, 8);
+    const uint32_t count = 1u << 24;
+    huge_count.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    huge_count.append(64, '\0');
+    istringstream huge(huge_count);
+    try {
+        Database().Import(huge);
+        Assert(false, "count beyond stream");
+    } catch (runtime_error &error) {
+        AssertEqual(string(error.what()), string("Import: corrupted chunk header"), "count checked against stream size");
+    }
+
+    istringstream text("2017-01-01 holiday");
+    try {
+        Database().Import(text);
+        Assert(false, "not an export file");
+    } catch (runtime_error &) {
+    }
+    AssertEqual(Crc32("123456789", 9), 0xCBF43926u, "crc32 check value");
+}
+
+void TestStats() {
+    LatencyHistogram histogram;
+    for (int i = 1; i <= 100; ++i) {
+        histogram.Record(chrono::microseconds(i));
+    }
+    AssertEqual(histogram.Count(), 100u, "histogram count");
+    AssertEqual(histogram.MaxNanoseconds(), 100000u, "histogram max");
+    Assert(histogram.PercentileNanoseconds(0.5) >= 50000 && histogram.PercentileNanoseconds(0.5) <= 100000,
+           "median bucket bound");
+    Assert(histogram.MeanNanoseconds() > 50000 && histogram.MeanNanoseconds() < 51000, "mean");
+
+    Database db;
+    for (int day = 1; day <= 10; ++day) {
+        db.Add({2017, 1, day}, "a");
+        db.Add({2017, 1, day}, "b");
+    }
+    Stats &stats = Stats::Instance();
+    stats.Reset();
+    db.FindIf(NodePredicate(Condition("date <= 2017-01-03")));
+    ScanCounters totals = stats.ScanTotals();
+    AssertEqual(totals.dates_visited, 10u, "dates visited");
+    AssertEqual(totals.events_scanned, 0u, "date condition scans no events");
+    AssertEqual(totals.events_matched, 6u, "matched by dates");
+    stats.Reset();
+    DoRemove(db, R"(event == "a")");
+    totals = stats.ScanTotals();
+    AssertEqual(totals.events_scanned, 20u, "events scanned");
+    AssertEqual(totals.events_matched, 10u, "events removed");
+
+    stats.SetEnabled(false);
+    db.FindIf(NodePredicate(Condition("")));
+    stats.SetEnabled(true);
+    AssertEqual(stats.ScanTotals().events_matched, 10u, "disabled stats are not recorded");
+    for (uint32_t i = 0; i < Stats::PARSE_SAMPLE * 3; ++i) {
+        Condition("");
+    }
+    Assert(stats.ParseLatency().Count() >= 3, "parse sampled");
+
+    ostringstream os;
+    stats.Print(os);
+    db.PrintStats(os);
+    Assert(os.str().find("events scanned 20") != string::npos, "printed scans");
+    Assert(os.str().find("arena: allocations") != string::npos, "printed arena");
+    stats.Reset();
+}
+
+void TestSlowQueryLog() {
+    SpscRing<int> ring(3);
+    AssertEqual(ring.capacity(), 4u, "capacity rounded up");
+    for (int i = 0; i < 4; ++i) {
+        Assert(ring.TryPush(int(i)), "push");
+    }
+    Assert(!ring.TryPush(4), "full ring rejects");
+    int value = -1;
+    Assert(ring.TryPop(value) && value == 0, "fifo order");
+    Assert(ring.TryPush(4), "push after pop");
+    for (int expected = 1; expected <= 4; ++expected) {
+        Assert(ring.TryPop(value) && value == expected, "pop in order");
+    }
+    Assert(!ring.TryPop(value), "empty ring");
+
+    ParseTiming timing;
+    istringstream is(R"(date > 2017-01-01 AND event != "a")");
+    ParseCondition(is, &timing);
+    Assert(timing.tokenize.count() > 0 && timing.parse.count() > 0, "parse phases timed");
+
+    QueryTrace trace;
+    trace.command = "Find";
+    trace.account = "user";
+    trace.text = R"(event == "a\"b")";
+    trace.tokenize = chrono::microseconds(100);
+    trace.parse = chrono::microseconds(200);
+    trace.plan = chrono::microseconds(50);
+    trace.scan = chrono::microseconds(900);
+    trace.format = chrono::microseconds(150);
+    trace.write = chrono::microseconds(100);
+    trace.total = chrono::microseconds(1500);
+    trace.rows_returned = 7;
+    const string line = FormatQueryTrace(trace);
+    Assert(line.find("total_us=1500.0") != string::npos, "total");
+    for (const string &phase : {"tokenize_us=100.0", "parse_us=200.0", "plan_us=50.0", "scan_us=900.0",
+                                "format_us=150.0", "write_us=100.0"}) {
+        Assert(line.find(phase) != string::npos, "phase " + phase);
+    }
+    Assert(line.find("command=Find") != string::npos, "command");
+    Assert(line.find("rows_returned=7") != string::npos, "rows returned");
+    Assert(line.find(R"(text="event == \"a\\\"b\"")") != string::npos, "escaped text");
+
+    const string path = "slow_query_log_test.txt";
+    remove(path.c_str());
+    {
+        SlowQueryLog log(path, chrono::milliseconds(1));
+        QueryTrace fast = trace;
+        fast.total = chrono::microseconds(10);
+        log.Submit(move(fast));
+        for (int i = 0; i < 3; ++i) {
+            QueryTrace slow = trace;
+            log.Submit(move(slow));
+        }
+    }
+    ifstream input(path);
+    vector<string> lines;
+    for (string text; getline(input, text);) {
+        lines.push_back(text);
+    }
+    input.close();
+    remove(path.c_str());
+    AssertEqual(lines.size(), 3u, "only slow commands are logged");
+    AssertEqual(lines[0], line, "logged line");
+}
+
+void TestPipeline() {
+    //ответы в порядке ввода при любой нарезке на пачки; CHANGE получает следующие слова ввода
+    string script;
+    for (int i = 0; i < 1000; ++i) {
+        script += "Echo " + to_string(i) + "\n";
+    }
+    script += "CHANGE\nuser secret\nEcho last\n";
+    for (size_t batch_size : {1u, 7u, 256u}) {
+        istringstream input(script);
+        ostringstream output;
+        PipelineOptions options;
+        options.batch_size = batch_size;
+        options.queue_capacity = 2;
+        RunPipeline(input, output, [](const string &line, istream &credentials, ostream &out) {
+            istringstream is(line);
+            string command, argument;
+            is >> command >> argument;
+            if (command == "CHANGE") {
+                string login, password;
+                credentials >> login >> password;
+                out << "login " << login << ' ' << password << '\n';
+            } else if (command == "Echo") {
+                out << argument << '\n';
+            }
+        }, options);
+        string expected;
+        for (int i = 0; i < 1000; ++i) {
+            expected += to_string(i) + "\n";
+        }
+        expected += "login user secret\nlast\n";
+        AssertEqual(output.str(), expected, "pipeline output, batch " + to_string(batch_size));
+    }
+
+    //приглашения CHANGE выведены вместе со всеми предыдущими ответами до того, как читается логин
+    {
+        istringstream input("Echo first\nCHANGE\nuser secret\nEcho after\n");
+        ostringstream output;
+        string seen_before_login;
+        RunPipeline(input, output, [&output, &seen_before_login](const string &line, istream &credentials, ostream &out) {
+            istringstream is(line);
+            string command, argument;
+            is >> command >> argument;
+            if (command == "CHANGE") {
+                out << "login? " << flush;
+                string login, password;
+                credentials >> login;
+                seen_before_login = output.str();
+                out << "password? " << flush;
+                credentials >> password;
+                out << login << ' ' << password << '\n';
+            } else if (command == "Echo") {
+                out << argument << '\n';
+            }
+        });
+        AssertEqual(seen_before_login, string("first\nlogin? "), "prompt shown before reading credentials");
+        AssertEqual(output.str(), string("first\nlogin? password? user secret\nafter\n"), "pipeline output after CHANGE");
+    }
+
+    //та же база, что и без конвейера
+    Database sequential, pipelined;
+    const string commands = "Add 2017-01-01 a\nAdd 2017-01-02 b\nDel event == \"a\"\nAdd 2017-01-01 c\n";
+    auto apply = [](Database &db) {
+        return [&db](const string &line, istream &, ostream &out) {
+            istringstream is(line);
+            string command;
+            is >> command;
+            if (command == "Add") {
+                const Date date = ParseDate(is);
+                db.Add(date, ParseEvent(is));
+            } else if (command == "Del") {
+                out << DoRemove(db, ParseEvent(is)) << '\n';
+            }
+        };
+    };
+    istringstream input(commands);
+    ostringstream output;
+    RunPipeline(input, output, apply(pipelined));
+    istringstream sequential_input(commands);
+    ostringstream sequential_output;
+    for (string line; getline(sequential_input, line);) {
+        apply(sequential)(line, sequential_input, sequential_output);
+    }
+    AssertEqual(output.str(), sequential_output.str(), "same answers");
+    AssertEqual(pipelined.ToStringDB(), sequential.ToStringDB(), "same database");
+}
+
+void TestAddBuffer() {
+    TestRandom random(7);
+
+    //SetSorted против Set по одной дате
+    LastIndex sorted, single;
+    for (int round = 0; round < 20; ++round) {
+        map<int, uint32_t> updates;
+        for (int i = 0; i < 50; ++i) {
+            updates[Date(2000 + random.Next() % 5, 1 + random.Next() % 12, 1 + random.Next() % 28).GetPacked()] = random.Next() % 100;
+        }
+        for (const auto &update : updates) {
+            single.Set(update.first, update.second);
+        }
+        sorted.SetSorted(vector<pair<int, uint32_t>>(updates.begin(), updates.end()));
+        AssertEqual(sorted.size(), single.size(), "sorted size");
+        for (size_t i = 0; i < single.size(); ++i) {
+            Assert(sorted.DateAt(i) == single.DateAt(i) && sorted.EventAt(i) == single.EventAt(i), "sorted entry");
+        }
+    }
+
+    //FindOrInsert с подсказкой против обычного
+    EventDictionary dictionary;
+    DateDirectory hinted, plain;
+    for (int round = 0; round < 10; ++round) {
+        vector<int> dates;
+        for (int i = 0; i < 300; ++i) {
+            dates.push_back(Date(2000 + random.Next() % 5, 1 + random.Next() % 12, 1 + random.Next() % 28).GetPacked());
+        }
+        sort(dates.begin(), dates.end());
+        const uint32_t id = dictionary.Intern("round " + to_string(round));
+        DateDirectory::Position hint{0, 0};
+        for (int date : dates) {
+            hinted.FindOrInsert(date, &dictionary, hint).push_back(id);
+            plain.FindOrInsert(date, &dictionary).push_back(id);
+            Assert(&hinted.Blocks()[hint.block].columns[hint.index] == hinted.Find(date), "hint moves to date");
+        }
+    }
+    AssertEqual(hinted.size(), plain.size(), "hinted size");
+    for (const auto &block : plain.Blocks()) {
+        for (size_t i = 0; i < block.dates.size(); ++i) {
+            const EventColumn &column = *hinted.Find(block.dates[i]);
+            Assert(vector<string>(column.begin(), column.end()) == vector<string>(block.columns[i].begin(), block.columns[i].end()),
+                   "hinted column");
+        }
+    }
+
+    //база с буфером ведёт себя как без него
+    Database direct, buffered;
+    buffered.SetAddBuffer(64);
+    buffered.CreateView("sport", R"(event == "sport")");
+    direct.CreateView("sport", R"(event == "sport")");
+    const vector<string> events = {"sport", "holiday", "work", "sport event"};
+    for (int i = 0; i < 1000; ++i) {
+        const Date date(2017, 1 + random.Next() % 3, 1 + random.Next() % 28);
+        const string &event = events[random.Next() % events.size()];
+        direct.Add(date, event);
+        buffered.Add(date, event);
+        if (i % 97 == 0) {
+            AssertEqual(buffered.Last({2017, 2, 10}), direct.Last({2017, 2, 10}), "last sees buffer");
+        }
+        if (i % 251 == 0) {
+            AssertEqual(DoRemove(buffered, "date == 2017-02-03"), DoRemove(direct, "date == 2017-02-03"), "remove sees buffer");
+        }
+    }
+    Assert(buffered.Pending() > 0, "events wait in buffer");
+    AssertEqual(DoFind(buffered, R"(event != "work")"), DoFind(direct, R"(event != "work")"), "find sees buffer");
+    AssertEqual(buffered.Pending(), 0u, "find merges buffer");
+    buffered.Add({2016, 12, 31}, "sport");
+    direct.Add({2016, 12, 31}, "sport");
+    AssertEqual(buffered.ReadView("sport"), direct.ReadView("sport"), "views updated at once");
+    Database copy(buffered);
+    AssertEqual(copy.ToStringDB(), direct.ToStringDB(), "copy keeps buffer");
+    buffered.SetAddBuffer(0);
+    AssertEqual(buffered.Pending(), 0u, "turning buffer off merges it");
+    AssertEqual(buffered.ToStringDB(), direct.ToStringDB(), "same database");
+    buffered.SetAddBuffer(static_cast<size_t>(-1));
+    AssertEqual(buffered.AddBuffer(), Database::MAX_ADD_BUFFER, "capacity clamped");
+}
+
+void TestLsmDatabase() {
+    //фильтр Блума: добавленные ключи находятся всегда, чужие - редко
+    BloomFilter filter(1000);
+    for (int i = 0; i < 1000; ++i) {
+        filter.Add("key " + to_string(i));
+    }
+    size_t false_positives = 0;
+    for (int i = 0; i < 1000; ++i) {
+        Assert(filter.MayContain("key " + to_string(i)), "bloom has added key");
+        false_positives += filter.MayContain("other " + to_string(i));
+    }
+    Assert(false_positives < 50, "bloom false positive rate");
+
+    TestRandom random(11);
+    auto parse = [](const string &text) {
+        istringstream is(text);
+        return ParseCondition(is);
+    };
+
+    //прогоны на каждый Add: слияние, надгробия и повторное добавление удалённого
+    {
+        LsmDatabase db({1, 2, ""});
+        db.Add({2017, 1, 7}, "xmas");
+        db.Add({2017, 1, 1}, "new year");
+        db.Add({2017, 1, 7}, "party");
+        db.Add({2017, 1, 1}, "new year");
+        db.Add({2017, 1, 7}, "pie");
+        db.WaitForCompaction();
+        AssertEqual(db.ToStringDB(), "2017-01-01 new year\n2017-01-07 xmas\n2017-01-07 party\n2017-01-07 pie\n",
+                    "lsm order across runs");
+        AssertEqual(DoFind(db, R"(event == "party")"), "2017-01-07 party\n1", "lsm find event");
+        AssertEqual(db.RemoveIf(parse(R"(event == "xmas")")), 1, "lsm remove from run");
+        AssertEqual(db.RemoveIf(parse(R"(event == "xmas")")), 0, "lsm removed stays removed");
+        db.Add({2017, 1, 7}, "xmas");
+        AssertEqual(db.ToStringDB(), "2017-01-01 new year\n2017-01-07 party\n2017-01-07 pie\n2017-01-07 xmas\n",
+                    "lsm re-added goes last");
+        AssertEqual(db.Last({2017, 1, 10}), "2017-01-07 xmas", "lsm last newest");
+        AssertEqual(db.Last({2017, 1, 6}), "2017-01-01 new year", "lsm last before");
+        AssertEqual(db.Last({2016, 1, 6}), "No entries", "lsm last nothing");
+    }
+
+    //против Database на случайной нагрузке: маленькая memtable, слияние идёт во время запросов
+    const vector<string> events = {"sport", "holiday", "work", "sport event", "party"};
+    const vector<string> conditions = {"", R"(event == "sport")", "date < 2017-02-10", R"(event != "work")",
+                                       R"(date >= 2017-01-15 AND date <= 2017-02-15 AND event == "holiday")",
+                                       R"(event == "party" OR event == "work")", "date == 2017-03-01"};
+    Database expected;
+    LsmDatabase db({8, 2, ""});
+    for (int i = 0; i < 3000; ++i) {
+        const Date date(2017, 1 + random.Next() % 3, 1 + random.Next() % 28);
+        const string &event = events[random.Next() % events.size()];
+        expected.Add(date, event);
+        db.Add(date, event);
+        if (i % 50 == 0) {
+            const string &condition = conditions[random.Next() % conditions.size()];
+            AssertEqual(DoFind(db, condition), DoFind(expected, condition), "lsm find " + condition);
+        }
+        if (i % 37 == 0) {
+            AssertEqual(db.Last(date), expected.Last(date), "lsm last");
+        }
+        if (i % 113 == 0) {
+            const string removed = conditions[1 + random.Next() % (conditions.size() - 1)];
+            AssertEqual(db.RemoveIf(parse(removed)), DoRemove(expected, removed), "lsm remove " + removed);
+        }
+        if (i % 500 == 0) {
+            db.WaitForCompaction();
+        }
+    }
+    db.WaitForCompaction();
+    AssertEqual(db.ToStringDB(), expected.ToStringDB(), "lsm same database");
+}
+
+void TestEventFilter() {
+    //фильтр столбца не теряет добавленные номера ни при росте, ни после удалений
+    EventDictionary dictionary;
+    EventColumn column(&dictionary);
+    for (uint32_t id = 0; id < 1000; id += 2) {
+        column.push_back(id);
+        if (column.size() >= EventColumn::FILTERED_EVENTS) {
+            Assert(column.MayContain(id, 10), "filter has added id");
+        }
+    }
+    size_t false_positives = 0;
+    for (uint32_t id = 1; id < 1000; id += 2) {
+        false_positives += column.MayContain(id, 10);
+    }
+    Assert(false_positives < 25, "filter false positive rate");
+    Assert(column.MayContain(1, 0), "no filter when off");
+    Bitmap selection;
+    ClearBitmap(selection, column.size());
+    for (size_t i = 0; i < column.size(); i += 3) {
+        SetBit(selection, i);
+    }
+    column.EraseSelected(selection);
+    for (size_t i = 0; i < column.size(); ++i) {
+        Assert(column.MayContain(column.Id(i), 10), "filter rebuilt after erase");
+    }
+
+    //Find и Del с фильтрами и без дают одно и то же, а даты без события пропускаются
+    Database filtered, plain;
+    plain.SetEventFilter(0);
+    for (int day = 1; day <= 28; ++day) {
+        for (int i = 0; i < 200; ++i) {
+            filtered.Add({2017, 1, day}, "event " + to_string(i));
+            plain.Add({2017, 1, day}, "event " + to_string(i));
+        }
+        if (day % 7 == 0) {
+            filtered.Add({2017, 1, day}, "rare");
+            plain.Add({2017, 1, day}, "rare");
+        }
+    }
+    Stats::ThreadScan() = {};
+    AssertEqual(DoFind(filtered, R"(event == "rare")"), DoFind(plain, R"(event == "rare")"), "filtered find");
+    AssertEqual(Stats::ThreadScan().filter_checks, 28u, "dates checked by filter");
+    Assert(Stats::ThreadScan().filter_skips >= 20, "dates without event skipped");
+    AssertEqual(DoFind(filtered, R"(date > 2017-01-10 AND event == "rare")"),
+                DoFind(plain, R"(date > 2017-01-10 AND event == "rare")"), "filtered range find");
+    AssertEqual(DoFind(filtered, R"(event == "rare" OR event == "event 5")"),
+                DoFind(plain, R"(event == "rare" OR event == "event 5")"), "filtered one of");
+    AssertEqual(DoRemove(filtered, R"(event == "rare")"), DoRemove(plain, R"(event == "rare")"), "filtered remove");
+    AssertEqual(DoFind(filtered, R"(event == "rare")"), "0", "removed event is gone");
+    filtered.Add({2017, 1, 3}, "rare");
+    plain.Add({2017, 1, 3}, "rare");
+    AssertEqual(DoFind(filtered, R"(event == "rare")"), DoFind(plain, R"(event == "rare")"), "added after filter built");
+    filtered.SetEventFilter(4);
+    AssertEqual(DoFind(filtered, R"(event == "event 7")"), DoFind(plain, R"(event == "event 7")"), "other bits per event");
+    Database copy(filtered);
+    AssertEqual(copy.EventFilter(), 4u, "copy keeps filter setting");
+    AssertEqual(DoFind(copy, R"(event == "rare")"), DoFind(plain, R"(event == "rare")"), "copied filters");
+    copy.SetEventFilter(1000);
+    AssertEqual(copy.EventFilter(), Database::MAX_EVENT_FILTER_BITS, "bits per event clamped");
+    AssertEqual(DoFind(copy, R"(event == "event 7")"), DoFind(plain, R"(event == "event 7")"), "widest filters");
+}
+
+void TestPartitions() {
+    //разделы по месяцам и годам, с буфером Add и без, отвечают так же, как база без разделов
+    Database plain;
+    vector<Database> partitioned(3);
+    partitioned[0].SetPartitioning(DatePartitioning::Month);
+    partitioned[1].SetPartitioning(DatePartitioning::Year);
+    partitioned[2].SetPartitioning(DatePartitioning::Month);
+    partitioned[2].SetAddBuffer(16);
+    TestRandom random(11);
+    auto random_date = [&random]() {
+        return Date(2015 + random.Next() % 4, 1 + random.Next() % 12, 1 + random.Next() % 28);
+    };
+    for (Database &db : partitioned) {
+        db.CreateView("holidays", R"(event == "holiday")");
+    }
+    plain.CreateView("holidays", R"(event == "holiday")");
+    for (int step = 0; step < 3000; ++step) {
+        const int action = random.Next() % 20;
+        if (action == 0) {
+            const string condition = "date < " + random_date().ToString();
+            const int removed = DoRemove(plain, condition);
+            for (Database &db : partitioned) {
+                AssertEqual(DoRemove(db, condition), removed, "remove " + condition);
+            }
+        } else if (action == 1) {
+            //только даты, но не один диапазон: разделы проверяются по каждой дате
+            const string condition = "date < " + random_date().ToString() + " OR date > " + random_date().ToString();
+            const int removed = DoRemove(plain, condition);
+            for (Database &db : partitioned) {
+                AssertEqual(DoRemove(db, condition), removed, "remove " + condition);
+            }
+        } else if (action == 2) {
+            const string condition = "event == \"e" + to_string(random.Next() % 10) + "\" AND date > " + random_date().ToString();
+            const int removed = DoRemove(plain, condition);
+            for (Database &db : partitioned) {
+                AssertEqual(DoRemove(db, condition), removed, "remove " + condition);
+            }
+        } else {
+            const Date date = random_date();
+            const string event = random.Next() % 7 ? "e" + to_string(random.Next() % 10) : "holiday";
+            plain.Add(date, event);
+            for (Database &db : partitioned) {
+                db.Add(date, event);
+            }
+        }
+    }
+    vector<Date> dates;
+    for (int i = 0; i < 200; ++i) {
+        dates.push_back(Date(2014 + random.Next() % 6, 1 + random.Next() % 12, 1 + random.Next() % 28));
+    }
+    const auto last = plain.LastMany(dates);
+    const vector<string> conditions = {"", "date >= 2016-03-05 AND date < 2017-02-01", R"(event == "e3")",
+                                       R"(date > 2017-06-01 OR event == "holiday")"};
+    for (const Database &db : partitioned) {
+        AssertEqual(db.ToStringDB(), plain.ToStringDB(), "same contents");
+        AssertEqual(db.ReadView("holidays"), plain.ReadView("holidays"), "same view");
+        for (const string &condition_text : conditions) {
+            const auto condition = Condition(condition_text);
+            for (bool descending : {false, true}) {
+                FindOptions page;
+                page.limit = 50;
+                page.offset = 7;
+                page.descending = descending;
+                auto find_page = [&condition, &page](const Database &from) {
+                    return DispatchCondition(condition, [&from, &page](auto predicate) {
+                        return from.FindIf(predicate, page);
+                    });
+                };
+                AssertEqual(find_page(db), find_page(plain), "page of " + condition_text);
+            }
+        }
+        const auto many = db.LastMany(dates);
+        for (size_t i = 0; i < dates.size(); ++i) {
+            const auto single = db.LastEntry(dates[i]);
+            AssertEqual(static_cast<bool>(many[i]), static_cast<bool>(last[i]), "last found");
+            AssertEqual(static_cast<bool>(single), static_cast<bool>(last[i]), "last entry found");
+            if (last[i]) {
+                AssertEqual(many[i]->date, last[i]->date, "last date");
+                AssertEqual(string(many[i]->event), string(last[i]->event), "last event");
+                AssertEqual(single->date, last[i]->date, "last entry date");
+            }
+        }
+    }
+
+    //Del по датам убирает целые разделы, не просматривая событий
+    Database db;
+    db.SetPartitioning(DatePartitioning::Month);
+    for (int month = 1; month <= 12; ++month) {
+        for (int day = 1; day <= 28; day += 9) {
+            db.Add({2017, month, day}, "a");
+            db.Add({2017, month, day}, "b");
+        }
+    }
+    AssertEqual(db.PartitionCount(), 12u, "one partition per month");
+    Stats::ThreadScan() = {};
+    AssertEqual(DoRemove(db, "date < 2017-04-01"), 24, "removed three months");
+    AssertEqual(db.PartitionCount(), 9u, "whole partitions dropped");
+    AssertEqual(Stats::ThreadScan().events_scanned, 0u, "no events scanned");
+    AssertEqual(Stats::ThreadScan().dates_visited, 0u, "no dates visited");
+    Stats::ThreadScan() = {};
+    AssertEqual(DoRemove(db, "date < 2017-04-15"), 4, "part of a partition");
+    AssertEqual(Stats::ThreadScan().dates_visited, 4u, "only the boundary partition visits its dates");
+    AssertEqual(db.PartitionCount(), 9u, "boundary partition kept");
+    AssertEqual(DoFind(db, "date < 2017-05-01"), "2017-04-19 a\n2017-04-19 b\n2017-04-28 a\n2017-04-28 b\n4",
+                "rest of boundary partition");
+    db.Add({2017, 2, 1}, "back");
+    AssertEqual(db.PartitionCount(), 10u, "partition created again");
+    AssertEqual(db.LastEntry({2017, 3, 31})->event, "back", "last from earlier partition");
+
+    //копия и смена разбиения сохраняют события и их порядок внутри даты
+    Database copy(db);
+    AssertEqual(copy.ToStringDB(), db.ToStringDB(), "copy");
+    copy.Add({2017, 2, 1}, "copy only");
+    AssertEqual(DoFind(db, R"(event == "copy only")"), "0", "copy is separate");
+    const string before = db.ToStringDB();
+    db.SetPartitioning(DatePartitioning::Year);
+    AssertEqual(db.PartitionCount(), 1u, "one year");
+    AssertEqual(db.ToStringDB(), before, "repartitioned");
+    db.SetPartitioning(DatePartitioning::None);
+    AssertEqual(db.ToStringDB(), before, "partitions off");
+    db.SetPartitioning(DatePartitioning::Month);
+    db.Clear();
+    Assert(db.Partitioning() == DatePartitioning::Month, "clear keeps partitioning");
+    AssertEqual(db.PartitionCount(), 0u, "clear drops partitions");
+    AssertEqual(DoRemove(db, "date < 2018-01-01"), 0, "remove from empty");
+}
+
+void TestTiering() {
+    const string directory = (filesystem::temp_directory_path() / ("db_tests_segments_" +
+            to_string(chrono::steady_clock::now().time_since_epoch().count()))).string();
+    auto files = [&directory]() {
+        return static_cast<size_t>(distance(filesystem::directory_iterator(directory), filesystem::directory_iterator()));
+    };
+    auto page_ins = [](const Database &db) {
+        ostringstream os;
+        db.PrintStats(os);
+        const string stats = os.str();
+        const size_t at = stats.find("paged in ");
+        return at == string::npos ? 0 : stoull(stats.substr(at + 9));
+    };
+    try {
+        Database().SetTiering({2018, 1, 1}, directory);
+        Assert(false, "tiering needs partitions");
+    } catch (invalid_argument &) {
+    }
+    try {
+        Database db;
+        db.SetPartitioning(DatePartitioning::Month);
+        db.SetTiering({2018, 1, 1}, "");
+        Assert(false, "tiering needs a directory");
+    } catch (invalid_argument &) {
+    }
+    {
+        Database plain, tiered;
+        tiered.SetPartitioning(DatePartitioning::Month);
+        for (Database *db : {&plain, &tiered}) {
+            db->CreateView("e1", R"(event == "e1")");
+        }
+        TestRandom random(7);
+        for (int i = 0; i < 4000; ++i) {
+            const Date date(2015 + random.Next() % 4, 1 + random.Next() % 12, 1 + random.Next() % 28);
+            const string event = "e" + to_string(random.Next() % 20);
+            plain.Add(date, event);
+            tiered.Add(date, event);
+        }
+        tiered.SetTiering({2018, 1, 1}, directory);
+        AssertEqual(tiered.EvictedPartitions(), 36u, "months before 2018 on disk");
+        AssertEqual(files(), 36u, "one segment per month");
+        AssertEqual(DoFind(tiered, "date >= 2018-03-01"), DoFind(plain, "date >= 2018-03-01"), "hot range");
+        AssertEqual(page_ins(tiered), 0u, "hot range reads no segment");
+        AssertEqual(tiered.Last({2019, 1, 1}), plain.Last({2019, 1, 1}), "last after cold range");
+        AssertEqual(tiered.Last({2017, 12, 31}), plain.Last({2017, 12, 31}), "last from segment metadata");
+        AssertEqual(page_ins(tiered), 0u, "last of a later date reads no segment");
+        AssertEqual(DoFind(tiered, "date >= 2016-02-01 AND date < 2016-03-01"),
+                    DoFind(plain, "date >= 2016-02-01 AND date < 2016-03-01"), "cold range");
+        AssertEqual(page_ins(tiered), 1u, "only the touched month is read");
+
+        SegmentBudget::Instance().SetLimit(1);//в памяти остаётся только последний подгруженный раздел
+        AssertEqual(DoFind(tiered, R"(event == "e3")"), DoFind(plain, R"(event == "e3")"), "find through all segments");
+        AssertEqual(tiered.EvictedPartitions(), 35u, "budget keeps one cold partition");
+        AssertEqual(tiered.ToStringDB(), plain.ToStringDB(), "print");
+        for (int day = 1; day <= 28; day += 5) {
+            const Date date(2016, 7, day);
+            AssertEqual(tiered.Last(date), plain.Last(date), "last in cold partition " + date.ToString());
+        }
+        vector<Date> dates;
+        for (int i = 0; i < 100; ++i) {
+            dates.push_back(Date(2014 + random.Next() % 6, 1 + random.Next() % 12, 1 + random.Next() % 28));
+        }
+        const auto expected = plain.LastMany(dates);
+        const auto many = tiered.LastMany(dates);
+        for (size_t i = 0; i < dates.size(); ++i) {
+            AssertEqual(static_cast<bool>(many[i]), static_cast<bool>(expected[i]), "last many found");
+            if (expected[i]) {
+                AssertEqual(many[i]->date, expected[i]->date, "last many date");
+                AssertEqual(string(many[i]->event), string(expected[i]->event), "last many event");
+            }
+        }
+
+        //изменения холодных разделов переживают выгрузку: сегмент пишется заново
+        for (Database *db : {&plain, &tiered}) {
+            db->Add({2016, 5, 3}, "late");
+            db->Add({2014, 1, 1}, "older");
+            DoRemove(*db, R"(event == "e4" AND date < 2017-06-01)");
+        }
+        DoFind(tiered, "date >= 2017-11-01");
+        AssertEqual(DoFind(tiered, "date < 2016-06-01"), DoFind(plain, "date < 2016-06-01"), "changes kept");
+        const size_t before = page_ins(tiered);
+        AssertEqual(DoRemove(tiered, "date < 2016-01-01"), DoRemove(plain, "date < 2016-01-01"), "retention");
+        AssertEqual(page_ins(tiered), before, "dropped segments are not read");
+        AssertEqual(tiered.ReadView("e1"), plain.ReadView("e1"), "view");
+
+        Database copy(tiered);
+        AssertEqual(copy.ToStringDB(), plain.ToStringDB(), "copy shares segments");
+        copy.DisableTiering();
+        copy.Add({2016, 2, 2}, "copy only");
+        AssertEqual(DoFind(tiered, R"(event == "copy only")"), "0", "copy is separate");
+        tiered.DisableTiering();
+        AssertEqual(tiered.EvictedPartitions(), 0u, "all in memory");
+        AssertEqual(tiered.ToStringDB(), plain.ToStringDB(), "tiering off");
+        SegmentBudget::Instance().SetLimit(SegmentBudget::DEFAULT_LIMIT);
+    }
+    {
+        //сегмент пропал с диска: запрос падает каждый раз, а не отвечает по недогруженному разделу
+        Database db;
+        db.SetPartitioning(DatePartitioning::Month);
+        for (int day = 1; day <= 20; ++day) {
+            db.Add({2016, 3, day}, "cold");
+        }
+        db.Add({2017, 5, 1}, "hot");
+        db.SetTiering({2017, 1, 1}, directory);
+        AssertEqual(db.EvictedPartitions(), 1u, "cold month on disk");
+        for (const auto &entry : filesystem::directory_iterator(directory)) {
+            filesystem::remove(entry.path());
+        }
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            try {
+                DoFind(db, "date < 2017-01-01");
+                Assert(false, "missing segment, attempt " + to_string(attempt));
+            } catch (runtime_error &) {
+            }
+        }
+        AssertEqual(db.EvictedPartitions(), 1u, "failed load leaves partition on disk");
+        AssertEqual(DoFind(db, "date >= 2017-01-01"), "2017-05-01 hot\n1", "hot partitions still answer");
+    }
+    AssertEqual(files(), 0u, "segments removed with databases");
+    filesystem::remove_all(directory);
+}
+
+void TestBatchEvaluation() {
+    vector<int> dates;
+    for (int year = 2015; year <= 2019; ++year) {
+        for (int month = 1; month <= 12; ++month) {
+            dates.push_back(Date(year, month, 1 + (year + month) % 28).GetPacked());
+        }
+    }
+    for (auto level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2}) {
+        Bitmap selection;
+        if (MatchDateRangeWith(level, dates.data(), dates.size(), Date(2016, 3, 1).GetPacked(),
+                               Date(2017, 12, 31).GetPacked(), selection)) {
+            AssertEqual(CountBits(selection), 22u, "date range kernel " + to_string(static_cast<int>(level)));
+            Assert(!TestBit(selection, 13) && TestBit(selection, 14) && TestBit(selection, 35) &&
+                   !TestBit(selection, 36), "date range kernel bounds " + to_string(static_cast<int>(level)));
+        }
+    }
+
+    const vector<string> conditions = {
+            "date >= 2016-03-01 AND date <= 2017-12-31",
+            "date != 2016-03-05 AND date > 2015-06-01",
+            "date < 2016-01-01 OR date > 2019-06-01",
+            R"(date < 2016-01-01 OR event == "holiday")",
+            R"(date > 2017-01-01 AND (event != "holiday" OR date == 2018-05-24))",
+            R"(event > "h")",
+    };
+    EventDictionary dictionary;
+    EventColumn events(&dictionary);
+    for (const auto &event : {"holiday", "workday", "sport event", "holiday", "xmas"}) {
+        events.push_back(dictionary.Intern(event));
+    }
+    for (const string &condition : conditions) {
+        istringstream is(condition);
+        auto root = ParseCondition(is);
+
+        if (!root->UsesEvents()) {
+            EventBatch batch;
+            batch.dates = dates.data();
+            batch.size = dates.size();
+            Bitmap selection;
+            root->EvaluateBatch(batch, selection);
+            for (size_t i = 0; i < dates.size(); ++i) {
+                const Date date(dates[i] / 512, dates[i] % 512 / 32, dates[i] % 32);
+                AssertEqual(TestBit(selection, i), root->Evaluate(date, ""), "date batch: " + condition);
+            }
+        }
+        for (int packed : dates) {
+            const Date date(packed / 512, packed % 512 / 32, packed % 32);
+            EventBatch batch;
+            batch.date = packed;
+            batch.events = &events;
+            batch.size = events.size();
+            Bitmap selection;
+            root->EvaluateBatch(batch, selection);
+            for (size_t i = 0; i < events.size(); ++i) {
+                AssertEqual(TestBit(selection, i), root->Evaluate(date, events[i]), "event batch: " + condition);
+            }
+        }
+    }
+
+    Database db;
+    db.Add({2016, 1, 1}, "new year");
+    db.Add({2016, 1, 1}, "holiday");
+    db.Add({2017, 1, 1}, "new year");
+    db.Add({2018, 1, 1}, "new year");
+    AssertEqual(DoFind(db, "date != 2017-01-01"), "2016-01-01 new year\n2016-01-01 holiday\n2018-01-01 new year\n3",
+                "find by dates only");
+    AssertEqual(DoRemove(db, "date < 2017-01-01 OR date > 2017-06-01"), 3, "remove by dates only");
+    AssertEqual(DoFind(db, ""), "2017-01-01 new year\n1", "remove by dates only, left");
+}
+
 void TestAll();
 
 void TestParseEvent() {
@@ -876,11 +2377,40 @@ void TestParseEvent() {
 void TestAll() {
     TestRunner tr;
     tr.RunTest(TestEmptyNode, "Test TestEmptyNode");
-    tr.RunTest(TestDbAdd, "Test TestDbAdd");
-    tr.RunTest(TestDbFind, "Test TestDbFind");
-    tr.RunTest(TestDbLast, "Test TestDbLast");
-    tr.RunTest(TestDbRemoveIf, "Test TestDbRemoveIf");
-    tr.RunTest(TestInsertionOrder, "Test for the order of output");
+    tr.RunTest(TestDateYearRange, "TestDateYearRange");
+    tr.RunTest(TestDbAdd<Database>, "Test TestDbAdd");
+    tr.RunTest(TestDbFind<Database>, "Test TestDbFind");
+    tr.RunTest(TestDbLast<Database>, "Test TestDbLast");
+    tr.RunTest(TestDbRemoveIf<Database>, "Test TestDbRemoveIf");
+    tr.RunTest(TestInsertionOrder<Database>, "Test for the order of output");
+    tr.RunTest(TestDbAdd<SmallLsmDatabase>, "Test TestDbAdd, lsm");
+    tr.RunTest(TestDbFind<SmallLsmDatabase>, "Test TestDbFind, lsm");
+    tr.RunTest(TestDbLast<SmallLsmDatabase>, "Test TestDbLast, lsm");
+    tr.RunTest(TestDbRemoveIf<SmallLsmDatabase>, "Test TestDbRemoveIf, lsm");
+    tr.RunTest(TestInsertionOrder<SmallLsmDatabase>, "Test for the order of output, lsm");
     tr.RunTest(TestParseEvent, "TestParseEvent");
     tr.RunTest(TestParseCondition, "TestParseCondition");
+    tr.RunTest(TestConditionDispatch, "TestConditionDispatch");
+    tr.RunTest(TestEventMatch, "TestEventMatch");
+    tr.RunTest(TestEventDictionary, "TestEventDictionary");
+    tr.RunTest(TestDictionaryCompaction, "TestDictionaryCompaction");
+    tr.RunTest(TestBatchEvaluation, "TestBatchEvaluation");
+    tr.RunTest(TestDatabaseAllocation, "TestDatabaseAllocation");
+    tr.RunTest(TestDedupIndex, "TestDedupIndex");
+    tr.RunTest(TestDateDirectory, "TestDateDirectory");
+    tr.RunTest(TestLastIndex, "TestLastIndex");
+    tr.RunTest(TestLastMany, "TestLastMany");
+    tr.RunTest(TestMaterializedViews, "TestMaterializedViews");
+    tr.RunTest(TestResultCache, "TestResultCache");
+    tr.RunTest(TestAggregates, "TestAggregates");
+    tr.RunTest(TestFindPages, "TestFindPages");
+    tr.RunTest(TestExportImport, "TestExportImport");
+    tr.RunTest(TestStats, "TestStats");
+    tr.RunTest(TestSlowQueryLog, "TestSlowQueryLog");
+    tr.RunTest(TestPipeline, "TestPipeline");
+    tr.RunTest(TestAddBuffer, "TestAddBuffer");
+    tr.RunTest(TestLsmDatabase, "TestLsmDatabase");
+    tr.RunTest(TestEventFilter, "TestEventFilter");
+    tr.RunTest(TestPartitions, "TestPartitions");
+    tr.RunTest(TestTiering, "TestTiering");
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+#include "database.h"
+#include "condition_parser.h"
+#include "predicates.h"
+#include "slow_query_log.h"
+#include "pipeline.h"
+#include "lsm_database.h"
+
+#include <set>
+#include <filesystem>
+#include <fstream>
+
+#include "test_functions.h"
+
+//Модульные тесты отдельной программой: сервер их при запуске не выполняет.
+//TestRunner завершает процесс с кодом 1, если хоть один тест упал
+int main() {
+    TestAll();
+    return 0;
+}